@@ -0,0 +1,859 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+#ifndef __KDRIVE_EXPRESS_ASYNC_HPP__
+#define __KDRIVE_EXPRESS_ASYNC_HPP__
+
+/*!
+	\file
+	C++20 coroutine layer over the access port and the service port.
+
+	Header-only, requires a C++20 compiler (coroutines) and links
+	against kdriveExpress only.
+
+	\code
+	kdrive::async::executor ex(2);
+	kdrive::async::access_port port(ap, ex);
+
+	kdrive::async::task<void> read_light(kdrive::async::access_port& port)
+	{
+		kdrive::async::group_value value = co_await port.read_group(0x0901);
+		...
+	}
+
+	kdrive::async::spawn(read_light(port));
+	\endcode
+
+	Group value reads do not block a thread: the GroupValue_Read is sent
+	with kdrive_ap_group_read and the operation completes from the telegram
+	callback of the access port (or from the timer of the port when the
+	timeout elapses). Concurrent reads of the same group address share one
+	GroupValue_Read telegram.
+
+	The device services of kdriveExpress are blocking. The service_port runs
+	them on a small number of worker threads, each with its own service port
+	descriptor, and queues the operations in between. The bus handles one
+	service at a time per connection anyway.
+
+	All completions resume the awaiting coroutine on an executor thread,
+	never on the notification thread of the access port or on a service
+	worker. The operation state lives in the coroutine frame, so an
+	operation in flight costs no thread and no allocation.
+*/
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "kdrive_express.h"
+#include "kdrive_express_handles.hpp"
+
+namespace kdrive
+{
+namespace async
+{
+
+/*******************************
+** Results
+********************************/
+
+/*!
+	The result of a group value read
+*/
+struct group_value
+{
+	error_t error = KDRIVE_ERROR_NONE; /*!< KDRIVE_ERROR_NONE, KDRIVE_TIMEOUT_ERROR or the send error */
+	uint16_t address = 0; /*!< the group address */
+	std::array<uint8_t, KDRIVE_MAX_GROUP_VALUE_LEN> data{}; /*!< the value of the GroupValue_Response */
+	uint32_t length = 0; /*!< the length of the value in octets */
+};
+
+/*!
+	The result of a device service read
+*/
+struct service_data
+{
+	error_t error = KDRIVE_ERROR_NONE; /*!< the result of the kdrive service */
+	std::array<uint8_t, 255> data{}; /*!< the data read */
+	uint32_t length = 0; /*!< the length of the data in octets */
+};
+
+/*******************************
+** Executor
+********************************/
+
+/*!
+	A fixed pool of threads which resumes the coroutines
+	of the completed operations.
+	Create the executor before the ports which post to it, so it
+	is destroyed after them and resumes their cancelled operations
+*/
+class executor
+{
+public:
+	explicit executor(unsigned thread_count = 1)
+	{
+		thread_count = thread_count ? thread_count : 1;
+		for (unsigned index = 0; index < thread_count; ++index)
+		{
+			threads_.emplace_back([this] { run(); });
+		}
+	}
+
+	/*!
+		Resumes the coroutines still queued (i.e. the operations cancelled
+		by the destructor of a port) and stops the threads
+	*/
+	~executor()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		cond_.notify_all();
+		for (std::thread& thread : threads_)
+		{
+			thread.join();
+		}
+	}
+
+	executor(const executor&) = delete;
+	executor& operator=(const executor&) = delete;
+
+	/*!
+		Queues a coroutine to be resumed on an executor thread
+	*/
+	void post(std::coroutine_handle<> handle)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			queue_.push_back(handle);
+		}
+		cond_.notify_one();
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		for (;;)
+		{
+			cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+			if (queue_.empty())
+			{
+				return;
+			}
+			std::coroutine_handle<> handle = queue_.front();
+			queue_.pop_front();
+			lock.unlock();
+			handle.resume();
+			lock.lock();
+		}
+	}
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::deque<std::coroutine_handle<> > queue_;
+	std::vector<std::thread> threads_;
+	bool stop_ = false;
+};
+
+/*******************************
+** Task
+********************************/
+
+template <typename T = void>
+class task;
+
+namespace detail
+{
+
+/*!
+	The part of the task promise which doesn't depend on the value type.
+	The task is lazy, it starts when it is awaited, and resumes
+	its awaiter when finished (symmetric transfer)
+*/
+struct promise_base
+{
+	struct final_awaiter
+	{
+		bool await_ready() noexcept
+		{
+			return false;
+		}
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+		{
+			return handle.promise().continuation;
+		}
+
+		void await_resume() noexcept
+		{
+		}
+	};
+
+	std::suspend_always initial_suspend() noexcept
+	{
+		return {};
+	}
+
+	final_awaiter final_suspend() noexcept
+	{
+		return {};
+	}
+
+	void unhandled_exception() noexcept
+	{
+		exception = std::current_exception();
+	}
+
+	void rethrow()
+	{
+		if (exception)
+		{
+			std::rethrow_exception(exception);
+		}
+	}
+
+	std::coroutine_handle<> continuation = std::noop_coroutine();
+	std::exception_ptr exception;
+};
+
+template <typename T>
+struct promise : promise_base
+{
+	task<T> get_return_object() noexcept;
+
+	void return_value(T result)
+	{
+		value = std::move(result);
+	}
+
+	T result()
+	{
+		rethrow();
+		return std::move(value);
+	}
+
+	T value{};
+};
+
+template <>
+struct promise<void> : promise_base
+{
+	task<void> get_return_object() noexcept;
+
+	void return_void() noexcept
+	{
+	}
+
+	void result()
+	{
+		rethrow();
+	}
+};
+
+} // namespace detail
+
+/*!
+	A coroutine returning T (T must be default constructible).
+	Move-only, the coroutine frame is destroyed with the task
+*/
+template <typename T>
+class task
+{
+public:
+	using promise_type = detail::promise<T>;
+
+	explicit task(std::coroutine_handle<promise_type> handle) noexcept
+		: handle_(handle)
+	{
+	}
+
+	task(task&& other) noexcept
+		: handle_(std::exchange(other.handle_, nullptr))
+	{
+	}
+
+	task& operator=(task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (handle_)
+			{
+				handle_.destroy();
+			}
+			handle_ = std::exchange(other.handle_, nullptr);
+		}
+		return *this;
+	}
+
+	~task()
+	{
+		if (handle_)
+		{
+			handle_.destroy();
+		}
+	}
+
+	task(const task&) = delete;
+	task& operator=(const task&) = delete;
+
+	auto operator co_await() noexcept
+	{
+		struct awaiter
+		{
+			std::coroutine_handle<promise_type> handle;
+
+			bool await_ready() noexcept
+			{
+				return !handle || handle.done();
+			}
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+			{
+				handle.promise().continuation = awaiting;
+				return handle;
+			}
+
+			T await_resume()
+			{
+				return handle.promise().result();
+			}
+		};
+
+		return awaiter{handle_};
+	}
+
+private:
+	std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail
+{
+
+template <typename T>
+task<T> promise<T>::get_return_object() noexcept
+{
+	return task<T>(std::coroutine_handle<promise<T> >::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() noexcept
+{
+	return task<void>(std::coroutine_handle<promise<void> >::from_promise(*this));
+}
+
+/*!
+	An eager coroutine which destroys itself when finished
+*/
+struct detached
+{
+	struct promise_type
+	{
+		detached get_return_object() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void return_void() noexcept
+		{
+		}
+
+		void unhandled_exception() noexcept
+		{
+			std::terminate();
+		}
+	};
+};
+
+inline detached run_detached(task<void> t)
+{
+	co_await t;
+}
+
+} // namespace detail
+
+/*!
+	Starts a task without awaiting it. The task runs on the calling
+	thread until its first suspension and on the executor afterwards.
+	An exception leaving the task terminates the application
+*/
+inline void spawn(task<void> t)
+{
+	detail::run_detached(std::move(t));
+}
+
+/*******************************
+** Access Port
+********************************/
+
+/*!
+	Group value reads on an open access port.
+	The access port descriptor remains owned by the caller
+	and must outlive this object
+*/
+class access_port
+{
+public:
+	static constexpr uint32_t default_timeout = 1000; /*!< in ms */
+
+	/*!
+		The awaitable GroupValue_Read
+	*/
+	class group_read
+	{
+	public:
+		group_read(access_port& port, uint16_t address, uint32_t timeout) noexcept
+			: port_(port), timeout_(timeout)
+		{
+			result_.address = address;
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		/*!
+			The operation can complete on another thread as soon as it
+			is linked, so after that only locals are used
+		*/
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			access_port& port = port_;
+			const uint16_t address = result_.address;
+			const bool send = port.link(*this, handle);
+
+			if (send)
+			{
+				const error_t e = kdrive_ap_group_read(port.ap_, address);
+				if (e != KDRIVE_ERROR_NONE)
+				{
+					port.fail(address, e);
+				}
+			}
+		}
+
+		group_value await_resume() const noexcept
+		{
+			return result_;
+		}
+
+	private:
+		friend class access_port;
+
+		access_port& port_;
+		uint32_t timeout_;
+		group_value result_;
+		std::coroutine_handle<> handle_;
+		group_read* prev_ = nullptr;
+		group_read* next_ = nullptr;
+		std::multimap<std::chrono::steady_clock::time_point, group_read*>::iterator timer_;
+	};
+
+	access_port(int32_t ap, executor& ex)
+		: ap_(ap), executor_(ex)
+	{
+		kdrive_ap_register_telegram_callback(ap_, &access_port::on_telegram, this, &key_);
+		timer_thread_ = std::thread([this] { run_timer(); });
+	}
+
+	access_port(const access_port_handle& ap, executor& ex)
+		: access_port(ap.get(), ex)
+	{
+	}
+
+	/*!
+		The pending reads complete with KDRIVE_SP_OPERATION_CANCELLED_ERROR
+	*/
+	~access_port()
+	{
+		kdrive_ap_remove_telegram_callback(ap_, key_);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+			while (!timers_.empty())
+			{
+				complete(*timers_.begin()->second, KDRIVE_SP_OPERATION_CANCELLED_ERROR);
+			}
+		}
+		cond_.notify_all();
+		timer_thread_.join();
+	}
+
+	access_port(const access_port&) = delete;
+	access_port& operator=(const access_port&) = delete;
+
+	/*!
+		Sends a GroupValue_Read (unless one is pending for the address)
+		and completes with the value of the GroupValue_Response
+	*/
+	group_read read_group(uint16_t address, uint32_t timeout = default_timeout) noexcept
+	{
+		return group_read(*this, address, timeout);
+	}
+
+	int32_t descriptor() const noexcept
+	{
+		return ap_;
+	}
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	/*!
+		Adds the read to the pending reads of its address and to the timers.
+		Returns true if it is the first read of the address,
+		i.e. the GroupValue_Read has to be sent
+	*/
+	bool link(group_read& read, std::coroutine_handle<> handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		read.handle_ = handle;
+		read.timer_ = timers_.emplace(clock::now() + std::chrono::milliseconds(read.timeout_), &read);
+		if (read.timer_ == timers_.begin())
+		{
+			cond_.notify_one();
+		}
+
+		group_read*& head = pending_[read.result_.address];
+		const bool first = (head == nullptr);
+		read.next_ = head;
+		if (head)
+		{
+			head->prev_ = &read;
+		}
+		head = &read;
+
+		return first;
+	}
+
+	/*!
+		Removes the read and resumes its coroutine.
+		Called with the mutex locked
+	*/
+	void complete(group_read& read, error_t e)
+	{
+		if (read.prev_)
+		{
+			read.prev_->next_ = read.next_;
+		}
+		else if (read.next_)
+		{
+			pending_[read.result_.address] = read.next_;
+		}
+		else
+		{
+			pending_.erase(read.result_.address);
+		}
+		if (read.next_)
+		{
+			read.next_->prev_ = read.prev_;
+		}
+		timers_.erase(read.timer_);
+
+		read.result_.error = e;
+		executor_.post(read.handle_);
+	}
+
+	/*!
+		Completes all pending reads of the address with the error
+	*/
+	void fail(uint16_t address, error_t e)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto it = pending_.find(address);
+		while (it != pending_.end())
+		{
+			complete(*it->second, e);
+			it = pending_.find(address);
+		}
+	}
+
+	/*!
+		Called on the notification thread of the access port
+	*/
+	static void on_telegram(const uint8_t telegram[], uint32_t telegram_len, void* user_data)
+	{
+		access_port* port = static_cast<access_port*>(user_data);
+		uint8_t data[KDRIVE_MAX_GROUP_VALUE_LEN];
+		uint32_t data_len = sizeof(data);
+		uint16_t address = 0;
+
+		if (!kdrive_ap_is_group_response(telegram, telegram_len) ||
+		        (kdrive_ap_get_dest(telegram, telegram_len, &address) != KDRIVE_ERROR_NONE) ||
+		        (kdrive_ap_get_group_data(telegram, telegram_len, data, &data_len) != KDRIVE_ERROR_NONE))
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(port->mutex_);
+
+		auto it = port->pending_.find(address);
+		while (it != port->pending_.end())
+		{
+			group_read& read = *it->second;
+			std::memcpy(read.result_.data.data(), data, data_len);
+			read.result_.length = data_len;
+			port->complete(read, KDRIVE_ERROR_NONE);
+			it = port->pending_.find(address);
+		}
+	}
+
+	void run_timer()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (!stop_)
+		{
+			if (timers_.empty())
+			{
+				cond_.wait(lock);
+				continue;
+			}
+
+			/* a copy, the timer can be removed while waiting */
+			const clock::time_point deadline = timers_.begin()->first;
+			const clock::time_point now = clock::now();
+			if (deadline > now)
+			{
+				cond_.wait_until(lock, deadline);
+				continue;
+			}
+
+			while (!timers_.empty() && (timers_.begin()->first <= now))
+			{
+				complete(*timers_.begin()->second, KDRIVE_TIMEOUT_ERROR);
+			}
+		}
+	}
+
+	int32_t ap_;
+	executor& executor_;
+	uint32_t key_ = 0;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::unordered_map<uint16_t, group_read*> pending_; /*!< the first pending read per address */
+	std::multimap<clock::time_point, group_read*> timers_;
+	std::thread timer_thread_;
+	bool stop_ = false;
+};
+
+#if KDRIVE_EXPRESS_SERVICES_INCLUDED == 1
+
+/*******************************
+** Service Port
+********************************/
+
+/*!
+	Device services on an open access port.
+	Each worker owns its own service port.
+	The access port descriptor remains owned by the caller
+	and must outlive this object
+*/
+class service_port
+{
+public:
+	using function_type = std::function<error_t(int32_t sp, service_data& result)>;
+
+	/*!
+		The awaitable device service
+	*/
+	class service_read
+	{
+	public:
+		service_read(service_port& port, function_type function)
+			: port_(port), function_(std::move(function))
+		{
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = handle;
+			port_.enqueue(*this);
+		}
+
+		service_data await_resume() const noexcept
+		{
+			return result_;
+		}
+
+	private:
+		friend class service_port;
+
+		service_port& port_;
+		function_type function_;
+		service_data result_;
+		std::coroutine_handle<> handle_;
+	};
+
+	service_port(int32_t ap, executor& ex, unsigned worker_count = 1)
+		: executor_(ex)
+	{
+		worker_count = worker_count ? worker_count : 1;
+		for (unsigned index = 0; index < worker_count; ++index)
+		{
+			service_port_handle sp = service_port_handle::create(ap);
+			if (sp)
+			{
+				workers_.emplace_back([this](service_port_handle sp) { run(sp.get()); }, std::move(sp));
+			}
+		}
+	}
+
+	service_port(const access_port_handle& ap, executor& ex, unsigned worker_count = 1)
+		: service_port(ap.get(), ex, worker_count)
+	{
+	}
+
+	/*!
+		The queued services complete with KDRIVE_SP_OPERATION_CANCELLED_ERROR,
+		the services in progress are finished first
+	*/
+	~service_port()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+			for (service_read* read : queue_)
+			{
+				read->result_.error = KDRIVE_SP_OPERATION_CANCELLED_ERROR;
+				executor_.post(read->handle_);
+			}
+			queue_.clear();
+		}
+		cond_.notify_all();
+		for (std::thread& worker : workers_)
+		{
+			worker.join();
+		}
+	}
+
+	service_port(const service_port&) = delete;
+	service_port& operator=(const service_port&) = delete;
+
+	/*!
+		Reads a property value, see kdrive_sp_prop_value_read
+	*/
+	service_read prop_value_read(uint16_t ind_addr, uint8_t object_index, uint8_t prop_id,
+	                             uint8_t nr_of_elems, uint16_t start_index)
+	{
+		return service_read(*this, [=](int32_t sp, service_data& result)
+		{
+			result.length = static_cast<uint32_t>(result.data.size());
+			return kdrive_sp_prop_value_read(sp, ind_addr, object_index, prop_id,
+			                                 nr_of_elems, start_index, result.data.data(), &result.length);
+		});
+	}
+
+	/*!
+		Reads memory, see kdrive_sp_memory_read
+	*/
+	service_read memory_read(uint16_t ind_addr, uint16_t memory_addr, uint8_t number)
+	{
+		return service_read(*this, [=](int32_t sp, service_data& result)
+		{
+			result.length = static_cast<uint32_t>(result.data.size());
+			return kdrive_sp_memory_read(sp, ind_addr, memory_addr, number,
+			                             result.data.data(), &result.length);
+		});
+	}
+
+	/*!
+		Runs any blocking call on a worker, i.e. the services
+		which are not wrapped above
+	*/
+	service_read call(function_type function)
+	{
+		return service_read(*this, std::move(function));
+	}
+
+private:
+	void enqueue(service_read& read)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (workers_.empty() || stop_)
+			{
+				read.result_.error = KDRIVE_SP_DESCRIPTOR_NOT_FOUND_ERROR;
+				executor_.post(read.handle_);
+				return;
+			}
+			queue_.push_back(&read);
+		}
+		cond_.notify_one();
+	}
+
+	void run(int32_t sp)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		for (;;)
+		{
+			cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+			if (queue_.empty())
+			{
+				break;
+			}
+			service_read* read = queue_.front();
+			queue_.pop_front();
+			lock.unlock();
+
+			read->result_.error = read->function_(sp, read->result_);
+			executor_.post(read->handle_);
+
+			lock.lock();
+		}
+	}
+
+	executor& executor_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::deque<service_read*> queue_;
+	std::vector<std::thread> workers_;
+	bool stop_ = false;
+};
+
+#endif /* KDRIVE_EXPRESS_SERVICES_INCLUDED == 1 */
+
+} // namespace async
+} // namespace kdrive
+
+#endif /* __KDRIVE_EXPRESS_ASYNC_HPP__ */
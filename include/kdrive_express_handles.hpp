@@ -0,0 +1,209 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+#ifndef __KDRIVE_EXPRESS_HANDLES_HPP__
+#define __KDRIVE_EXPRESS_HANDLES_HPP__
+
+/*!
+	\file
+	Owning C++ handles for the access port and service port descriptors.
+
+	Header-only, requires C++11. The handles can be moved but not copied,
+	the descriptor is released when the owning handle is destroyed.
+
+	\code
+	kdrive::access_port_handle ap = kdrive::access_port_handle::create();
+	if (ap && (kdrive_ap_open_usb(ap.get(), 0) == KDRIVE_ERROR_NONE))
+	{
+		kdrive::service_port_handle sp = kdrive::service_port_handle::create(ap);
+		...
+	}
+	\endcode
+
+	\note The descriptor is resolved inside the library on every call,
+	the handles only remove the create/release bookkeeping.
+*/
+
+#include <utility>
+
+#include "kdrive_express.h"
+
+namespace kdrive
+{
+
+namespace detail
+{
+
+/*!
+	A move-only owner of a descriptor.
+	Traits::release(descriptor) is called for a valid descriptor
+*/
+template <typename Traits>
+class descriptor_handle
+{
+public:
+	descriptor_handle() noexcept
+		: descriptor_(KDRIVE_INVALID_DESCRIPTOR)
+	{
+	}
+
+	/*!
+		Takes the ownership of the descriptor
+	*/
+	explicit descriptor_handle(int32_t descriptor) noexcept
+		: descriptor_(descriptor)
+	{
+	}
+
+	descriptor_handle(descriptor_handle&& other) noexcept
+		: descriptor_(other.release())
+	{
+	}
+
+	descriptor_handle& operator=(descriptor_handle&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset(other.release());
+		}
+		return *this;
+	}
+
+	~descriptor_handle()
+	{
+		reset();
+	}
+
+	descriptor_handle(const descriptor_handle&) = delete;
+	descriptor_handle& operator=(const descriptor_handle&) = delete;
+
+	/*!
+		Returns the descriptor, the handle keeps the ownership
+	*/
+	int32_t get() const noexcept
+	{
+		return descriptor_;
+	}
+
+	/*!
+		Returns the descriptor and gives up the ownership
+	*/
+	int32_t release() noexcept
+	{
+		const int32_t descriptor = descriptor_;
+		descriptor_ = KDRIVE_INVALID_DESCRIPTOR;
+		return descriptor;
+	}
+
+	/*!
+		Releases the descriptor and takes the ownership of the new one
+	*/
+	void reset(int32_t descriptor = KDRIVE_INVALID_DESCRIPTOR) noexcept
+	{
+		const int32_t old = descriptor_;
+		descriptor_ = descriptor;
+		if (old != KDRIVE_INVALID_DESCRIPTOR)
+		{
+			Traits::release(old);
+		}
+	}
+
+	void swap(descriptor_handle& other) noexcept
+	{
+		std::swap(descriptor_, other.descriptor_);
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return descriptor_ != KDRIVE_INVALID_DESCRIPTOR;
+	}
+
+private:
+	int32_t descriptor_;
+};
+
+struct access_port_traits
+{
+	/*!
+		An open access port is closed first
+	*/
+	static void release(int32_t ap) noexcept
+	{
+		if (kdrive_ap_is_open(ap))
+		{
+			kdrive_ap_close(ap);
+		}
+		kdrive_ap_release(ap);
+	}
+};
+
+#if KDRIVE_EXPRESS_SERVICES_INCLUDED == 1
+
+struct service_port_traits
+{
+	static void release(int32_t sp) noexcept
+	{
+		kdrive_sp_release(sp);
+	}
+};
+
+#endif /* KDRIVE_EXPRESS_SERVICES_INCLUDED == 1 */
+
+} // namespace detail
+
+/*!
+	Owns an access port descriptor
+*/
+class access_port_handle : public detail::descriptor_handle<detail::access_port_traits>
+{
+public:
+	using detail::descriptor_handle<detail::access_port_traits>::descriptor_handle;
+
+	/*!
+		Creates an access port, the handle is empty on error
+	*/
+	static access_port_handle create() noexcept
+	{
+		return access_port_handle(kdrive_ap_create());
+	}
+};
+
+#if KDRIVE_EXPRESS_SERVICES_INCLUDED == 1
+
+/*!
+	Owns a service port descriptor.
+	The access port must outlive the service port
+*/
+class service_port_handle : public detail::descriptor_handle<detail::service_port_traits>
+{
+public:
+	using detail::descriptor_handle<detail::service_port_traits>::descriptor_handle;
+
+	/*!
+		Creates a service port on the access port, the handle is empty on error
+	*/
+	static service_port_handle create(int32_t ap) noexcept
+	{
+		return service_port_handle(kdrive_sp_create(ap));
+	}
+
+	static service_port_handle create(const access_port_handle& ap) noexcept
+	{
+		return create(ap.get());
+	}
+};
+
+#endif /* KDRIVE_EXPRESS_SERVICES_INCLUDED == 1 */
+
+} // namespace kdrive
+
+#endif /* __KDRIVE_EXPRESS_HANDLES_HPP__ */
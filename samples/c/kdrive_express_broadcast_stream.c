@@ -0,0 +1,612 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Streaming variants of the broadcast read services.
+
+	kdrive_sp_ind_addr_prog_mode_read, kdrive_sp_system_network_param_read
+	and kdrive_sp_domain_addr_prog_mode_read wait for the whole wait_time
+	and return the responses in an array of fixed capacity.
+
+	The variants in this sample send the request with kdrive_ap_send
+	and pass each response to a callback as soon as it is received (on
+	the notification thread of the access port). They return when the
+	wait time elapsed, when the expected number of responses was
+	received, or when the callback returns 0. There is no limit on the
+	number of responses.
+
+	Start the sample with "sn" to read the serial numbers of all devices
+	(SystemNetworkParameterRead) or with "rf" to read the domain address
+	of a KNX RF device in programming mode.
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_broadcast_stream kdrive_express_broadcast_stream.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN					(128)	/*!< kdriveExpress Error Messages */
+#define MAX_TELEGRAM_LEN					(64)	/*!< max telegram buffer size */
+#define MAX_TEST_INFO_LEN					(10)	/*!< max length of test info and test result */
+#define CTRL1_BROADCAST						(0xB0)	/*!< standard frame, don't repeat, broadcast, system priority */
+#define CTRL1_SYSTEM_BROADCAST				(0xA0)	/*!< standard frame, don't repeat, system broadcast, system priority */
+#define CTRL2_GROUP							(0xE0)	/*!< group address, hop count 6 */
+#define APCI_IND_ADDR_READ					(0x0100)	/*!< A_IndividualAddress_Read */
+#define APCI_IND_ADDR_RESPONSE				(0x0140)	/*!< A_IndividualAddress_Response */
+#define APCI_SYSTEM_NETWORK_PARAM_READ		(0x01C8)	/*!< A_SystemNetworkParameter_Read */
+#define APCI_SYSTEM_NETWORK_PARAM_RESPONSE	(0x01C9)	/*!< A_SystemNetworkParameter_Response */
+#define APCI_DOMAIN_ADDR_READ				(0x03E1)	/*!< A_DomainAddress_Read */
+#define APCI_DOMAIN_ADDR_RESPONSE			(0x03E2)	/*!< A_DomainAddress_Response */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	Called for each individual address response.
+	Return 0 to stop waiting for more responses.
+*/
+typedef bool_t (*ind_addr_stream_callback)(uint16_t ind_addr, void* user_data);
+
+/*!
+	Called for each system network parameter response.
+	Return 0 to stop waiting for more responses.
+*/
+typedef bool_t (*system_network_param_stream_callback)(const system_network_param_read_t* item, void* user_data);
+
+/*!
+	Called for each domain address response.
+	Return 0 to stop waiting for more responses.
+*/
+typedef bool_t (*domain_addr_stream_callback)(const domain_addr_prog_mode_read_t* item, void* user_data);
+
+/*!
+	A running broadcast read
+*/
+typedef struct broadcast_stream_t
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t done_cond;
+	uint16_t response_apci; /*!< the expected response service */
+	uint16_t object_type; /*!< system network parameter: object type of the request */
+	uint16_t prop_id; /*!< system network parameter: property id of the request */
+	uint32_t expected; /*!< stop after this number of responses, 0 for no limit */
+	uint32_t count; /*!< number of received responses */
+	uint32_t in_flight; /*!< number of notification callbacks running a decoder */
+	bool_t done;
+	union
+	{
+		ind_addr_stream_callback ind_addr;
+		system_network_param_stream_callback system_network_param;
+		domain_addr_stream_callback domain_addr;
+	} callback; /*!< the application callback */
+	void* user_data;
+
+	/*!
+		Decodes a response telegram and passes it to the application callback.
+		Returns 0 if the telegram isn't a matching response, otherwise 1.
+		more is set to the return value of the application callback.
+	*/
+	bool_t (*decoder)(struct broadcast_stream_t* stream, const uint8_t* telegram, uint32_t telegram_len, bool_t* more);
+
+} broadcast_stream_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Reads the individual addresses of the devices in programming mode.
+	Returns the number of responses.
+*/
+static uint32_t ind_addr_prog_mode_read_stream(int32_t ap, uint32_t wait_time, uint32_t expected,
+        ind_addr_stream_callback c, void* user_data);
+
+/*!
+	Reads a system parameter with the SystemNetworkParameterRead service.
+	Returns the number of responses.
+*/
+static uint32_t system_network_param_read_stream(int32_t ap, uint16_t object_type, uint16_t prop_id,
+        const uint8_t data[], uint32_t data_length, uint32_t wait_time, uint32_t expected,
+        system_network_param_stream_callback c, void* user_data);
+
+/*!
+	Reads the domain addresses of the devices in programming mode.
+	Returns the number of responses.
+*/
+static uint32_t domain_addr_prog_mode_read_stream(int32_t ap, uint32_t wait_time, uint32_t expected,
+        domain_addr_stream_callback c, void* user_data);
+
+/*!
+	Sends the request and waits for the responses
+*/
+static uint32_t stream_run(int32_t ap, broadcast_stream_t* stream, const uint8_t* request,
+                           uint32_t request_len, uint32_t wait_time);
+
+/*!
+	Builds a broadcast cEMI L_Data.req, returns the telegram length
+*/
+static uint32_t stream_build_request(uint8_t telegram[MAX_TELEGRAM_LEN], bool_t system_broadcast,
+                                     uint16_t apci, const uint8_t* data, uint32_t data_length);
+
+/*!
+	The telegram callback of the access port during a broadcast read
+*/
+static void on_stream_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Returns the offset and the length of the APDU data (after the APCI)
+*/
+static bool_t stream_get_data(const uint8_t* telegram, uint32_t telegram_len, uint32_t* offset, uint32_t* length);
+
+/*!
+	The decoders of the responses
+*/
+static bool_t decode_ind_addr(broadcast_stream_t* stream, const uint8_t* telegram, uint32_t telegram_len, bool_t* more);
+static bool_t decode_system_network_param(broadcast_stream_t* stream, const uint8_t* telegram, uint32_t telegram_len, bool_t* more);
+static bool_t decode_domain_addr(broadcast_stream_t* stream, const uint8_t* telegram, uint32_t telegram_len, bool_t* more);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Prints the individual address of a device in programming mode
+*/
+static bool_t on_ind_addr(uint16_t ind_addr, void* user_data);
+
+/*!
+	Prints the serial number of a device
+*/
+static bool_t on_serial_number(const system_network_param_read_t* item, void* user_data);
+
+/*!
+	Prints the domain address of a device in programming mode
+*/
+static bool_t on_domain_addr(const domain_addr_prog_mode_read_t* item, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+	uint8_t test_info = 1;
+	uint32_t start = 0;
+	uint32_t count = 0;
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	ap = kdrive_ap_create();
+	if ((ap == KDRIVE_INVALID_DESCRIPTOR) ||
+	    (kdrive_ap_enum_usb(ap) == 0) ||
+	    (kdrive_ap_open_usb(ap, 0) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the access port");
+		kdrive_ap_release(ap);
+		return -1;
+	}
+
+	start = now_ms();
+
+	if ((argc > 1) && (strcmp(argv[1], "sn") == 0))
+	{
+		/* read the serial numbers of all devices: device object, PID_SERIAL_NUMBER, test info 1 */
+		count = system_network_param_read_stream(ap, 0, 11, &test_info, 1, 2500, 0, &on_serial_number, NULL);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u device(s) found", count);
+	}
+	else if ((argc > 1) && (strcmp(argv[1], "rf") == 0))
+	{
+		/* read the domain address of the KNX RF device in programming mode */
+		count = domain_addr_prog_mode_read_stream(ap, 1000, 1, &on_domain_addr, NULL);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u device(s) in programming mode, after %u ms", count, now_ms() - start);
+	}
+	else
+	{
+		/*
+			We expect one device in programming mode, so the
+			read returns with the first response
+		*/
+		count = ind_addr_prog_mode_read_stream(ap, 1000, 1, &on_ind_addr, NULL);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u device(s) in programming mode, after %u ms", count, now_ms() - start);
+	}
+
+	kdrive_ap_close(ap);
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+uint32_t ind_addr_prog_mode_read_stream(int32_t ap, uint32_t wait_time, uint32_t expected,
+                                        ind_addr_stream_callback c, void* user_data)
+{
+	broadcast_stream_t stream;
+	uint8_t request[MAX_TELEGRAM_LEN];
+	uint32_t request_len = stream_build_request(request, 0, APCI_IND_ADDR_READ, NULL, 0);
+
+	memset(&stream, 0, sizeof(broadcast_stream_t));
+	stream.response_apci = APCI_IND_ADDR_RESPONSE;
+	stream.expected = expected;
+	stream.decoder = &decode_ind_addr;
+	stream.callback.ind_addr = c;
+	stream.user_data = user_data;
+
+	return stream_run(ap, &stream, request, request_len, wait_time);
+}
+
+/*!
+	The request carries object type (2), property id (12 bits)
+	and reserved (4 bits), followed by the test info.
+*/
+uint32_t system_network_param_read_stream(int32_t ap, uint16_t object_type, uint16_t prop_id,
+        const uint8_t data[], uint32_t data_length, uint32_t wait_time, uint32_t expected,
+        system_network_param_stream_callback c, void* user_data)
+{
+	broadcast_stream_t stream;
+	uint8_t request[MAX_TELEGRAM_LEN];
+	uint8_t parameters[4 + MAX_TEST_INFO_LEN];
+	uint32_t request_len = 0;
+
+	if (data_length > MAX_TEST_INFO_LEN)
+	{
+		return 0;
+	}
+
+	parameters[0] = (uint8_t)(object_type >> 8);
+	parameters[1] = (uint8_t) object_type;
+	parameters[2] = (uint8_t)(prop_id >> 4);
+	parameters[3] = (uint8_t)((prop_id & 0x0F) << 4);
+	if (data_length > 0)
+	{
+		memcpy(&parameters[4], data, data_length);
+	}
+	request_len = stream_build_request(request, 1, APCI_SYSTEM_NETWORK_PARAM_READ, parameters, 4 + data_length);
+
+	memset(&stream, 0, sizeof(broadcast_stream_t));
+	stream.response_apci = APCI_SYSTEM_NETWORK_PARAM_RESPONSE;
+	stream.object_type = object_type;
+	stream.prop_id = prop_id;
+	stream.expected = expected;
+	stream.decoder = &decode_system_network_param;
+	stream.callback.system_network_param = c;
+	stream.user_data = user_data;
+
+	return stream_run(ap, &stream, request, request_len, wait_time);
+}
+
+uint32_t domain_addr_prog_mode_read_stream(int32_t ap, uint32_t wait_time, uint32_t expected,
+        domain_addr_stream_callback c, void* user_data)
+{
+	broadcast_stream_t stream;
+	uint8_t request[MAX_TELEGRAM_LEN];
+	uint32_t request_len = stream_build_request(request, 1, APCI_DOMAIN_ADDR_READ, NULL, 0);
+
+	memset(&stream, 0, sizeof(broadcast_stream_t));
+	stream.response_apci = APCI_DOMAIN_ADDR_RESPONSE;
+	stream.expected = expected;
+	stream.decoder = &decode_domain_addr;
+	stream.callback.domain_addr = c;
+	stream.user_data = user_data;
+
+	return stream_run(ap, &stream, request, request_len, wait_time);
+}
+
+/*!
+	The telegram callback is registered before the request is sent,
+	so a fast response is not missed. After the callback is removed
+	no more responses are delivered, but a callback that already
+	started may still run its decoder. We wait for it to finish
+	before the mutex and the condition are destroyed.
+*/
+uint32_t stream_run(int32_t ap, broadcast_stream_t* stream, const uint8_t* request,
+                    uint32_t request_len, uint32_t wait_time)
+{
+	struct timespec deadline;
+	uint32_t key = 0;
+	uint32_t count = 0;
+
+	pthread_mutex_init(&stream->mutex, NULL);
+	pthread_cond_init(&stream->done_cond, NULL);
+
+	if (kdrive_ap_register_telegram_callback(ap, &on_stream_telegram, stream, &key) == KDRIVE_ERROR_NONE)
+	{
+		if (kdrive_ap_send(ap, request, request_len) == KDRIVE_ERROR_NONE)
+		{
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += wait_time / 1000;
+			deadline.tv_nsec += (long)(wait_time % 1000) * 1000000L;
+			if (deadline.tv_nsec >= 1000000000L)
+			{
+				++deadline.tv_sec;
+				deadline.tv_nsec -= 1000000000L;
+			}
+
+			pthread_mutex_lock(&stream->mutex);
+			while (!stream->done)
+			{
+				if (pthread_cond_timedwait(&stream->done_cond, &stream->mutex, &deadline) != 0)
+				{
+					break;
+				}
+			}
+			stream->done = 1;
+			pthread_mutex_unlock(&stream->mutex);
+		}
+
+		kdrive_ap_remove_telegram_callback(ap, key);
+
+		pthread_mutex_lock(&stream->mutex);
+		stream->done = 1;
+		while (stream->in_flight > 0)
+		{
+			pthread_cond_wait(&stream->done_cond, &stream->mutex);
+		}
+		pthread_mutex_unlock(&stream->mutex);
+	}
+
+	count = stream->count;
+
+	pthread_cond_destroy(&stream->done_cond);
+	pthread_mutex_destroy(&stream->mutex);
+
+	return count;
+}
+
+/*!
+	The source address is set by the interface device
+*/
+uint32_t stream_build_request(uint8_t telegram[MAX_TELEGRAM_LEN], bool_t system_broadcast,
+                              uint16_t apci, const uint8_t* data, uint32_t data_length)
+{
+	telegram[0] = KDRIVE_CEMI_L_DATA_REQ;
+	telegram[1] = 0; /* no additional info */
+	telegram[2] = system_broadcast ? CTRL1_SYSTEM_BROADCAST : CTRL1_BROADCAST;
+	telegram[3] = CTRL2_GROUP;
+	telegram[4] = 0;
+	telegram[5] = 0;
+	telegram[6] = 0; /* destination: broadcast 0/0/0 */
+	telegram[7] = 0;
+	telegram[8] = (uint8_t)(1 + data_length);
+	telegram[9] = (uint8_t)((apci >> 8) & 0x03);
+	telegram[10] = (uint8_t) apci;
+	if (data_length > 0)
+	{
+		memcpy(&telegram[11], data, data_length);
+	}
+
+	return 11 + data_length;
+}
+
+/*!
+	Runs on the notification thread. The decoder, and so the
+	application callback, is called without holding the mutex.
+	in_flight keeps stream_run from destroying the stream meanwhile.
+*/
+void on_stream_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	broadcast_stream_t* stream = (broadcast_stream_t*) user_data;
+	uint8_t message_code = 0;
+	uint16_t apci = 0;
+	bool_t decoded = 0;
+	bool_t more = 1;
+
+	if ((kdrive_ap_get_message_code(telegram, telegram_len, &message_code) != KDRIVE_ERROR_NONE) ||
+	    (message_code != KDRIVE_CEMI_L_DATA_IND) ||
+	    (kdrive_ap_get_apci(telegram, telegram_len, &apci) != KDRIVE_ERROR_NONE) ||
+	    (apci != stream->response_apci))
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&stream->mutex);
+	if (stream->done)
+	{
+		pthread_mutex_unlock(&stream->mutex);
+		return;
+	}
+	++stream->in_flight;
+	pthread_mutex_unlock(&stream->mutex);
+
+	decoded = stream->decoder(stream, telegram, telegram_len, &more);
+
+	pthread_mutex_lock(&stream->mutex);
+	--stream->in_flight;
+	if (decoded)
+	{
+		++stream->count;
+		if (!more || ((stream->expected > 0) && (stream->count >= stream->expected)))
+		{
+			stream->done = 1;
+		}
+	}
+	if (stream->done)
+	{
+		pthread_cond_broadcast(&stream->done_cond);
+	}
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+/*!
+	cEMI: message code, additional info length, additional info,
+	control field 1 and 2, source (2), destination (2), length,
+	TPCI/APCI, APCI/data, data
+*/
+bool_t stream_get_data(const uint8_t* telegram, uint32_t telegram_len, uint32_t* offset, uint32_t* length)
+{
+	uint32_t npdu = 0;
+
+	if (telegram_len < 2)
+	{
+		return 0;
+	}
+
+	npdu = 2 + (uint32_t) telegram[1] + 6;
+	if ((npdu + 3 > telegram_len) || (npdu + 2 + telegram[npdu] > telegram_len) || (telegram[npdu] < 1))
+	{
+		return 0;
+	}
+
+	*offset = npdu + 3;
+	*length = (uint32_t) telegram[npdu] - 1;
+
+	return 1;
+}
+
+bool_t decode_ind_addr(broadcast_stream_t* stream, const uint8_t* telegram, uint32_t telegram_len, bool_t* more)
+{
+	ind_addr_stream_callback c = stream->callback.ind_addr;
+	uint16_t ind_addr = 0;
+
+	if (kdrive_ap_get_src(telegram, telegram_len, &ind_addr) != KDRIVE_ERROR_NONE)
+	{
+		return 0;
+	}
+
+	*more = c ? c(ind_addr, stream->user_data) : 1;
+
+	return 1;
+}
+
+/*!
+	The response carries object type (2), property id (12 bits)
+	and reserved (4 bits), followed by the test info and test result.
+	Only responses for the requested parameter are passed on.
+*/
+bool_t decode_system_network_param(broadcast_stream_t* stream, const uint8_t* telegram, uint32_t telegram_len, bool_t* more)
+{
+	system_network_param_stream_callback c = stream->callback.system_network_param;
+	system_network_param_read_t item;
+	uint32_t offset = 0;
+	uint32_t length = 0;
+
+	if (!stream_get_data(telegram, telegram_len, &offset, &length) || (length < 4) ||
+	    ((((uint16_t) telegram[offset] << 8) | telegram[offset + 1]) != stream->object_type) ||
+	    ((((uint16_t) telegram[offset + 2] << 4) | (telegram[offset + 3] >> 4)) != stream->prop_id) ||
+	    (kdrive_ap_get_src(telegram, telegram_len, &item.ind_addr) != KDRIVE_ERROR_NONE))
+	{
+		return 0;
+	}
+
+	item.length = length - 4;
+	if (item.length > sizeof(item.test_info_result))
+	{
+		item.length = sizeof(item.test_info_result);
+	}
+	memcpy(item.test_info_result, &telegram[offset + 4], item.length);
+
+	*more = c ? c(&item, stream->user_data) : 1;
+
+	return 1;
+}
+
+/*!
+	On KNX RF the serial number of the sender is in the
+	additional info, on other media it remains 0.
+*/
+bool_t decode_domain_addr(broadcast_stream_t* stream, const uint8_t* telegram, uint32_t telegram_len, bool_t* more)
+{
+	domain_addr_stream_callback c = stream->callback.domain_addr;
+	domain_addr_prog_mode_read_t item;
+	uint32_t offset = 0;
+	uint32_t length = 0;
+
+	memset(&item, 0, sizeof(domain_addr_prog_mode_read_t));
+
+	if (!stream_get_data(telegram, telegram_len, &offset, &length) || (length == 0) ||
+	    (kdrive_ap_get_src(telegram, telegram_len, &item.ind_addr) != KDRIVE_ERROR_NONE))
+	{
+		return 0;
+	}
+
+	if (length > KDRIVE_DA_LEN)
+	{
+		length = KDRIVE_DA_LEN;
+	}
+	memcpy(item.domain_address, &telegram[offset], length);
+	kdrive_ap_get_serial_number(telegram, telegram_len, item.serial_number);
+
+	*more = c ? c(&item, stream->user_data) : 1;
+
+	return 1;
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000u) + ((uint32_t) ts.tv_nsec / 1000000u);
+}
+
+bool_t on_ind_addr(uint16_t ind_addr, void* user_data)
+{
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Device in programming mode: %u.%u.%u",
+	                 (ind_addr >> 12) & 0x0F, (ind_addr >> 8) & 0x0F, ind_addr & 0xFF);
+	return 1;
+}
+
+bool_t on_serial_number(const system_network_param_read_t* item, void* user_data)
+{
+	char message[ERROR_MESSAGE_LEN];
+
+	snprintf(message, sizeof(message), "%u.%u.%u: ", (item->ind_addr >> 12) & 0x0F,
+	         (item->ind_addr >> 8) & 0x0F, item->ind_addr & 0xFF);
+	kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, message, item->test_info_result, item->length);
+	return 1;
+}
+
+bool_t on_domain_addr(const domain_addr_prog_mode_read_t* item, void* user_data)
+{
+	kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "Serial number: ", item->serial_number, KDRIVE_SN_LEN);
+	kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "Domain address: ", item->domain_address, KDRIVE_DA_LEN);
+	return 1;
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
@@ -0,0 +1,486 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Telegram callbacks are called in the context of the single
+	notification thread of the access port. When the callback is
+	CPU-heavy only one core is used.
+
+	This sample registers a telegram callback which dispatches the
+	received telegrams to a pool of worker threads. The telegrams are
+	sharded by the destination address: all telegrams for the same address
+	are handled by the same worker (and so stay in order), telegrams for
+	different addresses are handled in parallel.
+
+	When the queue of a worker is full the notification thread waits
+	until there is space again (back pressure), so no telegram is lost.
+
+	Start the sample with the argument "bench" to measure the throughput
+	with 1..n workers without an interface device.
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_callback_pool kdrive_express_callback_pool.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define MAX_TELEGRAM_LEN		(64)	/*!< max telegram buffer size */
+#define POOL_MAX_WORKERS		(16)	/*!< max number of worker threads */
+#define POOL_QUEUE_SIZE			(256)	/*!< capacity of the queue of each worker */
+#define BENCH_TELEGRAMS			(20000)	/*!< number of telegrams dispatched per benchmark run */
+#define BENCH_ADDRESSES			(64)	/*!< number of different group addresses used by the benchmark */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	A telegram copy, held in the queue of a worker
+*/
+typedef struct telegram_slot_t
+{
+	uint8_t telegram[MAX_TELEGRAM_LEN];
+	uint32_t telegram_len;
+
+} telegram_slot_t;
+
+/*!
+	A worker of the pool with its own queue
+*/
+typedef struct pool_worker_t
+{
+	pthread_t thread;
+	pthread_mutex_t mutex; /*!< protects the queue */
+	pthread_cond_t not_empty; /*!< signals the worker */
+	pthread_cond_t not_full; /*!< signals the notification thread */
+	telegram_slot_t queue[POOL_QUEUE_SIZE];
+	uint32_t head; /*!< queue read position */
+	uint32_t count; /*!< number of telegrams in the queue */
+	uint32_t processed; /*!< number of telegrams passed to the callback */
+	bool_t stop; /*!< tells the worker to terminate */
+	struct dispatch_pool_t* pool;
+
+} pool_worker_t;
+
+/*!
+	Dispatches the telegrams of an access port to a pool of workers
+*/
+typedef struct dispatch_pool_t
+{
+	int32_t ap; /*!< the access port descriptor */
+	uint32_t key; /*!< the telegram callback key */
+	kdrive_ap_telegram_callback callback; /*!< the application telegram callback */
+	void* user_data; /*!< the user data passed to the callback */
+	uint32_t worker_count;
+	pool_worker_t workers[POOL_MAX_WORKERS];
+
+} dispatch_pool_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Registers a telegram callback which is called on a pool of worker_count threads.
+	This is the pool variant of kdrive_ap_register_telegram_callback.
+	If worker_count is 0 the number of online processors is used.
+	The callback must be thread-safe: it is called concurrently for different
+	destination addresses, but never concurrently for the same destination address.
+*/
+static error_t pool_register_telegram_callback(dispatch_pool_t* pool, int32_t ap,
+        kdrive_ap_telegram_callback c, void* user_data, uint32_t worker_count);
+
+/*!
+	Removes the telegram callback, waits until all queued telegrams
+	are processed and stops the worker threads
+*/
+static void pool_remove_telegram_callback(dispatch_pool_t* pool);
+
+/*!
+	Starts the worker threads
+*/
+static error_t pool_start_workers(dispatch_pool_t* pool, kdrive_ap_telegram_callback c,
+                                  void* user_data, uint32_t worker_count);
+
+/*!
+	Stops the worker threads, after the queues are empty
+*/
+static void pool_stop_workers(dispatch_pool_t* pool);
+
+/*!
+	The telegram callback registered with the access port
+*/
+static void on_pool_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	The worker thread
+*/
+static void* pool_worker(void* arg);
+
+/*!
+	Selects the worker for the destination address of the telegram
+*/
+static uint32_t pool_shard(const dispatch_pool_t* pool, const uint8_t* telegram, uint32_t telegram_len);
+
+/*!
+	Measures the throughput for 1..n workers without an interface device
+*/
+static void run_benchmark(void);
+
+/*!
+	A CPU-heavy telegram callback: simulates a rules engine
+*/
+static void on_rules_engine(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static dispatch_pool_t pool;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t ap = 0;
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	if ((argc > 1) && (strcmp(argv[1], "bench") == 0))
+	{
+		run_benchmark();
+		return 0;
+	}
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	/*
+		We create a Access Port descriptor. This descriptor is then used for
+		all calls to that specific access port.
+	*/
+	ap = kdrive_ap_create();
+
+	/*
+		We check that we were able to allocate a new descriptor
+		This should always happen, unless a bad_alloc exception is internally thrown
+		which means the memory couldn't be allocated.
+	*/
+	if (ap == KDRIVE_INVALID_DESCRIPTOR)
+	{
+		kdrive_logger(KDRIVE_LOGGER_FATAL, "Unable to create access port. This is a terminal failure");
+		while (1)
+		{
+			;
+		}
+	}
+
+	/* If we found at least 1 interface we simply open the first one (i.e. index 0) */
+	if ((kdrive_ap_enum_usb(ap) > 0) && (kdrive_ap_open_usb(ap, 0) == KDRIVE_ERROR_NONE))
+	{
+		/* one worker per processor */
+		pool_register_telegram_callback(&pool, ap, &on_rules_engine, NULL, 0);
+
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Dispatching telegrams on %u workers", pool.worker_count);
+		kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Press [Enter] to exit the application ...");
+		getchar();
+
+		pool_remove_telegram_callback(&pool);
+
+		/* close the access port */
+		kdrive_ap_close(ap);
+	}
+
+	/* releases the access port */
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+error_t pool_register_telegram_callback(dispatch_pool_t* pool, int32_t ap,
+                                        kdrive_ap_telegram_callback c, void* user_data, uint32_t worker_count)
+{
+	error_t e = pool_start_workers(pool, c, user_data, worker_count);
+
+	if (e == KDRIVE_ERROR_NONE)
+	{
+		pool->ap = ap;
+		e = kdrive_ap_register_telegram_callback(ap, &on_pool_telegram, pool, &pool->key);
+		if (e != KDRIVE_ERROR_NONE)
+		{
+			pool_stop_workers(pool);
+		}
+	}
+
+	return e;
+}
+
+void pool_remove_telegram_callback(dispatch_pool_t* pool)
+{
+	kdrive_ap_remove_telegram_callback(pool->ap, pool->key);
+	pool_stop_workers(pool);
+}
+
+error_t pool_start_workers(dispatch_pool_t* pool, kdrive_ap_telegram_callback c,
+                           void* user_data, uint32_t worker_count)
+{
+	uint32_t index = 0;
+	pool_worker_t* worker = 0;
+
+	if (worker_count == 0)
+	{
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		worker_count = (processors > 0) ? (uint32_t) processors : 1;
+	}
+	if (worker_count > POOL_MAX_WORKERS)
+	{
+		worker_count = POOL_MAX_WORKERS;
+	}
+
+	memset(pool, 0, sizeof(dispatch_pool_t));
+	pool->callback = c;
+	pool->user_data = user_data;
+
+	for (index = 0; index < worker_count; ++index)
+	{
+		worker = &pool->workers[index];
+		worker->pool = pool;
+		pthread_mutex_init(&worker->mutex, NULL);
+		pthread_cond_init(&worker->not_empty, NULL);
+		pthread_cond_init(&worker->not_full, NULL);
+
+		if (pthread_create(&worker->thread, NULL, &pool_worker, worker) != 0)
+		{
+			pool_stop_workers(pool);
+			return KDRIVE_UNKNOWN_ERROR;
+		}
+
+		/* the worker is only counted when it is running */
+		pool->worker_count = index + 1;
+	}
+
+	return KDRIVE_ERROR_NONE;
+}
+
+void pool_stop_workers(dispatch_pool_t* pool)
+{
+	uint32_t index = 0;
+	pool_worker_t* worker = 0;
+
+	for (index = 0; index < pool->worker_count; ++index)
+	{
+		worker = &pool->workers[index];
+		pthread_mutex_lock(&worker->mutex);
+		worker->stop = 1;
+		pthread_cond_signal(&worker->not_empty);
+		pthread_mutex_unlock(&worker->mutex);
+	}
+
+	for (index = 0; index < pool->worker_count; ++index)
+	{
+		pthread_join(pool->workers[index].thread, NULL);
+	}
+}
+
+void on_pool_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	dispatch_pool_t* pool = (dispatch_pool_t*) user_data;
+	pool_worker_t* worker = 0;
+	telegram_slot_t* slot = 0;
+
+	if (telegram_len > MAX_TELEGRAM_LEN)
+	{
+		return;
+	}
+
+	worker = &pool->workers[pool_shard(pool, telegram, telegram_len)];
+
+	pthread_mutex_lock(&worker->mutex);
+
+	while (worker->count == POOL_QUEUE_SIZE)
+	{
+		pthread_cond_wait(&worker->not_full, &worker->mutex);
+	}
+
+	slot = &worker->queue[(worker->head + worker->count) % POOL_QUEUE_SIZE];
+	memcpy(slot->telegram, telegram, telegram_len);
+	slot->telegram_len = telegram_len;
+	++worker->count;
+
+	pthread_cond_signal(&worker->not_empty);
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+/*!
+	Processes the queued telegrams in order.
+	When the worker is stopped the remaining telegrams are
+	processed before the thread terminates.
+*/
+void* pool_worker(void* arg)
+{
+	pool_worker_t* worker = (pool_worker_t*) arg;
+	dispatch_pool_t* pool = worker->pool;
+	telegram_slot_t slot;
+
+	pthread_mutex_lock(&worker->mutex);
+
+	while (1)
+	{
+		if (worker->count == 0)
+		{
+			if (worker->stop)
+			{
+				break;
+			}
+			pthread_cond_wait(&worker->not_empty, &worker->mutex);
+			continue;
+		}
+
+		slot = worker->queue[worker->head];
+		worker->head = (worker->head + 1) % POOL_QUEUE_SIZE;
+		--worker->count;
+		pthread_cond_signal(&worker->not_full);
+
+		pthread_mutex_unlock(&worker->mutex);
+		pool->callback(slot.telegram, slot.telegram_len, pool->user_data);
+		pthread_mutex_lock(&worker->mutex);
+
+		++worker->processed;
+	}
+
+	pthread_mutex_unlock(&worker->mutex);
+
+	return NULL;
+}
+
+/*!
+	Group addresses of a project are usually close together
+	(i.e. 1/1/1, 1/1/2, ...), so we use a multiplicative hash
+	to spread them over the workers.
+	Telegrams without a destination address all go to the first worker.
+*/
+uint32_t pool_shard(const dispatch_pool_t* pool, const uint8_t* telegram, uint32_t telegram_len)
+{
+	uint16_t address = 0;
+
+	if (kdrive_ap_get_dest(telegram, telegram_len, &address) != KDRIVE_ERROR_NONE)
+	{
+		return 0;
+	}
+
+	return (((uint32_t) address * 2654435761u) >> 16) % pool->worker_count;
+}
+
+/*!
+	Dispatches BENCH_TELEGRAMS cEMI L_Data.ind GroupValue_Write telegrams
+	for BENCH_ADDRESSES group addresses and measures the time until all
+	telegrams are processed.
+*/
+void run_benchmark(void)
+{
+	uint8_t telegram[] = { 0x29, 0x00, 0xBC, 0xE0, 0x11, 0x01, 0x09, 0x00, 0x01, 0x00, 0x81 };
+	uint32_t worker_count = 1;
+	uint32_t index = 0;
+	uint16_t address = 0;
+	struct timespec start;
+	struct timespec end;
+	double seconds = 0;
+	double single = 0;
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%ld processors online", processors);
+
+	for (worker_count = 1; (worker_count <= POOL_MAX_WORKERS) && (worker_count <= (uint32_t) processors * 2); worker_count *= 2)
+	{
+		pool_start_workers(&pool, &on_rules_engine, NULL, worker_count);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (index = 0; index < BENCH_TELEGRAMS; ++index)
+		{
+			address = (uint16_t)(0x0900 + (index % BENCH_ADDRESSES));
+			telegram[6] = (uint8_t)(address >> 8);
+			telegram[7] = (uint8_t)(address & 0xFF);
+			on_pool_telegram(telegram, sizeof(telegram), &pool);
+		}
+
+		pool_stop_workers(&pool);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		seconds = (double)(end.tv_sec - start.tv_sec) + ((double)(end.tv_nsec - start.tv_nsec) / 1e9);
+		if (worker_count == 1)
+		{
+			single = seconds;
+		}
+
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%2u worker(s): %8.0f telegrams/s (speedup %.2f)",
+		                 worker_count, BENCH_TELEGRAMS / seconds, single / seconds);
+	}
+}
+
+/*!
+	Simulates about 50 us of CPU work per telegram
+*/
+void on_rules_engine(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	volatile uint32_t hash = 2166136261u;
+	uint32_t round = 0;
+	uint32_t index = 0;
+
+	for (round = 0; round < 2000; ++round)
+	{
+		for (index = 0; index < telegram_len; ++index)
+		{
+			hash = (hash ^ telegram[index]) * 16777619u;
+		}
+	}
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
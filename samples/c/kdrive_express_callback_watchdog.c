@@ -0,0 +1,569 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Telegram callbacks are called in the context of the single
+	notification thread of the access port. A consumer that takes
+	too long holds back all other consumers (and finally the receive path).
+
+	This sample registers one telegram callback (the watchdog) with the
+	access port and dispatches the telegrams to several consumers.
+	The execution time of each consumer is measured and recorded in a histogram.
+	A consumer which exceeds its time budget WATCHDOG_OVERRUN_LIMIT times in a row
+	is isolated: it is moved to its own worker thread with a bounded queue,
+	and the application is notified with WATCHDOG_EVENT_CONSUMER_ISOLATED
+	via the same event callback that handles the access port events.
+	The isolated consumer is handed to the optional isolated callback.
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_callback_watchdog kdrive_express_callback_watchdog.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN			(128)	/*!< kdriveExpress Error Messages */
+#define MAX_TELEGRAM_LEN			(520)	/*!< max cEMI frame: 255 octets additional info, extended frame with 256 octets TPDU */
+#define MAX_CONSUMERS				(8)		/*!< max number of consumers served by the watchdog */
+#define HISTOGRAM_BUCKETS			(16)	/*!< execution time histogram: bucket n holds [2^n, 2^(n+1)) us */
+#define WATCHDOG_OVERRUN_LIMIT		(3)		/*!< consecutive budget overruns before a consumer is isolated */
+#define ISOLATION_QUEUE_SIZE		(64)	/*!< capacity of the queue of an isolated consumer */
+
+/*!
+	The watchdog event is emitted when a consumer was moved to its own worker.
+	The access port events (KDRIVE_EVENT_ERROR etc) are in the range 0x0000 to 0x000C,
+	so we use a value outside of this range.
+*/
+#define WATCHDOG_EVENT_CONSUMER_ISOLATED	(0x0100)
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	A telegram copy, held in the queue of an isolated consumer
+*/
+typedef struct telegram_slot_t
+{
+	uint8_t telegram[MAX_TELEGRAM_LEN];
+	uint32_t telegram_len;
+
+} telegram_slot_t;
+
+struct consumer_t;
+
+/*!
+	Called when a consumer was isolated, after the event callback
+*/
+typedef void (*watchdog_isolated_callback)(int32_t ap, const struct consumer_t* consumer, void* user_data);
+
+/*!
+	A consumer of the received telegrams
+*/
+typedef struct consumer_t
+{
+	const char* name; /*!< name, used for logging */
+	kdrive_ap_telegram_callback callback; /*!< the consumer telegram callback */
+	void* user_data; /*!< the user data passed to the callback */
+	uint32_t budget_us; /*!< time budget per call in microseconds */
+
+	uint32_t histogram[HISTOGRAM_BUCKETS]; /*!< execution time histogram */
+	uint32_t calls; /*!< number of calls */
+	uint32_t overruns; /*!< number of calls which exceeded the budget */
+	uint32_t consecutive_overruns; /*!< number of consecutive calls which exceeded the budget */
+	uint32_t max_us; /*!< longest execution time */
+
+	bool_t isolated; /*!< 1 when the consumer runs on its own worker thread */
+	pthread_t worker; /*!< the worker thread (when isolated) */
+	pthread_mutex_t mutex; /*!< protects the statistics and the queue */
+	pthread_cond_t cond; /*!< signals the worker */
+	telegram_slot_t queue[ISOLATION_QUEUE_SIZE]; /*!< the bounded queue (when isolated) */
+	uint32_t head; /*!< queue read position */
+	uint32_t count; /*!< number of telegrams in the queue */
+	uint32_t dropped; /*!< number of telegrams dropped because the queue was full or the telegram too long */
+	bool_t stop; /*!< tells the worker to terminate */
+
+} consumer_t;
+
+/*!
+	The watchdog dispatches the telegrams of an access port to the consumers
+*/
+typedef struct watchdog_t
+{
+	int32_t ap; /*!< the access port descriptor */
+	uint32_t key; /*!< the telegram callback key */
+	consumer_t consumers[MAX_CONSUMERS];
+	uint32_t consumer_count;
+	kdrive_event_callback event_callback; /*!< notified when a consumer is isolated */
+	watchdog_isolated_callback isolated_callback; /*!< gets the isolated consumer */
+	void* event_user_data; /*!< the user data passed to both callbacks */
+
+} watchdog_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Adds a consumer to the watchdog. Consumers should be added
+	before the watchdog is started.
+*/
+static error_t watchdog_add_consumer(watchdog_t* watchdog, const char* name,
+                                     kdrive_ap_telegram_callback c, void* user_data, uint32_t budget_us);
+
+/*!
+	Registers the watchdog as telegram callback with the access port.
+	event_callback and isolated_callback are optional
+*/
+static error_t watchdog_start(watchdog_t* watchdog, int32_t ap, kdrive_event_callback event_callback,
+                              watchdog_isolated_callback isolated_callback, void* event_user_data);
+
+/*!
+	Removes the telegram callback and stops the worker threads
+*/
+static void watchdog_stop(watchdog_t* watchdog);
+
+/*!
+	Writes the execution time histograms to the logger
+*/
+static void watchdog_log_statistics(watchdog_t* watchdog);
+
+/*!
+	The telegram callback registered with the access port
+*/
+static void on_watchdog_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	The worker thread of an isolated consumer
+*/
+static void* isolated_consumer_worker(void* arg);
+
+/*!
+	Calls the consumer and records the execution time.
+	Returns 1 when the budget was exceeded
+*/
+static bool_t call_consumer(consumer_t* consumer, const uint8_t* telegram, uint32_t telegram_len);
+
+/*!
+	Moves the consumer to its own worker thread
+*/
+static void isolate_consumer(watchdog_t* watchdog, consumer_t* consumer);
+
+/*!
+	Returns the monotonic time in microseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_us(void);
+
+/*!
+	A fast consumer: logs the group value writes
+*/
+static void on_group_write_logger(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	A slow consumer: simulates an expensive computation
+*/
+static void on_slow_rules_engine(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*!
+	Called when an event occurs
+*/
+static void event_callback(int32_t ap, uint32_t e, void* user_data);
+
+/*!
+	Called when the watchdog isolated a consumer
+*/
+static void isolated_callback(int32_t ap, const consumer_t* consumer, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static watchdog_t watchdog;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t ap = 0;
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	/*
+		We create a Access Port descriptor. This descriptor is then used for
+		all calls to that specific access port.
+	*/
+	ap = kdrive_ap_create();
+
+	/*
+		We check that we were able to allocate a new descriptor
+		This should always happen, unless a bad_alloc exception is internally thrown
+		which means the memory couldn't be allocated.
+	*/
+	if (ap == KDRIVE_INVALID_DESCRIPTOR)
+	{
+		kdrive_logger(KDRIVE_LOGGER_FATAL, "Unable to create access port. This is a terminal failure");
+		while (1)
+		{
+			;
+		}
+	}
+
+	/*
+		We register an event callback to notify of the Access Port Events
+		For example: KDRIVE_EVENT_TERMINATED
+	*/
+	kdrive_set_event_callback(ap, &event_callback, NULL);
+
+	/*
+		The logger has a budget of 1 ms, the rules engine of 5 ms.
+		The rules engine needs about 20 ms per telegram, so it will be isolated
+		after WATCHDOG_OVERRUN_LIMIT telegrams.
+	*/
+	watchdog_add_consumer(&watchdog, "logger", &on_group_write_logger, NULL, 1000);
+	watchdog_add_consumer(&watchdog, "rules engine", &on_slow_rules_engine, NULL, 5000);
+
+	/* If we found at least 1 interface we simply open the first one (i.e. index 0) */
+	if ((kdrive_ap_enum_usb(ap) > 0) && (kdrive_ap_open_usb(ap, 0) == KDRIVE_ERROR_NONE))
+	{
+		watchdog_start(&watchdog, ap, &event_callback, &isolated_callback, NULL);
+
+		kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Dispatching telegrams to the consumers");
+		kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Press [Enter] to exit the application ...");
+		getchar();
+
+		watchdog_stop(&watchdog);
+		watchdog_log_statistics(&watchdog);
+
+		/* close the access port */
+		kdrive_ap_close(ap);
+	}
+
+	/* releases the access port */
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+error_t watchdog_add_consumer(watchdog_t* watchdog, const char* name,
+                              kdrive_ap_telegram_callback c, void* user_data, uint32_t budget_us)
+{
+	consumer_t* consumer = 0;
+
+	if (watchdog->consumer_count >= MAX_CONSUMERS)
+	{
+		return KDRIVE_BUFFER_TOO_SMALL_ERROR;
+	}
+
+	consumer = &watchdog->consumers[watchdog->consumer_count++];
+	memset(consumer, 0, sizeof(consumer_t));
+	consumer->name = name;
+	consumer->callback = c;
+	consumer->user_data = user_data;
+	consumer->budget_us = budget_us;
+	pthread_mutex_init(&consumer->mutex, NULL);
+	pthread_cond_init(&consumer->cond, NULL);
+
+	return KDRIVE_ERROR_NONE;
+}
+
+error_t watchdog_start(watchdog_t* watchdog, int32_t ap, kdrive_event_callback event_callback,
+                       watchdog_isolated_callback isolated_callback, void* event_user_data)
+{
+	watchdog->ap = ap;
+	watchdog->event_callback = event_callback;
+	watchdog->isolated_callback = isolated_callback;
+	watchdog->event_user_data = event_user_data;
+
+	return kdrive_ap_register_telegram_callback(ap, &on_watchdog_telegram, watchdog, &watchdog->key);
+}
+
+void watchdog_stop(watchdog_t* watchdog)
+{
+	uint32_t index = 0;
+	consumer_t* consumer = 0;
+
+	/* after this no more telegrams are dispatched */
+	kdrive_ap_remove_telegram_callback(watchdog->ap, watchdog->key);
+
+	for (index = 0; index < watchdog->consumer_count; ++index)
+	{
+		consumer = &watchdog->consumers[index];
+		if (consumer->isolated)
+		{
+			pthread_mutex_lock(&consumer->mutex);
+			consumer->stop = 1;
+			pthread_cond_signal(&consumer->cond);
+			pthread_mutex_unlock(&consumer->mutex);
+			pthread_join(consumer->worker, NULL);
+		}
+	}
+}
+
+void watchdog_log_statistics(watchdog_t* watchdog)
+{
+	uint32_t index = 0;
+	uint32_t bucket = 0;
+	consumer_t* consumer = 0;
+
+	for (index = 0; index < watchdog->consumer_count; ++index)
+	{
+		consumer = &watchdog->consumers[index];
+		pthread_mutex_lock(&consumer->mutex);
+
+		kdrive_logger(KDRIVE_LOGGER_INFORMATION, "");
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Consumer '%s' (%s)", consumer->name,
+		                 consumer->isolated ? "isolated" : "notification thread");
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "- calls %u, overruns %u, dropped %u, max %u us",
+		                 consumer->calls, consumer->overruns, consumer->dropped, consumer->max_us);
+
+		for (bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+		{
+			if (consumer->histogram[bucket])
+			{
+				kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "- %8u us .. %8u us : %u",
+				                 (bucket == 0) ? 0 : (1u << bucket), (2u << bucket) - 1, consumer->histogram[bucket]);
+			}
+		}
+
+		pthread_mutex_unlock(&consumer->mutex);
+	}
+}
+
+/*!
+	Dispatches the telegram to all consumers.
+	Consumers on the notification thread are called directly,
+	isolated consumers get a copy of the telegram in their queue.
+	When the queue of an isolated consumer is full (or the telegram
+	doesn't fit into a slot) the telegram is dropped and counted
+	for this consumer only.
+*/
+void on_watchdog_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	watchdog_t* watchdog = (watchdog_t*) user_data;
+	consumer_t* consumer = 0;
+	telegram_slot_t* slot = 0;
+	uint32_t index = 0;
+
+	for (index = 0; index < watchdog->consumer_count; ++index)
+	{
+		consumer = &watchdog->consumers[index];
+
+		if (consumer->isolated)
+		{
+			pthread_mutex_lock(&consumer->mutex);
+			if ((consumer->count < ISOLATION_QUEUE_SIZE) && (telegram_len <= MAX_TELEGRAM_LEN))
+			{
+				slot = &consumer->queue[(consumer->head + consumer->count) % ISOLATION_QUEUE_SIZE];
+				memcpy(slot->telegram, telegram, telegram_len);
+				slot->telegram_len = telegram_len;
+				++consumer->count;
+				pthread_cond_signal(&consumer->cond);
+			}
+			else
+			{
+				++consumer->dropped;
+			}
+			pthread_mutex_unlock(&consumer->mutex);
+		}
+		else if (call_consumer(consumer, telegram, telegram_len) &&
+		         (consumer->consecutive_overruns >= WATCHDOG_OVERRUN_LIMIT))
+		{
+			isolate_consumer(watchdog, consumer);
+		}
+	}
+}
+
+void* isolated_consumer_worker(void* arg)
+{
+	consumer_t* consumer = (consumer_t*) arg;
+	telegram_slot_t slot;
+
+	pthread_mutex_lock(&consumer->mutex);
+
+	while (!consumer->stop)
+	{
+		if (consumer->count == 0)
+		{
+			pthread_cond_wait(&consumer->cond, &consumer->mutex);
+			continue;
+		}
+
+		slot = consumer->queue[consumer->head];
+		consumer->head = (consumer->head + 1) % ISOLATION_QUEUE_SIZE;
+		--consumer->count;
+
+		pthread_mutex_unlock(&consumer->mutex);
+		call_consumer(consumer, slot.telegram, slot.telegram_len);
+		pthread_mutex_lock(&consumer->mutex);
+	}
+
+	pthread_mutex_unlock(&consumer->mutex);
+
+	return NULL;
+}
+
+bool_t call_consumer(consumer_t* consumer, const uint8_t* telegram, uint32_t telegram_len)
+{
+	uint32_t start = now_us();
+	uint32_t elapsed = 0;
+	uint32_t bucket = 0;
+	bool_t overrun = 0;
+
+	consumer->callback(telegram, telegram_len, consumer->user_data);
+	elapsed = now_us() - start;
+
+	while ((bucket < HISTOGRAM_BUCKETS - 1) && ((elapsed >> (bucket + 1)) != 0))
+	{
+		++bucket;
+	}
+
+	overrun = (elapsed > consumer->budget_us);
+
+	pthread_mutex_lock(&consumer->mutex);
+	++consumer->histogram[bucket];
+	++consumer->calls;
+	if (elapsed > consumer->max_us)
+	{
+		consumer->max_us = elapsed;
+	}
+	if (overrun)
+	{
+		++consumer->overruns;
+		++consumer->consecutive_overruns;
+	}
+	else
+	{
+		consumer->consecutive_overruns = 0;
+	}
+	pthread_mutex_unlock(&consumer->mutex);
+
+	return overrun;
+}
+
+void isolate_consumer(watchdog_t* watchdog, consumer_t* consumer)
+{
+	if (pthread_create(&consumer->worker, NULL, &isolated_consumer_worker, consumer) != 0)
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "Unable to start the worker for consumer '%s'", consumer->name);
+		return;
+	}
+
+	consumer->isolated = 1;
+
+	kdrive_logger_ex(KDRIVE_LOGGER_WARNING, "Consumer '%s' exceeded its budget of %u us %u times, isolated",
+	                 consumer->name, consumer->budget_us, consumer->consecutive_overruns);
+
+	if (watchdog->event_callback)
+	{
+		watchdog->event_callback(watchdog->ap, WATCHDOG_EVENT_CONSUMER_ISOLATED, watchdog->event_user_data);
+	}
+	if (watchdog->isolated_callback)
+	{
+		watchdog->isolated_callback(watchdog->ap, consumer, watchdog->event_user_data);
+	}
+}
+
+uint32_t now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000000u) + ((uint32_t) ts.tv_nsec / 1000u);
+}
+
+void on_group_write_logger(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	uint16_t address = 0;
+
+	if (kdrive_ap_is_group_write(telegram, telegram_len) &&
+	    (kdrive_ap_get_dest(telegram, telegram_len, &address) == KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "A_GroupValue_Write: 0x%04x ", address);
+	}
+}
+
+void on_slow_rules_engine(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	usleep(20000);
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
+
+/*!
+	The event callback is called when an Access Port event is raised
+	and when the watchdog isolated a consumer
+*/
+void event_callback(int32_t ap, uint32_t e, void* user_data)
+{
+	switch (e)
+	{
+		case KDRIVE_EVENT_ERROR:
+			kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Access Port Error");
+			break;
+
+		case KDRIVE_EVENT_TERMINATED:
+			kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Access Port Terminated");
+			break;
+
+		case WATCHDOG_EVENT_CONSUMER_ISOLATED:
+			kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Consumer Isolated");
+			break;
+
+		default:
+			break;
+	}
+}
+
+void isolated_callback(int32_t ap, const consumer_t* consumer, void* user_data)
+{
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "- consumer '%s', budget %u us", consumer->name, consumer->budget_us);
+}
@@ -0,0 +1,236 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Measures the call throughput of the descriptor based API
+	with several threads.
+
+	Each thread calls functions which only resolve the descriptor and
+	don't send anything on the bus (kdrive_ap_is_open on an access port
+	and kdrive_sp_get_response_timeout on a service port). Each thread
+	uses its own ports, so there is no shared state in the application.
+	The run is repeated with 1, 2, 4 and 8 threads (and ports), and the
+	throughput is compared with the single thread run.
+
+	With independent ports the throughput should scale with the number
+	of threads (up to the number of cores). A scaling far below that
+	shows that the calls are serialised inside the library.
+
+	usage: kdrive_express_descriptor_bench [calls per thread]
+
+	This sample uses POSIX threads, i.e.
+	gcc -O2 -I../../include -o kdrive_express_descriptor_bench kdrive_express_descriptor_bench.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define BENCH_MAX_THREADS		(8)		/*!< max number of threads (and ports) */
+#define BENCH_DEFAULT_CALLS		(1000000)	/*!< calls per thread */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	The ports and the result of a thread
+*/
+typedef struct bench_thread_t
+{
+	int32_t ap;
+	int32_t sp;
+	uint32_t calls;
+	pthread_barrier_t* barrier; /*!< all threads start at the same time */
+
+} bench_thread_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Runs the benchmark with thread_count threads.
+	Returns the throughput in calls per second
+*/
+static double bench_run(bench_thread_t threads[], uint32_t thread_count);
+
+/*!
+	The benchmark thread
+*/
+static void* bench_worker(void* arg);
+
+/*!
+	Returns the monotonic time in seconds
+*/
+static double now_s(void);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	bench_thread_t threads[BENCH_MAX_THREADS];
+	const uint32_t calls = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_CALLS;
+	uint32_t thread_count = 0;
+	uint32_t index = 0;
+	double single = 0;
+	double throughput = 0;
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	/* the ports don't need to be open */
+	memset(threads, 0, sizeof(threads));
+	for (index = 0; index < BENCH_MAX_THREADS; ++index)
+	{
+		threads[index].ap = kdrive_ap_create();
+		threads[index].sp = kdrive_sp_create(threads[index].ap);
+		threads[index].calls = calls;
+		if ((threads[index].ap == KDRIVE_INVALID_DESCRIPTOR) || (threads[index].sp == KDRIVE_INVALID_DESCRIPTOR))
+		{
+			kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to create the ports");
+			return -1;
+		}
+	}
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u calls per thread, %ld core(s)",
+	                 calls, sysconf(_SC_NPROCESSORS_ONLN));
+
+	for (thread_count = 1; thread_count <= BENCH_MAX_THREADS; thread_count *= 2)
+	{
+		throughput = bench_run(threads, thread_count);
+		if (thread_count == 1)
+		{
+			single = throughput;
+		}
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u thread(s): %10.0f calls/s, scaling %.2f (ideal %u)",
+		                 thread_count, throughput, (single > 0) ? throughput / single : 0, thread_count);
+	}
+
+	for (index = 0; index < BENCH_MAX_THREADS; ++index)
+	{
+		kdrive_sp_release(threads[index].sp);
+		kdrive_ap_release(threads[index].ap);
+	}
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	The time is taken from the start barrier to the last thread finished.
+	Each call of the worker makes two API calls
+*/
+double bench_run(bench_thread_t threads[], uint32_t thread_count)
+{
+	pthread_t ids[BENCH_MAX_THREADS];
+	pthread_barrier_t barrier;
+	uint32_t started = 0;
+	uint32_t index = 0;
+	double total = 0;
+	double start = 0;
+	double elapsed = 0;
+
+	pthread_barrier_init(&barrier, NULL, thread_count + 1);
+
+	for (index = 0; index < thread_count; ++index)
+	{
+		threads[index].barrier = &barrier;
+		if (pthread_create(&ids[index], NULL, &bench_worker, &threads[index]) == 0)
+		{
+			++started;
+		}
+	}
+
+	/* a thread which couldn't be created would block the barrier */
+	if (started < thread_count)
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to create the threads");
+		exit(-1);
+	}
+
+	pthread_barrier_wait(&barrier);
+	start = now_s();
+
+	for (index = 0; index < thread_count; ++index)
+	{
+		pthread_join(ids[index], NULL);
+		total += 2.0 * threads[index].calls;
+	}
+
+	elapsed = now_s() - start;
+	pthread_barrier_destroy(&barrier);
+
+	return (elapsed > 0) ? total / elapsed : 0;
+}
+
+void* bench_worker(void* arg)
+{
+	bench_thread_t* thread = (bench_thread_t*) arg;
+	uint32_t timeout = 0;
+	uint32_t index = 0;
+
+	pthread_barrier_wait(thread->barrier);
+
+	for (index = 0; index < thread->calls; ++index)
+	{
+		kdrive_ap_is_open(thread->ap);
+		kdrive_sp_get_response_timeout(thread->sp, &timeout);
+	}
+
+	return NULL;
+}
+
+double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
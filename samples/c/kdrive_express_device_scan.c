@@ -0,0 +1,434 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Scans a range of individual addresses and reads the device
+	descriptors (type 0 and type 2) of every device found.
+
+	The device services of a service port are synchronous: a scan with one
+	service port waits for each address in turn, and a missing device costs
+	the whole response timeout. This sample runs the scan on a number of
+	worker threads, each with its own service port. The service ports are
+	spread over the given access ports (i.e. one per tunneling connection,
+	see kdrive_express_ip_tunnel_pool.c), so several devices are read at
+	the same time.
+
+	Missing devices fail fast: the descriptors are read connection-oriented,
+	so the T_Connect to a missing device is not acknowledged on the bus and
+	the service returns KDRIVE_SP_NEGATIVE_CONFIRM_ERROR on the negative
+	L_Data.con (or KDRIVE_KER_DISCONNECTED_ERROR when the device answers
+	with T_Disconnect). The first read uses the short SCAN_PROBE_TIMEOUT,
+	only the type 2 read of a device which answered uses the full timeout.
+
+	The results are passed to a callback as soon as they are available.
+	The callback is never called concurrently.
+
+	Start the sample with the line to scan, i.e. "1.1" scans 1.1.0 to 1.1.255
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_device_scan kdrive_express_device_scan.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define SCAN_MAX_PORTS			(8)		/*!< max number of access ports used by a scan */
+#define SCAN_MAX_WORKERS		(32)	/*!< max number of concurrent service ports */
+#define SCAN_WORKERS_PER_PORT	(4)		/*!< default number of service ports per access port */
+#define SCAN_PROBE_TIMEOUT		(1000)	/*!< response timeout in ms of the first read of an address */
+#define SCAN_RESPONSE_TIMEOUT	(3000)	/*!< response timeout in ms of the following reads */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	The result of one scanned address
+*/
+typedef struct scan_result_t
+{
+	uint16_t ind_addr; /*!< the scanned individual address */
+	error_t error; /*!< KDRIVE_ERROR_NONE if a device was found */
+	uint16_t mask_version; /*!< device descriptor type 0 */
+	bool_t has_desc2; /*!< 1 if desc2 is valid */
+	device_descriptor_type2_t desc2; /*!< device descriptor type 2 */
+	uint32_t elapsed; /*!< time in ms spent on the address */
+
+} scan_result_t;
+
+/*!
+	Called for each scanned address.
+	Return 0 to stop the scan.
+*/
+typedef bool_t (*scan_callback)(const scan_result_t* result, void* user_data);
+
+/*!
+	A worker with its own service port
+*/
+typedef struct scan_worker_t
+{
+	pthread_t thread;
+	int32_t sp; /*!< the service port descriptor */
+	struct device_scan_t* scan;
+
+} scan_worker_t;
+
+/*!
+	A running scan
+*/
+typedef struct device_scan_t
+{
+	pthread_mutex_t mutex; /*!< protects the address range and the counters */
+	pthread_mutex_t callback_mutex; /*!< serializes the callback */
+	uint32_t next_addr; /*!< the next address to scan */
+	uint32_t last_addr; /*!< the last address to scan */
+	bool_t stop; /*!< set when the callback stops the scan */
+	scan_callback callback;
+	void* user_data;
+	uint32_t found; /*!< number of devices found */
+	uint32_t missing; /*!< number of addresses without device */
+	uint32_t worker_count;
+	scan_worker_t workers[SCAN_MAX_WORKERS];
+
+} device_scan_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Scans the individual addresses first_addr to last_addr with up to
+	concurrency service ports, spread over the access ports aps.
+	If concurrency is 0 SCAN_WORKERS_PER_PORT service ports per access port are used.
+	Returns when all addresses are scanned or the callback stopped the scan.
+	Returns the number of devices found.
+*/
+static uint32_t scan_run(const int32_t aps[], uint32_t ap_count, uint16_t first_addr, uint16_t last_addr,
+                         uint32_t concurrency, scan_callback c, void* user_data);
+
+/*!
+	The worker thread
+*/
+static void* scan_worker(void* arg);
+
+/*!
+	Scans one address with the service port of a worker
+*/
+static void scan_address(int32_t sp, uint16_t ind_addr, scan_result_t* result);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Opens up to count tunneling connections to the interface.
+	Returns the number of opened tunnels.
+*/
+static uint32_t open_tunnels(const char* ip_address, int32_t aps[], uint32_t count);
+
+/*!
+	Prints a scan result
+*/
+static bool_t on_result(const scan_result_t* result, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t aps[SCAN_MAX_PORTS];
+	uint32_t ap_count = 0;
+	uint32_t index = 0;
+	uint32_t found = 0;
+	uint32_t start = 0;
+	unsigned int area = 1;
+	unsigned int line = 1;
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	if ((argc > 1) && ((sscanf(argv[1], "%u.%u", &area, &line) != 2) || (area > 15) || (line > 15)))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Usage: kdrive_express_device_scan [area.line]");
+		return -1;
+	}
+
+	/*
+		Open up to 4 tunneling connections with a specific IP Interface,
+		you will probably have to change the IP address
+	*/
+	ap_count = open_tunnels("192.168.1.45", aps, 4);
+	if (ap_count > 0)
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Scanning line %u.%u with %u tunnel(s)", area, line, ap_count);
+
+		start = now_ms();
+		found = scan_run(aps, ap_count, (uint16_t)((area << 12) | (line << 8)),
+		                 (uint16_t)((area << 12) | (line << 8) | 0xFF), 0, &on_result, NULL);
+
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Found %u device(s) in %u ms", found, now_ms() - start);
+	}
+
+	for (index = 0; index < ap_count; ++index)
+	{
+		kdrive_ap_close(aps[index]);
+		kdrive_ap_release(aps[index]);
+	}
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+uint32_t scan_run(const int32_t aps[], uint32_t ap_count, uint16_t first_addr, uint16_t last_addr,
+                  uint32_t concurrency, scan_callback c, void* user_data)
+{
+	device_scan_t scan;
+	scan_worker_t* worker = 0;
+	uint32_t index = 0;
+
+	if ((ap_count == 0) || (first_addr > last_addr))
+	{
+		return 0;
+	}
+
+	memset(&scan, 0, sizeof(device_scan_t));
+	pthread_mutex_init(&scan.mutex, NULL);
+	pthread_mutex_init(&scan.callback_mutex, NULL);
+	scan.next_addr = first_addr;
+	scan.last_addr = last_addr;
+	scan.callback = c;
+	scan.user_data = user_data;
+
+	if (concurrency == 0)
+	{
+		concurrency = ap_count * SCAN_WORKERS_PER_PORT;
+	}
+	if (concurrency > SCAN_MAX_WORKERS)
+	{
+		concurrency = SCAN_MAX_WORKERS;
+	}
+	if (concurrency > (uint32_t) last_addr - first_addr + 1)
+	{
+		concurrency = (uint32_t) last_addr - first_addr + 1;
+	}
+
+	for (index = 0; index < concurrency; ++index)
+	{
+		worker = &scan.workers[scan.worker_count];
+		worker->scan = &scan;
+		worker->sp = kdrive_sp_create(aps[index % ap_count]);
+		if (worker->sp == KDRIVE_INVALID_DESCRIPTOR)
+		{
+			break;
+		}
+
+		/* connection-oriented, so missing devices are detected on the T_Connect */
+		kdrive_sp_set_co(worker->sp, 1);
+
+		if (pthread_create(&worker->thread, NULL, &scan_worker, worker) != 0)
+		{
+			kdrive_sp_release(worker->sp);
+			break;
+		}
+
+		++scan.worker_count;
+	}
+
+	for (index = 0; index < scan.worker_count; ++index)
+	{
+		pthread_join(scan.workers[index].thread, NULL);
+		kdrive_sp_release(scan.workers[index].sp);
+	}
+
+	pthread_mutex_destroy(&scan.callback_mutex);
+	pthread_mutex_destroy(&scan.mutex);
+
+	return scan.found;
+}
+
+void* scan_worker(void* arg)
+{
+	scan_worker_t* worker = (scan_worker_t*) arg;
+	device_scan_t* scan = worker->scan;
+	scan_result_t result;
+	uint16_t ind_addr = 0;
+
+	while (1)
+	{
+		pthread_mutex_lock(&scan->mutex);
+		if (scan->stop || (scan->next_addr > scan->last_addr))
+		{
+			pthread_mutex_unlock(&scan->mutex);
+			break;
+		}
+		ind_addr = (uint16_t) scan->next_addr++;
+		pthread_mutex_unlock(&scan->mutex);
+
+		scan_address(worker->sp, ind_addr, &result);
+
+		pthread_mutex_lock(&scan->mutex);
+		if (result.error == KDRIVE_ERROR_NONE)
+		{
+			++scan->found;
+		}
+		else
+		{
+			++scan->missing;
+		}
+		pthread_mutex_unlock(&scan->mutex);
+
+		pthread_mutex_lock(&scan->callback_mutex);
+		if (scan->callback && !scan->callback(&result, scan->user_data))
+		{
+			pthread_mutex_lock(&scan->mutex);
+			scan->stop = 1;
+			pthread_mutex_unlock(&scan->mutex);
+		}
+		pthread_mutex_unlock(&scan->callback_mutex);
+	}
+
+	return NULL;
+}
+
+/*!
+	The type 0 read is the probe: a missing device fails with a negative
+	confirm or a disconnect, otherwise after SCAN_PROBE_TIMEOUT.
+	The type 2 read is optional, not all devices support it.
+*/
+void scan_address(int32_t sp, uint16_t ind_addr, scan_result_t* result)
+{
+	uint32_t start = now_ms();
+
+	memset(result, 0, sizeof(scan_result_t));
+	result->ind_addr = ind_addr;
+
+	kdrive_sp_set_response_timeout(sp, SCAN_PROBE_TIMEOUT);
+	result->error = kdrive_sp_device_descriptor_type0_read(sp, ind_addr, &result->mask_version);
+
+	if (result->error == KDRIVE_ERROR_NONE)
+	{
+		kdrive_sp_set_response_timeout(sp, SCAN_RESPONSE_TIMEOUT);
+		result->has_desc2 = (kdrive_sp_device_descriptor_type2_read(sp, ind_addr, &result->desc2) == KDRIVE_ERROR_NONE);
+	}
+
+	result->elapsed = now_ms() - start;
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000u) + ((uint32_t) ts.tv_nsec / 1000000u);
+}
+
+uint32_t open_tunnels(const char* ip_address, int32_t aps[], uint32_t count)
+{
+	uint32_t opened = 0;
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+
+	if (count > SCAN_MAX_PORTS)
+	{
+		count = SCAN_MAX_PORTS;
+	}
+
+	while (opened < count)
+	{
+		ap = kdrive_ap_create();
+		if (ap == KDRIVE_INVALID_DESCRIPTOR)
+		{
+			break;
+		}
+
+		if (kdrive_ap_open_ip(ap, ip_address) != KDRIVE_ERROR_NONE)
+		{
+			/* KDRIVE_AP_NO_MORE_CONNECTIONS_ERROR: all tunnels of the interface are in use */
+			kdrive_ap_release(ap);
+			break;
+		}
+
+		aps[opened++] = ap;
+	}
+
+	return opened;
+}
+
+/*!
+	Prints the found devices, the missing
+	addresses are only counted
+*/
+bool_t on_result(const scan_result_t* result, void* user_data)
+{
+	uint16_t a = result->ind_addr;
+
+	if (result->error != KDRIVE_ERROR_NONE)
+	{
+		return 1;
+	}
+
+	if (result->has_desc2)
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION,
+		                 "%u.%u.%u: mask version 0x%04X, manufacturer 0x%04X, application 0x%04X v%u (%u ms)",
+		                 (a >> 12) & 0x0F, (a >> 8) & 0x0F, a & 0xFF, result->mask_version,
+		                 result->desc2.manufacturer, result->desc2.app_id, result->desc2.app_ver, result->elapsed);
+	}
+	else
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u.%u.%u: mask version 0x%04X (%u ms)",
+		                 (a >> 12) & 0x0F, (a >> 8) & 0x0F, a & 0xFF, result->mask_version, result->elapsed);
+	}
+
+	return 1;
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message. The negative confirms and
+	timeouts of the missing devices are expected.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if ((e != KDRIVE_TIMEOUT_ERROR) && (e != KDRIVE_SP_NEGATIVE_CONFIRM_ERROR) &&
+	    (e != KDRIVE_KER_DISCONNECTED_ERROR))
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
@@ -0,0 +1,769 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	EMI1 / EMI2 / cEMI Conversion
+
+	kdrive_utils_emi1_to_cemi converts a single EMI1 telegram into cEMI.
+	This sample converts L_Data frames between all three formats:
+	- emi_convert converts one frame, the destination may be the source
+	  buffer (in place) if it is large enough: EMI to cEMI needs 2 more bytes,
+	  cEMI to EMI drops the additional info
+	- emi_convert_batch converts a packed array of frames (i.e. a captured
+	  log), each frame is preceded by its length (2 bytes, big endian).
+	  Frames which can't be converted are skipped and counted. The
+	  destination may be the source buffer if no frame grows (to EMI1/EMI2)
+
+	Supported are L_Data.req, L_Data.con and L_Data.ind. In EMI1 the message
+	code 0x49 is used by L_Data.ind and L_Busmon.ind, it is converted as L_Data.ind.
+	The control field is copied unchanged, the address type and hop count
+	are moved between the EMI NPCI and the cEMI control field 2.
+	A cEMI frame with an extended frame format or a length above 15 can't
+	be represented in EMI1/EMI2 (KDRIVE_UNSUPPORTED_ERROR).
+
+	Start the sample with the argument "check" to run the round trip checks
+	over all message codes, control fields and lengths, or with "bench"
+	to measure the conversion rate in frames per second.
+
+	gcc -O2 -I../../include -o kdrive_express_emi_convert kdrive_express_emi_convert.c -lkdriveExpress
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <kdrive_express.h>
+#include <kdrive_express_utils.h>
+
+#define ERROR_MESSAGE_LEN			(128)	/*!< kdriveExpress Error Messages */
+#define MAX_TELEGRAM_LEN			(300)	/*!< max frame length: cEMI with additional info */
+
+#define EMI_FORMAT_EMI1				(0)		/*!< EMI1 */
+#define EMI_FORMAT_EMI2				(1)		/*!< EMI2 */
+#define EMI_FORMAT_CEMI				(2)		/*!< Common EMI */
+#define EMI_FORMATS					(3)		/*!< number of formats */
+
+#define EMI_L_DATA_REQ				(0)		/*!< index of L_Data.req in the message code table */
+#define EMI_L_DATA_CON				(1)		/*!< index of L_Data.con in the message code table */
+#define EMI_L_DATA_IND				(2)		/*!< index of L_Data.ind in the message code table */
+#define EMI_SERVICES				(3)		/*!< number of services */
+
+#define EMI_HEADER_LEN				(7)		/*!< EMI: message code, control, source, destination, NPCI */
+#define CEMI_HEADER_LEN				(9)		/*!< cEMI without additional info: message code, additional info length, control 1, control 2, source, destination, length */
+#define BATCH_LENGTH_LEN			(2)		/*!< the length in front of each frame of a batch */
+
+#define BENCH_FRAMES				(1000000)	/*!< number of frames in the benchmark log */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	The fields of an L_Data frame, independent of the format
+*/
+typedef struct emi_frame_t
+{
+	uint8_t service; /*!< EMI_L_DATA_REQ, EMI_L_DATA_CON or EMI_L_DATA_IND */
+	uint8_t ctrl1; /*!< control field (1) */
+	uint8_t ctrl2; /*!< address type, hop count and extended frame format */
+	uint8_t length; /*!< length of the APDU */
+	const uint8_t* addresses; /*!< source and destination address (4 bytes) */
+	const uint8_t* tpdu; /*!< TPCI, APCI and data */
+	uint32_t tpdu_len;
+
+} emi_frame_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Converts an L_Data frame
+	\param from the format of src (EMI_FORMAT_xxx)
+	\param to the format of dst (EMI_FORMAT_xxx)
+	\param dst the converted frame, may be src (in place)
+	\param dst_len holds the size of dst [in] and returns the length of the converted frame [out]
+*/
+static error_t emi_convert(uint32_t from, uint32_t to, const uint8_t src[], uint32_t src_len,
+                           uint8_t dst[], uint32_t* dst_len);
+
+/*!
+	Converts a packed array of frames, each frame is preceded by its length (big endian).
+	\param dst the converted frames, may be src if the frames don't grow
+	\param dst_len holds the size of dst [in] and returns the length of the converted frames [out]
+	\param converted returns the number of converted frames
+	\param skipped returns the number of frames which couldn't be converted
+*/
+static error_t emi_convert_batch(uint32_t from, uint32_t to, const uint8_t src[], uint32_t src_len,
+                                 uint8_t dst[], uint32_t* dst_len, uint32_t* converted, uint32_t* skipped);
+
+/*!
+	Decodes an L_Data frame
+*/
+static error_t emi_decode(uint32_t format, const uint8_t src[], uint32_t src_len, emi_frame_t* frame);
+
+/*!
+	Returns the service for the message code, -1 if not supported
+*/
+static int32_t emi_service(uint32_t format, uint8_t message_code);
+
+/*!
+	Runs the round trip checks, returns the number of failed checks
+*/
+static uint32_t run_check(void);
+
+/*!
+	Converts the frame from -> to -> from and compares it with the expected frame.
+	Also compares the in place and the batch conversion with emi_convert.
+	Returns 1 if all conversions match
+*/
+static bool_t check_round_trip(uint32_t from, uint32_t to, const uint8_t frame[], uint32_t frame_len,
+                               const uint8_t expected[], uint32_t expected_len);
+
+/*!
+	Measures the conversion rate
+*/
+static void run_benchmark(void);
+
+/*!
+	Converts the log in the benchmark and logs the rate
+*/
+static void bench_batch(const char* name, uint32_t from, uint32_t to, const uint8_t src[], uint32_t src_len,
+                        uint8_t dst[], uint32_t* dst_len);
+
+/*!
+	Returns the monotonic time in seconds
+*/
+static double now_s(void);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+/*!
+	The message codes of the services in the formats
+*/
+static const uint8_t message_codes_[EMI_FORMATS][EMI_SERVICES] =
+{
+	{ 0x11, 0x4E, 0x49 }, /* EMI1 */
+	{ 0x11, 0x2E, 0x29 }, /* EMI2 */
+	{ KDRIVE_CEMI_L_DATA_REQ, KDRIVE_CEMI_L_DATA_CON, KDRIVE_CEMI_L_DATA_IND } /* cEMI */
+};
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	/* EMI1 L_Data.ind: 1.1.1 -> 1/1/1, GroupValue_Write 1 */
+	const uint8_t emi1[] = { 0x49, 0xBC, 0x11, 0x01, 0x09, 0x01, 0xE1, 0x00, 0x81 };
+	uint8_t cemi[MAX_TELEGRAM_LEN];
+	uint8_t emi2[MAX_TELEGRAM_LEN];
+	uint32_t cemi_len = sizeof(cemi);
+	uint32_t emi2_len = sizeof(emi2);
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	if ((argc > 1) && (strcmp(argv[1], "check") == 0))
+	{
+		return (run_check() == 0) ? 0 : 1;
+	}
+
+	if ((argc > 1) && (strcmp(argv[1], "bench") == 0))
+	{
+		run_benchmark();
+		return 0;
+	}
+
+	kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "EMI1 :", emi1, sizeof(emi1));
+
+	if (kdrive_utils_emi1_to_cemi(emi1, sizeof(emi1), cemi, &cemi_len) == KDRIVE_ERROR_NONE)
+	{
+		kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "cEMI (kdrive_utils_emi1_to_cemi) :", cemi, cemi_len);
+	}
+
+	cemi_len = sizeof(cemi);
+	if (emi_convert(EMI_FORMAT_EMI1, EMI_FORMAT_CEMI, emi1, sizeof(emi1), cemi, &cemi_len) == KDRIVE_ERROR_NONE)
+	{
+		kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "cEMI (emi_convert) :", cemi, cemi_len);
+	}
+
+	if (emi_convert(EMI_FORMAT_CEMI, EMI_FORMAT_EMI2, cemi, cemi_len, emi2, &emi2_len) == KDRIVE_ERROR_NONE)
+	{
+		kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "EMI2 :", emi2, emi2_len);
+	}
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	The fields are decoded first, then the blocks are moved and the
+	header is written. When converting in place the blocks are moved
+	in an order which doesn't overwrite a block which is still to be moved:
+	the TPDU first when the frame grows, the addresses first when it shrinks.
+*/
+error_t emi_convert(uint32_t from, uint32_t to, const uint8_t src[], uint32_t src_len,
+                    uint8_t dst[], uint32_t* dst_len)
+{
+	emi_frame_t frame;
+	uint32_t length = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	if (to >= EMI_FORMATS)
+	{
+		return KDRIVE_UNSUPPORTED_ERROR;
+	}
+
+	e = emi_decode(from, src, src_len, &frame);
+	if (e != KDRIVE_ERROR_NONE)
+	{
+		return e;
+	}
+
+	if (to == EMI_FORMAT_CEMI)
+	{
+		length = CEMI_HEADER_LEN + frame.tpdu_len;
+		if (length > *dst_len)
+		{
+			return KDRIVE_BUFFER_TOO_SMALL_ERROR;
+		}
+
+		if (&dst[4] > frame.addresses)
+		{
+			memmove(&dst[CEMI_HEADER_LEN], frame.tpdu, frame.tpdu_len);
+			memmove(&dst[4], frame.addresses, 4);
+		}
+		else
+		{
+			memmove(&dst[4], frame.addresses, 4);
+			memmove(&dst[CEMI_HEADER_LEN], frame.tpdu, frame.tpdu_len);
+		}
+
+		dst[0] = message_codes_[to][frame.service];
+		dst[1] = 0x00; /* no additional info */
+		dst[2] = frame.ctrl1;
+		dst[3] = frame.ctrl2;
+		dst[8] = frame.length;
+	}
+	else
+	{
+		/* EMI has no extended frame format and 4 bits for the length */
+		if (((frame.ctrl2 & 0x0F) != 0) || (frame.length > 0x0F))
+		{
+			return KDRIVE_UNSUPPORTED_ERROR;
+		}
+
+		length = EMI_HEADER_LEN + frame.tpdu_len;
+		if (length > *dst_len)
+		{
+			return KDRIVE_BUFFER_TOO_SMALL_ERROR;
+		}
+
+		memmove(&dst[2], frame.addresses, 4);
+		memmove(&dst[EMI_HEADER_LEN], frame.tpdu, frame.tpdu_len);
+
+		dst[0] = message_codes_[to][frame.service];
+		dst[1] = frame.ctrl1;
+		dst[6] = (uint8_t)((frame.ctrl2 & 0xF0) | frame.length);
+	}
+
+	*dst_len = length;
+
+	return KDRIVE_ERROR_NONE;
+}
+
+/*!
+	The frames are converted one after another. When dst is src
+	the write position never passes the read position, as long
+	as no frame grows.
+*/
+error_t emi_convert_batch(uint32_t from, uint32_t to, const uint8_t src[], uint32_t src_len,
+                          uint8_t dst[], uint32_t* dst_len, uint32_t* converted, uint32_t* skipped)
+{
+	uint32_t read = 0;
+	uint32_t write = 0;
+	uint32_t frame_len = 0;
+	uint32_t length = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	*converted = 0;
+	*skipped = 0;
+
+	if ((dst == src) && (to == EMI_FORMAT_CEMI) && (from != EMI_FORMAT_CEMI))
+	{
+		return KDRIVE_UNSUPPORTED_ERROR;
+	}
+
+	while (read + BATCH_LENGTH_LEN <= src_len)
+	{
+		frame_len = (uint32_t)((src[read] << 8) | src[read + 1]);
+		read += BATCH_LENGTH_LEN;
+		if (read + frame_len > src_len)
+		{
+			return KDRIVE_AP_INVALID_TELEGRAM_ERROR;
+		}
+
+		if (write + BATCH_LENGTH_LEN > *dst_len)
+		{
+			return KDRIVE_BUFFER_TOO_SMALL_ERROR;
+		}
+
+		length = *dst_len - write - BATCH_LENGTH_LEN;
+		e = emi_convert(from, to, &src[read], frame_len, &dst[write + BATCH_LENGTH_LEN], &length);
+		if (e == KDRIVE_BUFFER_TOO_SMALL_ERROR)
+		{
+			return e;
+		}
+
+		if (e == KDRIVE_ERROR_NONE)
+		{
+			dst[write] = (uint8_t)(length >> 8);
+			dst[write + 1] = (uint8_t)(length & 0xFF);
+			write += BATCH_LENGTH_LEN + length;
+			++*converted;
+		}
+		else
+		{
+			++*skipped;
+		}
+
+		read += frame_len;
+	}
+
+	if (read != src_len)
+	{
+		return KDRIVE_AP_INVALID_TELEGRAM_ERROR;
+	}
+
+	*dst_len = write;
+
+	return KDRIVE_ERROR_NONE;
+}
+
+/*!
+	EMI: message code, control, source, destination, NPCI (address type,
+	hop count, length), TPCI, APCI, data.
+	cEMI: message code, additional info length, additional info, control 1,
+	control 2 (address type, hop count, extended frame format), source,
+	destination, length, TPCI, APCI, data.
+*/
+error_t emi_decode(uint32_t format, const uint8_t src[], uint32_t src_len, emi_frame_t* frame)
+{
+	const uint8_t* fields = 0;
+	int32_t service = 0;
+
+	if ((format >= EMI_FORMATS) || (src_len < 1))
+	{
+		return KDRIVE_UNSUPPORTED_ERROR;
+	}
+
+	service = emi_service(format, src[0]);
+	if (service < 0)
+	{
+		return KDRIVE_UNSUPPORTED_ERROR;
+	}
+	frame->service = (uint8_t) service;
+
+	if (format == EMI_FORMAT_CEMI)
+	{
+		if ((src_len < 2) || (src_len < CEMI_HEADER_LEN + src[1] + 1u))
+		{
+			return KDRIVE_AP_INVALID_TELEGRAM_ERROR;
+		}
+
+		fields = &src[2 + src[1]];
+		frame->ctrl1 = fields[0];
+		frame->ctrl2 = fields[1];
+		frame->addresses = &fields[2];
+		frame->length = fields[6];
+		frame->tpdu = &fields[7];
+		frame->tpdu_len = src_len - CEMI_HEADER_LEN - src[1];
+	}
+	else
+	{
+		if (src_len < EMI_HEADER_LEN + 1)
+		{
+			return KDRIVE_AP_INVALID_TELEGRAM_ERROR;
+		}
+
+		frame->ctrl1 = src[1];
+		frame->ctrl2 = (uint8_t)(src[6] & 0xF0);
+		frame->addresses = &src[2];
+		frame->length = (uint8_t)(src[6] & 0x0F);
+		frame->tpdu = &src[EMI_HEADER_LEN];
+		frame->tpdu_len = src_len - EMI_HEADER_LEN;
+	}
+
+	/* the length doesn't count the TPCI */
+	if (frame->tpdu_len != frame->length + 1u)
+	{
+		return KDRIVE_AP_INVALID_TELEGRAM_ERROR;
+	}
+
+	return KDRIVE_ERROR_NONE;
+}
+
+int32_t emi_service(uint32_t format, uint8_t message_code)
+{
+	int32_t service = 0;
+
+	for (service = 0; service < EMI_SERVICES; ++service)
+	{
+		if (message_codes_[format][service] == message_code)
+		{
+			return service;
+		}
+	}
+
+	return -1;
+}
+
+/*!
+	For each service and each pair of formats:
+	- all EMI frames (all control fields, all NPCI values, i.e. address type,
+	  hop count and all 16 lengths) convert to the other format and back
+	  to the same frame
+	- all cEMI frames (all control fields 1 and 2, lengths 0..16) convert to
+	  EMI and back to the same frame when they can be represented in EMI, and
+	  fail with KDRIVE_UNSUPPORTED_ERROR otherwise. With additional info the
+	  frame comes back without it
+	- the in place and batch conversions give the same result as emi_convert
+*/
+uint32_t run_check(void)
+{
+	uint8_t frame[MAX_TELEGRAM_LEN];
+	uint8_t expected[MAX_TELEGRAM_LEN];
+	uint8_t converted[MAX_TELEGRAM_LEN];
+	uint32_t converted_len = 0;
+	uint32_t frame_len = 0;
+	uint32_t from = 0;
+	uint32_t to = 0;
+	uint32_t service = 0;
+	uint32_t ctrl1 = 0;
+	uint32_t ctrl2 = 0;
+	uint32_t length = 0;
+	uint32_t index = 0;
+	uint32_t checks = 0;
+	uint32_t failed = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+	const uint8_t add_info[] = { 0x03, 0x02, 0x12, 0x34 }; /* an additional info field */
+
+	for (service = 0; service < EMI_SERVICES; ++service)
+	{
+		for (from = EMI_FORMAT_EMI1; from <= EMI_FORMAT_EMI2; ++from)
+		{
+			for (to = 0; to < EMI_FORMATS; ++to)
+			{
+				for (ctrl1 = 0; ctrl1 < 256; ++ctrl1)
+				{
+					for (ctrl2 = 0; ctrl2 < 256; ++ctrl2)
+					{
+						length = ctrl2 & 0x0F;
+						frame[0] = message_codes_[from][service];
+						frame[1] = (uint8_t) ctrl1;
+						frame[2] = 0x11;
+						frame[3] = (uint8_t) ctrl1;
+						frame[4] = (uint8_t) ctrl2;
+						frame[5] = 0x01;
+						frame[6] = (uint8_t) ctrl2;
+						for (index = 0; index <= length; ++index)
+						{
+							frame[EMI_HEADER_LEN + index] = (uint8_t)(index * 37 + ctrl1);
+						}
+						frame_len = EMI_HEADER_LEN + length + 1;
+
+						++checks;
+						if (!check_round_trip(from, to, frame, frame_len, frame, frame_len))
+						{
+							++failed;
+						}
+					}
+				}
+			}
+		}
+
+		for (to = EMI_FORMAT_EMI1; to <= EMI_FORMAT_EMI2; ++to)
+		{
+			for (ctrl1 = 0; ctrl1 < 256; ++ctrl1)
+			{
+				for (ctrl2 = 0; ctrl2 < 256; ++ctrl2)
+				{
+					for (length = 0; length <= 16; ++length)
+					{
+						expected[0] = message_codes_[EMI_FORMAT_CEMI][service];
+						expected[1] = 0x00;
+						expected[2] = (uint8_t) ctrl1;
+						expected[3] = (uint8_t) ctrl2;
+						expected[4] = 0x11;
+						expected[5] = (uint8_t) ctrl1;
+						expected[6] = (uint8_t) ctrl2;
+						expected[7] = 0x01;
+						expected[8] = (uint8_t) length;
+						for (index = 0; index <= length; ++index)
+						{
+							expected[CEMI_HEADER_LEN + index] = (uint8_t)(index * 37 + ctrl2);
+						}
+						frame_len = CEMI_HEADER_LEN + length + 1;
+
+						/* the same frame with additional info */
+						frame[0] = expected[0];
+						frame[1] = sizeof(add_info);
+						memcpy(&frame[2], add_info, sizeof(add_info));
+						memcpy(&frame[2 + sizeof(add_info)], &expected[2], frame_len - 2);
+
+						checks += 2;
+						if (((ctrl2 & 0x0F) != 0) || (length > 0x0F))
+						{
+							converted_len = sizeof(converted);
+							e = emi_convert(EMI_FORMAT_CEMI, to, expected, frame_len, converted, &converted_len);
+							if (e != KDRIVE_UNSUPPORTED_ERROR)
+							{
+								++failed;
+							}
+							converted_len = sizeof(converted);
+							e = emi_convert(EMI_FORMAT_CEMI, to, frame, frame_len + sizeof(add_info), converted, &converted_len);
+							if (e != KDRIVE_UNSUPPORTED_ERROR)
+							{
+								++failed;
+							}
+							continue;
+						}
+
+						if (!check_round_trip(EMI_FORMAT_CEMI, to, expected, frame_len, expected, frame_len))
+						{
+							++failed;
+						}
+						if (!check_round_trip(EMI_FORMAT_CEMI, to, frame, frame_len + sizeof(add_info), expected, frame_len))
+						{
+							++failed;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/* frames which are too short or have a wrong length */
+	frame[0] = message_codes_[EMI_FORMAT_EMI1][EMI_L_DATA_IND];
+	frame[6] = 0x02;
+	for (frame_len = 0; frame_len < EMI_HEADER_LEN + 3; ++frame_len)
+	{
+		++checks;
+		converted_len = sizeof(converted);
+		if (emi_convert(EMI_FORMAT_EMI1, EMI_FORMAT_CEMI, frame, frame_len, converted, &converted_len) == KDRIVE_ERROR_NONE)
+		{
+			++failed;
+		}
+	}
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u checks, %u failed", checks, failed);
+
+	return failed;
+}
+
+bool_t check_round_trip(uint32_t from, uint32_t to, const uint8_t frame[], uint32_t frame_len,
+                        const uint8_t expected[], uint32_t expected_len)
+{
+	uint8_t converted[MAX_TELEGRAM_LEN];
+	uint8_t back[MAX_TELEGRAM_LEN];
+	uint8_t in_place[MAX_TELEGRAM_LEN];
+	uint8_t batch[BATCH_LENGTH_LEN + MAX_TELEGRAM_LEN];
+	uint8_t batch_out[BATCH_LENGTH_LEN + MAX_TELEGRAM_LEN];
+	uint32_t converted_len = sizeof(converted);
+	uint32_t back_len = sizeof(back);
+	uint32_t in_place_len = sizeof(in_place);
+	uint32_t batch_len = sizeof(batch_out);
+	uint32_t count = 0;
+	uint32_t skipped = 0;
+
+	if ((emi_convert(from, to, frame, frame_len, converted, &converted_len) != KDRIVE_ERROR_NONE) ||
+	    (emi_convert(to, from, converted, converted_len, back, &back_len) != KDRIVE_ERROR_NONE) ||
+	    (back_len != expected_len) || (memcmp(back, expected, expected_len) != 0))
+	{
+		return 0;
+	}
+
+	/* in place: the buffer holds the frame and is large enough for the result */
+	memcpy(in_place, frame, frame_len);
+	if ((emi_convert(from, to, in_place, frame_len, in_place, &in_place_len) != KDRIVE_ERROR_NONE) ||
+	    (in_place_len != converted_len) || (memcmp(in_place, converted, converted_len) != 0))
+	{
+		return 0;
+	}
+
+	/* batch with one frame, in place when the frame doesn't grow */
+	batch[0] = (uint8_t)(frame_len >> 8);
+	batch[1] = (uint8_t)(frame_len & 0xFF);
+	memcpy(&batch[BATCH_LENGTH_LEN], frame, frame_len);
+	if (to != EMI_FORMAT_CEMI)
+	{
+		batch_len = sizeof(batch);
+		if ((emi_convert_batch(from, to, batch, BATCH_LENGTH_LEN + frame_len, batch, &batch_len, &count, &skipped) != KDRIVE_ERROR_NONE) ||
+		    (count != 1) || (batch_len != BATCH_LENGTH_LEN + converted_len) ||
+		    (memcmp(&batch[BATCH_LENGTH_LEN], converted, converted_len) != 0))
+		{
+			return 0;
+		}
+	}
+	else if ((emi_convert_batch(from, to, batch, BATCH_LENGTH_LEN + frame_len, batch_out, &batch_len, &count, &skipped) != KDRIVE_ERROR_NONE) ||
+	         (count != 1) || (batch_len != BATCH_LENGTH_LEN + converted_len) ||
+	         (memcmp(&batch_out[BATCH_LENGTH_LEN], converted, converted_len) != 0))
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+/*!
+	Builds a log of BENCH_FRAMES EMI1 L_Data.ind frames with 1 to 15
+	bytes APDU and converts it:
+	- EMI1 -> cEMI with kdrive_utils_emi1_to_cemi, frame by frame
+	- EMI1 -> cEMI with emi_convert_batch
+	- cEMI -> EMI2 with emi_convert_batch in place
+	- EMI2 -> EMI1 with emi_convert_batch in place
+*/
+void run_benchmark(void)
+{
+	const uint32_t size = BENCH_FRAMES * (BATCH_LENGTH_LEN + CEMI_HEADER_LEN + 16);
+	uint8_t* emi1 = (uint8_t*) malloc(size);
+	uint8_t* cemi = (uint8_t*) malloc(size);
+	uint8_t buffer[MAX_TELEGRAM_LEN];
+	uint32_t buffer_len = 0;
+	uint32_t emi1_len = 0;
+	uint32_t cemi_len = size;
+	uint32_t frame_len = 0;
+	uint32_t read = 0;
+	uint32_t index = 0;
+	uint32_t length = 0;
+	uint32_t count = 0;
+	double start = 0;
+	double seconds = 0;
+
+	if (!emi1 || !cemi)
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to allocate the log");
+		free(emi1);
+		free(cemi);
+		return;
+	}
+
+	for (index = 0; index < BENCH_FRAMES; ++index)
+	{
+		length = 1 + (index % 15);
+		frame_len = EMI_HEADER_LEN + length + 1;
+		emi1[emi1_len++] = 0;
+		emi1[emi1_len++] = (uint8_t) frame_len;
+		emi1[emi1_len++] = message_codes_[EMI_FORMAT_EMI1][EMI_L_DATA_IND];
+		emi1[emi1_len++] = (uint8_t)(0xB0 | ((index & 0x03) << 2));
+		emi1[emi1_len++] = 0x11;
+		emi1[emi1_len++] = (uint8_t) index;
+		emi1[emi1_len++] = (uint8_t)(0x08 | ((index >> 8) & 0x07));
+		emi1[emi1_len++] = (uint8_t) index;
+		emi1[emi1_len++] = (uint8_t)(0xE0 | length);
+		emi1[emi1_len++] = 0x00;
+		emi1[emi1_len++] = 0x80;
+		memset(&emi1[emi1_len], (int) index, length - 1);
+		emi1_len += length - 1;
+	}
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u frames, %u bytes EMI1", BENCH_FRAMES, emi1_len);
+
+	/* the baseline: the library converts a frame at a time */
+	start = now_s();
+	for (read = 0; read < emi1_len; read += BATCH_LENGTH_LEN + frame_len)
+	{
+		frame_len = emi1[read + 1];
+		buffer_len = sizeof(buffer);
+		if (kdrive_utils_emi1_to_cemi(&emi1[read + BATCH_LENGTH_LEN], frame_len, buffer, &buffer_len) == KDRIVE_ERROR_NONE)
+		{
+			++count;
+		}
+	}
+	seconds = now_s() - start;
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%-32s %12.0f frames/s (%u converted)",
+	                 "kdrive_utils_emi1_to_cemi", BENCH_FRAMES / seconds, count);
+
+	bench_batch("EMI1 -> cEMI", EMI_FORMAT_EMI1, EMI_FORMAT_CEMI, emi1, emi1_len, cemi, &cemi_len);
+	bench_batch("cEMI -> EMI2 (in place)", EMI_FORMAT_CEMI, EMI_FORMAT_EMI2, cemi, cemi_len, cemi, &cemi_len);
+	bench_batch("EMI2 -> EMI1 (in place)", EMI_FORMAT_EMI2, EMI_FORMAT_EMI1, cemi, cemi_len, cemi, &cemi_len);
+
+	if ((cemi_len != emi1_len) || (memcmp(cemi, emi1, emi1_len) != 0))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "The log differs after the round trip");
+	}
+
+	free(emi1);
+	free(cemi);
+}
+
+void bench_batch(const char* name, uint32_t from, uint32_t to, const uint8_t src[], uint32_t src_len,
+                 uint8_t dst[], uint32_t* dst_len)
+{
+	uint32_t converted = 0;
+	uint32_t skipped = 0;
+	double start = now_s();
+	error_t e = emi_convert_batch(from, to, src, src_len, dst, dst_len, &converted, &skipped);
+	double seconds = now_s() - start;
+
+	if (e != KDRIVE_ERROR_NONE)
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "%s failed: 0x%04X", name, e);
+		return;
+	}
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%-32s %12.0f frames/s (%u converted, %u skipped)",
+	                 name, converted / seconds, converted, skipped);
+}
+
+double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
@@ -0,0 +1,822 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Failover between several interfaces on the same KNX line
+
+	A failover port holds one access port per interface (USB, KNXnet/IP
+	Tunneling, FT1.2), the paths are added in the order of preference.
+	All paths are opened and receive at the same time, the telegrams are
+	sent on the healthiest path:
+	- a path is usable when it is open, the KNX bus is connected and it
+	  had less than FAILOVER_MAX_ERRORS send errors or missing confirms
+	  in a row. Of the usable paths the one with the fewest errors is used,
+	  on a tie the preferred one. The errors are cleared after
+	  FAILOVER_ERROR_HOLD ms without a further error.
+	- a failed send is repeated at once on the next usable path, so the
+	  failover takes at most one additional send. A path which was terminated
+	  or lost the bus is not used from the next send on (the event callback)
+	- a supervisor thread re-opens the closed paths with exponential backoff
+	  and switches back to the preferred path when it is healthy again
+	- the application registers one telegram callback on the failover port.
+	  An L_Data.ind which arrives on several paths within FAILOVER_DEDUP_WINDOW
+	  is passed only once
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_failover kdrive_express_failover.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN			(128)	/*!< kdriveExpress Error Messages */
+#define MAX_TELEGRAM_LEN			(64)	/*!< max cEMI telegram length */
+#define FAILOVER_MAX_PATHS			(4)		/*!< max number of interfaces */
+#define FAILOVER_MAX_ERRORS			(3)		/*!< a path with this number of errors in a row is not used */
+#define FAILOVER_ERROR_HOLD			(5000)	/*!< the errors of a path are cleared after this time without an error, in ms */
+#define FAILOVER_CHECK_INTERVAL		(100)	/*!< the supervisor runs every 100 ms */
+#define FAILOVER_BACKOFF_MIN		(100)	/*!< first re-open backoff in ms */
+#define FAILOVER_BACKOFF_MAX		(5000)	/*!< max re-open backoff in ms */
+#define FAILOVER_DEDUP_WINDOW		(500)	/*!< a telegram on another path within this time is a duplicate, in ms */
+#define FAILOVER_DEDUP_SIZE			(32)	/*!< number of recently received telegrams kept for the duplicate check */
+
+#define FAILOVER_USB				(0)		/*!< USB interface */
+#define FAILOVER_IP					(1)		/*!< KNXnet/IP Tunneling */
+#define FAILOVER_FT12				(2)		/*!< FT1.2 serial interface */
+
+/*******************************
+** Private Types
+********************************/
+
+struct failover_port_t;
+
+/*!
+	One interface of the failover port
+*/
+typedef struct failover_path_t
+{
+	struct failover_port_t* port;
+	int32_t ap; /*!< the access port descriptor */
+	uint32_t transport; /*!< FAILOVER_USB, FAILOVER_IP or FAILOVER_FT12 */
+	uint32_t usb_index; /*!< the USB interface index */
+	char address[64]; /*!< the ip address or the serial device */
+	uint32_t key; /*!< the telegram callback key */
+
+	bool_t open; /*!< 1 when the access port is open */
+	bool_t bus_connected; /*!< 0 after KDRIVE_EVENT_KNX_BUS_DISCONNECTED */
+	uint32_t errors; /*!< send errors and missing confirms in a row */
+	uint32_t last_error; /*!< time of the last error (ms) */
+	uint32_t backoff; /*!< the current re-open backoff in ms */
+	uint32_t next_attempt; /*!< time of the next re-open attempt (ms) */
+
+	uint32_t sent; /*!< number of telegrams sent on this path */
+	uint32_t received; /*!< number of L_Data.ind received on this path */
+
+} failover_path_t;
+
+/*!
+	A recently received L_Data.ind
+*/
+typedef struct dedup_entry_t
+{
+	uint8_t frame[MAX_TELEGRAM_LEN]; /*!< the frame without additional info */
+	uint32_t frame_len;
+	uint32_t received; /*!< time of the first reception (ms) */
+	uint32_t paths; /*!< bit mask of the paths it was received on */
+
+} dedup_entry_t;
+
+/*!
+	The failover port
+*/
+typedef struct failover_port_t
+{
+	failover_path_t paths[FAILOVER_MAX_PATHS]; /*!< in the order of preference */
+	uint32_t path_count;
+	int32_t active; /*!< the path used for sending, -1 if none is usable */
+
+	kdrive_ap_telegram_callback callback; /*!< called once for each received telegram */
+	void* user_data;
+
+	pthread_t thread; /*!< the supervisor thread */
+	pthread_mutex_t mutex; /*!< protects the path state and the duplicate check */
+	pthread_cond_t cond; /*!< signals the supervisor thread */
+	bool_t stop;
+	bool_t running; /*!< 1 when the supervisor thread was started */
+
+	dedup_entry_t recent[FAILOVER_DEDUP_SIZE]; /*!< ring of recently received telegrams */
+	uint32_t recent_next; /*!< the next entry to replace */
+
+	uint32_t failovers; /*!< number of changes of the active path */
+	uint32_t duplicates; /*!< number of dropped duplicates */
+
+} failover_port_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Initializes the failover port
+	\param c the telegram callback, called in the context of the notification thread of a path
+*/
+static void failover_init(failover_port_t* port, kdrive_ap_telegram_callback c, void* user_data);
+
+/*!
+	Adds a USB interface, see kdrive_ap_open_usb
+*/
+static error_t failover_add_usb(failover_port_t* port, uint32_t iface_index);
+
+/*!
+	Adds a KNXnet/IP Tunneling interface, see kdrive_ap_open_ip
+*/
+static error_t failover_add_ip(failover_port_t* port, const char* ip_address);
+
+/*!
+	Adds a FT1.2 serial interface, see kdrive_ap_open_serial_ft12
+*/
+static error_t failover_add_ft12(failover_port_t* port, const char* serial_device);
+
+/*!
+	Opens all paths and starts the supervisor thread.
+	Succeeds if at least one path was opened, the others are
+	opened by the supervisor thread.
+*/
+static error_t failover_open(failover_port_t* port);
+
+/*!
+	Stops the supervisor thread, closes and releases the access ports
+*/
+static void failover_close(failover_port_t* port);
+
+/*!
+	Sends a GroupValue_Write on the healthiest path, see kdrive_ap_group_write
+*/
+static error_t failover_group_write(failover_port_t* port, uint16_t address, const uint8_t* value, uint32_t bits);
+
+/*!
+	Creates the access port of a new path
+*/
+static failover_path_t* failover_add(failover_port_t* port, uint32_t transport);
+
+/*!
+	Selects the active path. The mutex must be locked
+*/
+static void failover_select(failover_port_t* port);
+
+/*!
+	The supervisor thread
+*/
+static void* failover_supervisor(void* arg);
+
+/*!
+	Opens the access port of the path
+*/
+static error_t path_open(failover_path_t* path);
+
+/*!
+	Returns 1 if the path can be used for sending. The mutex must be locked
+*/
+static bool_t path_is_usable(const failover_path_t* path);
+
+/*!
+	Returns the index of the path in the port
+*/
+static uint32_t path_index(const failover_path_t* path);
+
+/*!
+	Returns 1 if the L_Data.ind was already received on another path
+	within FAILOVER_DEDUP_WINDOW. The mutex must be locked
+*/
+static bool_t dedup_is_duplicate(failover_port_t* port, uint32_t path, const uint8_t telegram[], uint32_t telegram_len);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Event callback of the access port of a path
+*/
+static void path_event_callback(int32_t ap, uint32_t e, void* user_data);
+
+/*!
+	Telegram callback of the access port of a path
+*/
+static void path_telegram_callback(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Telegram Callback Handler of the application
+*/
+static void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static failover_port_t port;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	uint16_t address = 0x901;
+	uint8_t value = 0;
+	uint32_t index = 0;
+	failover_path_t* path = 0;
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	/*
+		The interfaces in the order of preference,
+		you will probably have to change the IP address and the serial device
+	*/
+	failover_init(&port, &on_telegram, NULL);
+	failover_add_usb(&port, 0);
+	failover_add_ip(&port, "192.168.1.45");
+	failover_add_ft12(&port, "/dev/ttyS0");
+
+	if (failover_open(&port) == KDRIVE_ERROR_NONE)
+	{
+		/*
+			Toggle the group object once a second for one minute.
+			Unplug one of the interfaces to see the failover.
+		*/
+		for (index = 0; index < 60; ++index)
+		{
+			value = (uint8_t)(index & 1);
+			if (failover_group_write(&port, address, &value, 1) != KDRIVE_ERROR_NONE)
+			{
+				kdrive_logger(KDRIVE_LOGGER_WARNING, "No interface available");
+			}
+			sleep(1);
+		}
+
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Failovers: %u, duplicates: %u", port.failovers, port.duplicates);
+		for (index = 0; index < port.path_count; ++index)
+		{
+			path = &port.paths[index];
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Path %u: %s, sent %u, received %u",
+			                 index, path->open ? "open" : "closed", path->sent, path->received);
+		}
+	}
+
+	failover_close(&port);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+void failover_init(failover_port_t* port, kdrive_ap_telegram_callback c, void* user_data)
+{
+	memset(port, 0, sizeof(failover_port_t));
+	port->active = -1;
+	port->callback = c;
+	port->user_data = user_data;
+	pthread_mutex_init(&port->mutex, NULL);
+	pthread_cond_init(&port->cond, NULL);
+}
+
+error_t failover_add_usb(failover_port_t* port, uint32_t iface_index)
+{
+	failover_path_t* path = failover_add(port, FAILOVER_USB);
+
+	if (!path)
+	{
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+	path->usb_index = iface_index;
+
+	return KDRIVE_ERROR_NONE;
+}
+
+error_t failover_add_ip(failover_port_t* port, const char* ip_address)
+{
+	failover_path_t* path = failover_add(port, FAILOVER_IP);
+
+	if (!path)
+	{
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+	strncpy(path->address, ip_address, sizeof(path->address) - 1);
+
+	return KDRIVE_ERROR_NONE;
+}
+
+error_t failover_add_ft12(failover_port_t* port, const char* serial_device)
+{
+	failover_path_t* path = failover_add(port, FAILOVER_FT12);
+
+	if (!path)
+	{
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+	strncpy(path->address, serial_device, sizeof(path->address) - 1);
+
+	return KDRIVE_ERROR_NONE;
+}
+
+/*!
+	The callbacks are registered once and stay registered
+	when the access port is closed and opened again
+*/
+failover_path_t* failover_add(failover_port_t* port, uint32_t transport)
+{
+	failover_path_t* path = 0;
+
+	if (port->path_count == FAILOVER_MAX_PATHS)
+	{
+		return 0;
+	}
+
+	path = &port->paths[port->path_count];
+	memset(path, 0, sizeof(failover_path_t));
+	path->port = port;
+	path->transport = transport;
+	path->bus_connected = 1;
+
+	path->ap = kdrive_ap_create();
+	if (path->ap == KDRIVE_INVALID_DESCRIPTOR)
+	{
+		return 0;
+	}
+
+	kdrive_set_event_callback(path->ap, &path_event_callback, path);
+	kdrive_ap_register_telegram_callback(path->ap, &path_telegram_callback, path, &path->key);
+	++port->path_count;
+
+	return path;
+}
+
+error_t failover_open(failover_port_t* port)
+{
+	failover_path_t* path = 0;
+	uint32_t index = 0;
+	uint32_t opened = 0;
+	const uint32_t now = now_ms();
+
+	for (index = 0; index < port->path_count; ++index)
+	{
+		path = &port->paths[index];
+		if (path_open(path) == KDRIVE_ERROR_NONE)
+		{
+			++opened;
+		}
+		else
+		{
+			path->backoff = FAILOVER_BACKOFF_MIN;
+			path->next_attempt = now + path->backoff;
+		}
+	}
+
+	if (opened == 0)
+	{
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+
+	pthread_mutex_lock(&port->mutex);
+	failover_select(port);
+	pthread_mutex_unlock(&port->mutex);
+
+	if (pthread_create(&port->thread, NULL, &failover_supervisor, port) != 0)
+	{
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+	port->running = 1;
+
+	return KDRIVE_ERROR_NONE;
+}
+
+void failover_close(failover_port_t* port)
+{
+	failover_path_t* path = 0;
+	uint32_t index = 0;
+
+	pthread_mutex_lock(&port->mutex);
+	port->stop = 1;
+	port->active = -1;
+	pthread_cond_signal(&port->cond);
+	pthread_mutex_unlock(&port->mutex);
+
+	if (port->running)
+	{
+		pthread_join(port->thread, NULL);
+		port->running = 0;
+	}
+
+	for (index = 0; index < port->path_count; ++index)
+	{
+		path = &port->paths[index];
+		kdrive_ap_remove_telegram_callback(path->ap, path->key);
+		kdrive_set_event_callback(path->ap, 0, 0);
+		kdrive_ap_close(path->ap);
+		kdrive_ap_release(path->ap);
+	}
+	port->path_count = 0;
+}
+
+/*!
+	Sends on the active path, and on the next usable ones until a send
+	succeeds. The send itself is made without holding the mutex.
+	Each path is tried at most once, so a send returns after
+	path_count attempts at the latest.
+*/
+error_t failover_group_write(failover_port_t* port, uint16_t address, const uint8_t* value, uint32_t bits)
+{
+	failover_path_t* path = 0;
+	error_t e = KDRIVE_UNKNOWN_ERROR;
+	uint32_t tried = 0;
+	uint32_t attempt = 0;
+
+	for (attempt = 0; attempt < FAILOVER_MAX_PATHS; ++attempt)
+	{
+		pthread_mutex_lock(&port->mutex);
+		if ((port->active < 0) || (tried & (1u << port->active)))
+		{
+			pthread_mutex_unlock(&port->mutex);
+			break;
+		}
+		path = &port->paths[port->active];
+		tried |= 1u << port->active;
+		pthread_mutex_unlock(&port->mutex);
+
+		e = kdrive_ap_group_write(path->ap, address, value, bits);
+
+		pthread_mutex_lock(&port->mutex);
+		if (e == KDRIVE_ERROR_NONE)
+		{
+			path->errors = 0;
+			++path->sent;
+			pthread_mutex_unlock(&port->mutex);
+			return KDRIVE_ERROR_NONE;
+		}
+
+		++path->errors;
+		path->last_error = now_ms();
+		if (!kdrive_ap_is_open(path->ap))
+		{
+			path->open = 0;
+			pthread_cond_signal(&port->cond);
+		}
+		failover_select(port);
+
+		/* a path which is still usable isn't tried again, the error is returned */
+		pthread_mutex_unlock(&port->mutex);
+	}
+
+	return e;
+}
+
+void failover_select(failover_port_t* port)
+{
+	const int32_t previous = port->active;
+	uint32_t index = 0;
+
+	port->active = -1;
+	for (index = 0; index < port->path_count; ++index)
+	{
+		if (path_is_usable(&port->paths[index]) &&
+		    ((port->active < 0) || (port->paths[index].errors < port->paths[port->active].errors)))
+		{
+			port->active = (int32_t) index;
+		}
+	}
+
+	if ((port->active != previous) && !port->stop)
+	{
+		if (previous >= 0)
+		{
+			++port->failovers;
+		}
+		if (port->active >= 0)
+		{
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Sending on path %d", port->active);
+		}
+		else
+		{
+			kdrive_logger(KDRIVE_LOGGER_WARNING, "No usable path");
+		}
+	}
+}
+
+/*!
+	The closed paths are re-opened with exponential backoff.
+	Opening blocks (i.e. the tunnel connect), so it is done without
+	holding the mutex.
+	The selection runs every FAILOVER_CHECK_INTERVAL ms, so the port
+	switches back to a preferred path after its errors were cleared.
+*/
+void* failover_supervisor(void* arg)
+{
+	failover_port_t* port = (failover_port_t*) arg;
+	failover_path_t* path = 0;
+	struct timespec deadline;
+	uint32_t index = 0;
+	uint32_t now = 0;
+	bool_t reopen = 0;
+
+	pthread_mutex_lock(&port->mutex);
+
+	while (!port->stop)
+	{
+		for (index = 0; (index < port->path_count) && !port->stop; ++index)
+		{
+			path = &port->paths[index];
+			now = now_ms();
+			if (path->open && (path->errors > 0) && ((now - path->last_error) >= FAILOVER_ERROR_HOLD))
+			{
+				path->errors = 0;
+			}
+			reopen = !path->open && ((int32_t)(now - path->next_attempt) >= 0);
+			if (!reopen)
+			{
+				continue;
+			}
+
+			pthread_mutex_unlock(&port->mutex);
+			kdrive_ap_close(path->ap);
+			if (path_open(path) == KDRIVE_ERROR_NONE)
+			{
+				kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Path %u re-opened", index);
+				pthread_mutex_lock(&port->mutex);
+				path->backoff = 0;
+			}
+			else
+			{
+				pthread_mutex_lock(&port->mutex);
+				path->backoff = (path->backoff == 0) ? FAILOVER_BACKOFF_MIN : path->backoff * 2;
+				if (path->backoff > FAILOVER_BACKOFF_MAX)
+				{
+					path->backoff = FAILOVER_BACKOFF_MAX;
+				}
+				path->next_attempt = now_ms() + path->backoff;
+			}
+		}
+
+		failover_select(port);
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += FAILOVER_CHECK_INTERVAL * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L)
+		{
+			++deadline.tv_sec;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&port->cond, &port->mutex, &deadline);
+	}
+
+	pthread_mutex_unlock(&port->mutex);
+
+	return NULL;
+}
+
+error_t path_open(failover_path_t* path)
+{
+	error_t e = KDRIVE_ERROR_NONE;
+
+	switch (path->transport)
+	{
+		case FAILOVER_USB:
+			e = (kdrive_ap_enum_usb(path->ap) > path->usb_index)
+			    ? kdrive_ap_open_usb(path->ap, path->usb_index) : KDRIVE_UNKNOWN_ERROR;
+			break;
+
+		case FAILOVER_IP:
+			e = kdrive_ap_open_ip(path->ap, path->address);
+			break;
+
+		case FAILOVER_FT12:
+			e = kdrive_ap_open_serial_ft12(path->ap, path->address);
+			break;
+
+		default:
+			e = KDRIVE_UNKNOWN_ERROR;
+			break;
+	}
+
+	pthread_mutex_lock(&path->port->mutex);
+	path->open = (e == KDRIVE_ERROR_NONE) ? 1 : 0;
+	if (path->open)
+	{
+		path->errors = 0;
+		path->bus_connected = 1;
+	}
+	pthread_mutex_unlock(&path->port->mutex);
+
+	return e;
+}
+
+bool_t path_is_usable(const failover_path_t* path)
+{
+	return path->open && path->bus_connected && (path->errors < FAILOVER_MAX_ERRORS);
+}
+
+uint32_t path_index(const failover_path_t* path)
+{
+	return (uint32_t)(path - path->port->paths);
+}
+
+/*!
+	The frames are compared without the additional info, the repeat
+	flag and the hop count: a telegram received by two interfaces can
+	differ in these fields (i.e. a KNXnet/IP interface behind a coupler).
+	The same telegram twice on the same path is a new telegram.
+*/
+bool_t dedup_is_duplicate(failover_port_t* port, uint32_t path, const uint8_t telegram[], uint32_t telegram_len)
+{
+	uint8_t frame[MAX_TELEGRAM_LEN];
+	uint32_t frame_len = 0;
+	uint32_t offset = 0;
+	uint32_t index = 0;
+	dedup_entry_t* entry = 0;
+	const uint32_t now = now_ms();
+
+	if ((telegram_len < 2) || (telegram_len < 2u + telegram[1] + 2u))
+	{
+		return 0;
+	}
+
+	offset = 2u + telegram[1];
+	frame_len = telegram_len - offset;
+	if (frame_len > MAX_TELEGRAM_LEN)
+	{
+		return 0;
+	}
+	memcpy(frame, &telegram[offset], frame_len);
+	frame[0] &= (uint8_t) ~0x20; /* repeat flag */
+	frame[1] &= (uint8_t) ~0x70; /* hop count */
+
+	for (index = 0; index < FAILOVER_DEDUP_SIZE; ++index)
+	{
+		entry = &port->recent[index];
+		if ((entry->frame_len == frame_len) && !(entry->paths & (1u << path)) &&
+		    ((now - entry->received) <= FAILOVER_DEDUP_WINDOW) &&
+		    (memcmp(entry->frame, frame, frame_len) == 0))
+		{
+			entry->paths |= 1u << path;
+			return 1;
+		}
+	}
+
+	entry = &port->recent[port->recent_next];
+	port->recent_next = (port->recent_next + 1) % FAILOVER_DEDUP_SIZE;
+	memcpy(entry->frame, frame, frame_len);
+	entry->frame_len = frame_len;
+	entry->received = now;
+	entry->paths = 1u << path;
+
+	return 0;
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
+}
+
+/*!
+	The access port must not be opened in the context of the
+	notification thread, a terminated path is re-opened by the
+	supervisor thread
+*/
+void path_event_callback(int32_t ap, uint32_t e, void* user_data)
+{
+	failover_path_t* path = (failover_path_t*) user_data;
+	failover_port_t* port = path->port;
+
+	pthread_mutex_lock(&port->mutex);
+
+	switch (e)
+	{
+		case KDRIVE_EVENT_TERMINATED:
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Path %u terminated", path_index(path));
+			path->open = 0;
+			path->next_attempt = now_ms();
+			pthread_cond_signal(&port->cond);
+			break;
+
+		case KDRIVE_EVENT_KNX_BUS_DISCONNECTED:
+			path->bus_connected = 0;
+			break;
+
+		case KDRIVE_EVENT_KNX_BUS_CONNECTED:
+			path->bus_connected = 1;
+			break;
+
+		case KDRIVE_EVENT_TELEGRAM_CONFIRM:
+			path->errors = 0;
+			break;
+
+		case KDRIVE_EVENT_TELEGRAM_CONFIRM_TIMEOUT:
+			++path->errors;
+			path->last_error = now_ms();
+			break;
+
+		default:
+			break;
+	}
+
+	failover_select(port);
+	pthread_mutex_unlock(&port->mutex);
+}
+
+/*!
+	The application callback is called without holding the mutex,
+	so it may send on the failover port
+*/
+void path_telegram_callback(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	failover_path_t* path = (failover_path_t*) user_data;
+	failover_port_t* port = path->port;
+	uint8_t message_code = 0;
+	bool_t duplicate = 0;
+
+	if ((kdrive_ap_get_message_code(telegram, telegram_len, &message_code) == KDRIVE_ERROR_NONE) &&
+	    (message_code == KDRIVE_CEMI_L_DATA_IND))
+	{
+		pthread_mutex_lock(&port->mutex);
+		++path->received;
+		duplicate = dedup_is_duplicate(port, path_index(path), telegram, telegram_len);
+		if (duplicate)
+		{
+			++port->duplicates;
+		}
+		pthread_mutex_unlock(&port->mutex);
+	}
+
+	if (!duplicate && port->callback)
+	{
+		port->callback(telegram, telegram_len, port->user_data);
+	}
+}
+
+/*!
+	When a telegram is received we check to see if it is a group value write
+	telegram and if so, we print out the datapoint value
+*/
+void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	static uint8_t data[KDRIVE_MAX_GROUP_VALUE_LEN];
+	uint32_t data_len = KDRIVE_MAX_GROUP_VALUE_LEN;
+	uint16_t address = 0;
+
+	if (kdrive_ap_is_group_write(telegram, telegram_len) &&
+	    (kdrive_ap_get_dest(telegram, telegram_len, &address) == KDRIVE_ERROR_NONE) &&
+	    (kdrive_ap_get_group_data(telegram, telegram_len, data, &data_len) == KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "A_GroupValue_Write: 0x%04x ", address);
+		kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "A_GroupValue_Write Data :", data, data_len);
+	}
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
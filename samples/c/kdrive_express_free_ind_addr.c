@@ -0,0 +1,539 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Finds free individual addresses on a line.
+
+	kdrive_is_ind_addr_free checks one address and blocks until the
+	answer (or the timeout for a free address). The allocator in this
+	sample checks several addresses at the same time, on worker threads
+	with their own service port, and stops as soon as enough free
+	addresses are found.
+
+	The results are kept in an occupancy bitmap per line (known and
+	used bits for the 256 device addresses). Addresses known to be free
+	are handed out without any bus traffic. An address which was handed
+	out is reserved and not handed out again. A background thread
+	refreshes the lines which were used, one address at a time with a
+	gap of ALLOC_REFRESH_GAP ms, so the bitmap follows devices which
+	were added or removed. The refresh pauses while a search runs, so
+	the search has the line to itself.
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_free_ind_addr kdrive_express_free_ind_addr.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define ALLOC_MAX_WORKERS		(8)		/*!< max number of concurrent checks */
+#define ALLOC_LINES				(256)	/*!< number of lines (area and line of the individual address) */
+#define ALLOC_BITMAP_WORDS		(8)		/*!< 256 device addresses per line */
+#define ALLOC_REFRESH_GAP		(200)	/*!< time in ms between two checks of the background refresh */
+#define ALLOC_REFRESH_PERIOD	(60000)	/*!< time in ms after which a line is refreshed again */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	The occupancy of the device addresses of a line
+*/
+typedef struct line_occupancy_t
+{
+	uint32_t known[ALLOC_BITMAP_WORDS]; /*!< 1 if the state of the address was checked */
+	uint32_t used[ALLOC_BITMAP_WORDS]; /*!< 1 if a device uses the address */
+	uint32_t reserved[ALLOC_BITMAP_WORDS]; /*!< 1 if the address was handed out */
+	bool_t active; /*!< 1 if the line is refreshed in the background */
+	uint32_t refreshed; /*!< time in ms of the last complete refresh */
+
+} line_occupancy_t;
+
+/*!
+	The allocator with its bitmaps
+*/
+typedef struct ind_addr_allocator_t
+{
+	pthread_mutex_t mutex; /*!< protects the bitmaps */
+	line_occupancy_t lines[ALLOC_LINES];
+	int32_t ap; /*!< the access port used for the service ports */
+	uint32_t worker_count; /*!< number of concurrent checks */
+	pthread_t refresh_thread;
+	pthread_cond_t refresh_cond; /*!< wakes the refresh thread on stop and when the last search ended */
+	pthread_cond_t search_cond; /*!< wakes a search when the check of the refresh ended */
+	bool_t refresh_running;
+	bool_t refreshing; /*!< 1 while the refresh thread checks an address */
+	uint32_t searching; /*!< number of running searches */
+	bool_t stop;
+
+} ind_addr_allocator_t;
+
+/*!
+	A search for free addresses on one line
+*/
+typedef struct free_search_t
+{
+	ind_addr_allocator_t* allocator;
+	uint8_t line;
+	uint32_t needed; /*!< number of free addresses still needed */
+	uint32_t next; /*!< the next device address to check */
+	uint16_t* out;
+	uint32_t out_len;
+	uint32_t checks; /*!< number of kdrive_is_ind_addr_free calls */
+
+} free_search_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Initializes the allocator and starts the background refresh
+*/
+static void alloc_init(ind_addr_allocator_t* allocator, int32_t ap, uint32_t worker_count);
+
+/*!
+	Stops the background refresh
+*/
+static void alloc_close(ind_addr_allocator_t* allocator);
+
+/*!
+	Finds count free individual addresses on line (i.e. 0x1100 for 1.1.x).
+	The addresses are reserved and written to out, out_len is the number found.
+	Returns the number of addresses checked on the bus.
+*/
+static uint32_t find_free_ind_addrs(ind_addr_allocator_t* allocator, uint16_t line, uint32_t count,
+                                    uint16_t out[], uint32_t* out_len);
+
+/*!
+	Releases a reserved address, i.e. when the programming failed
+*/
+static void alloc_release(ind_addr_allocator_t* allocator, uint16_t ind_addr);
+
+/*!
+	Takes the free, unreserved addresses of the search line from the bitmap.
+	Called with the mutex locked.
+*/
+static void alloc_take_known(free_search_t* search);
+
+/*!
+	The worker thread of a search
+*/
+static void* search_worker(void* arg);
+
+/*!
+	The background refresh thread
+*/
+static void* refresh_worker(void* arg);
+
+/*!
+	Stores the result of a check in the bitmap.
+	Called with the mutex locked.
+*/
+static void alloc_set(line_occupancy_t* line, uint8_t device, bool_t is_free);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static ind_addr_allocator_t allocator;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+	uint16_t addresses[8];
+	uint32_t count = 0;
+	uint32_t checks = 0;
+	uint32_t index = 0;
+	uint32_t round = 0;
+	uint32_t start = 0;
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	ap = kdrive_ap_create();
+	if ((ap == KDRIVE_INVALID_DESCRIPTOR) ||
+	    (kdrive_ap_enum_usb(ap) == 0) ||
+	    (kdrive_ap_open_usb(ap, 0) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the access port");
+		kdrive_ap_release(ap);
+		return -1;
+	}
+
+	alloc_init(&allocator, ap, 4);
+
+	/*
+		The first search checks addresses on the bus,
+		the second is (mostly) answered from the bitmap
+	*/
+	for (round = 0; round < 2; ++round)
+	{
+		start = now_ms();
+		checks = find_free_ind_addrs(&allocator, 0x1100, 4, addresses, &count);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Found %u free address(es) with %u check(s) in %u ms",
+		                 count, checks, now_ms() - start);
+
+		for (index = 0; index < count; ++index)
+		{
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "  %u.%u.%u", (addresses[index] >> 12) & 0x0F,
+			                 (addresses[index] >> 8) & 0x0F, addresses[index] & 0xFF);
+		}
+
+		/* the first address was not used, hand it out again */
+		if (count > 0)
+		{
+			alloc_release(&allocator, addresses[0]);
+		}
+	}
+
+	alloc_close(&allocator);
+
+	kdrive_ap_close(ap);
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+void alloc_init(ind_addr_allocator_t* allocator, int32_t ap, uint32_t worker_count)
+{
+	memset(allocator, 0, sizeof(ind_addr_allocator_t));
+	allocator->ap = ap;
+	allocator->worker_count = ((worker_count > 0) && (worker_count <= ALLOC_MAX_WORKERS)) ? worker_count : ALLOC_MAX_WORKERS;
+	pthread_mutex_init(&allocator->mutex, NULL);
+	pthread_cond_init(&allocator->refresh_cond, NULL);
+	pthread_cond_init(&allocator->search_cond, NULL);
+
+	allocator->refresh_running = (pthread_create(&allocator->refresh_thread, NULL, &refresh_worker, allocator) == 0);
+}
+
+void alloc_close(ind_addr_allocator_t* allocator)
+{
+	pthread_mutex_lock(&allocator->mutex);
+	allocator->stop = 1;
+	pthread_cond_signal(&allocator->refresh_cond);
+	pthread_mutex_unlock(&allocator->mutex);
+
+	if (allocator->refresh_running)
+	{
+		pthread_join(allocator->refresh_thread, NULL);
+		allocator->refresh_running = 0;
+	}
+
+	pthread_cond_destroy(&allocator->search_cond);
+	pthread_cond_destroy(&allocator->refresh_cond);
+	pthread_mutex_destroy(&allocator->mutex);
+}
+
+/*!
+	Device address 0 is reserved for the line coupler and never handed out.
+	The search waits for a running check of the background refresh and
+	keeps the refresh paused until it is done.
+*/
+uint32_t find_free_ind_addrs(ind_addr_allocator_t* allocator, uint16_t line, uint32_t count,
+                             uint16_t out[], uint32_t* out_len)
+{
+	free_search_t search;
+	pthread_t threads[ALLOC_MAX_WORKERS];
+	uint32_t started = 0;
+	uint32_t index = 0;
+
+	memset(&search, 0, sizeof(free_search_t));
+	search.allocator = allocator;
+	search.line = (uint8_t)(line >> 8);
+	search.needed = count;
+	search.next = 1;
+	search.out = out;
+
+	pthread_mutex_lock(&allocator->mutex);
+	while (allocator->refreshing)
+	{
+		pthread_cond_wait(&allocator->search_cond, &allocator->mutex);
+	}
+	++allocator->searching;
+	allocator->lines[search.line].active = 1;
+	alloc_take_known(&search);
+	pthread_mutex_unlock(&allocator->mutex);
+
+	if (search.needed > 0)
+	{
+		for (index = 0; index < allocator->worker_count; ++index)
+		{
+			if (pthread_create(&threads[started], NULL, &search_worker, &search) == 0)
+			{
+				++started;
+			}
+		}
+		for (index = 0; index < started; ++index)
+		{
+			pthread_join(threads[index], NULL);
+		}
+	}
+
+	pthread_mutex_lock(&allocator->mutex);
+	if (--allocator->searching == 0)
+	{
+		pthread_cond_signal(&allocator->refresh_cond);
+	}
+	pthread_mutex_unlock(&allocator->mutex);
+
+	*out_len = search.out_len;
+
+	return search.checks;
+}
+
+void alloc_release(ind_addr_allocator_t* allocator, uint16_t ind_addr)
+{
+	uint8_t device = (uint8_t) ind_addr;
+
+	pthread_mutex_lock(&allocator->mutex);
+	allocator->lines[ind_addr >> 8].reserved[device / 32] &= ~(1u << (device % 32));
+	pthread_mutex_unlock(&allocator->mutex);
+}
+
+void alloc_take_known(free_search_t* search)
+{
+	line_occupancy_t* line = &search->allocator->lines[search->line];
+	uint32_t device = 0;
+	uint32_t mask = 0;
+
+	for (device = 1; (device < 256) && (search->needed > 0); ++device)
+	{
+		mask = 1u << (device % 32);
+		if ((line->known[device / 32] & mask) && !(line->used[device / 32] & mask) &&
+		    !(line->reserved[device / 32] & mask))
+		{
+			line->reserved[device / 32] |= mask;
+			search->out[search->out_len++] = (uint16_t)((search->line << 8) | device);
+			--search->needed;
+		}
+	}
+}
+
+/*!
+	The workers take the addresses which are not known yet in order.
+	A free address found after the search is complete is stored in the
+	bitmap only, it is handed out by a later search.
+*/
+void* search_worker(void* arg)
+{
+	free_search_t* search = (free_search_t*) arg;
+	ind_addr_allocator_t* allocator = search->allocator;
+	line_occupancy_t* line = &allocator->lines[search->line];
+	int32_t sp = kdrive_sp_create(allocator->ap);
+	uint32_t device = 0;
+	uint32_t mask = 0;
+	bool_t is_free = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	if (sp == KDRIVE_INVALID_DESCRIPTOR)
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&allocator->mutex);
+
+	while ((search->needed > 0) && (search->next < 256))
+	{
+		device = search->next++;
+		mask = 1u << (device % 32);
+		if ((line->known[device / 32] & mask) || (line->reserved[device / 32] & mask))
+		{
+			continue;
+		}
+
+		++search->checks;
+		pthread_mutex_unlock(&allocator->mutex);
+
+		e = kdrive_is_ind_addr_free(sp, (uint16_t)((search->line << 8) | device), &is_free);
+
+		pthread_mutex_lock(&allocator->mutex);
+
+		if (e == KDRIVE_ERROR_NONE)
+		{
+			alloc_set(line, (uint8_t) device, is_free);
+			if (is_free && (search->needed > 0))
+			{
+				line->reserved[device / 32] |= mask;
+				search->out[search->out_len++] = (uint16_t)((search->line << 8) | device);
+				--search->needed;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&allocator->mutex);
+
+	kdrive_sp_release(sp);
+
+	return NULL;
+}
+
+/*!
+	Each pass checks every address of the active lines which weren't
+	refreshed within ALLOC_REFRESH_PERIOD. Reserved addresses are
+	checked too, so a programmed device shows up as used.
+	No address is checked while a search runs. A line counts as
+	refreshed only when all its addresses were checked.
+*/
+void* refresh_worker(void* arg)
+{
+	ind_addr_allocator_t* allocator = (ind_addr_allocator_t*) arg;
+	struct timespec deadline;
+	int32_t sp = kdrive_sp_create(allocator->ap);
+	uint32_t line = 0;
+	uint32_t device = 0;
+	bool_t is_free = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	if (sp == KDRIVE_INVALID_DESCRIPTOR)
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&allocator->mutex);
+
+	while (!allocator->stop)
+	{
+		for (line = 0; (line < ALLOC_LINES) && !allocator->stop; ++line)
+		{
+			if (!allocator->lines[line].active ||
+			    ((allocator->lines[line].refreshed != 0) &&
+			     ((now_ms() - allocator->lines[line].refreshed) < ALLOC_REFRESH_PERIOD)))
+			{
+				continue;
+			}
+
+			for (device = 1; (device < 256) && !allocator->stop; ++device)
+			{
+				while (!allocator->stop && (allocator->searching > 0))
+				{
+					pthread_cond_wait(&allocator->refresh_cond, &allocator->mutex);
+				}
+				if (allocator->stop)
+				{
+					break;
+				}
+
+				allocator->refreshing = 1;
+				pthread_mutex_unlock(&allocator->mutex);
+				e = kdrive_is_ind_addr_free(sp, (uint16_t)((line << 8) | device), &is_free);
+				pthread_mutex_lock(&allocator->mutex);
+				allocator->refreshing = 0;
+				pthread_cond_broadcast(&allocator->search_cond);
+
+				if (e == KDRIVE_ERROR_NONE)
+				{
+					alloc_set(&allocator->lines[line], (uint8_t) device, is_free);
+				}
+
+				/* limit the bus load, wake up early on stop */
+				clock_gettime(CLOCK_REALTIME, &deadline);
+				deadline.tv_nsec += ALLOC_REFRESH_GAP * 1000000L;
+				deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+				deadline.tv_nsec %= 1000000000L;
+				while (!allocator->stop &&
+				       (pthread_cond_timedwait(&allocator->refresh_cond, &allocator->mutex, &deadline) == 0))
+				{
+					;
+				}
+			}
+
+			if (device == 256)
+			{
+				allocator->lines[line].refreshed = now_ms() | 1;
+			}
+		}
+
+		if (!allocator->stop)
+		{
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += 1;
+			pthread_cond_timedwait(&allocator->refresh_cond, &allocator->mutex, &deadline);
+		}
+	}
+
+	pthread_mutex_unlock(&allocator->mutex);
+
+	kdrive_sp_release(sp);
+
+	return NULL;
+}
+
+void alloc_set(line_occupancy_t* line, uint8_t device, bool_t is_free)
+{
+	uint32_t mask = 1u << (device % 32);
+
+	line->known[device / 32] |= mask;
+	if (is_free)
+	{
+		line->used[device / 32] &= ~mask;
+	}
+	else
+	{
+		line->used[device / 32] |= mask;
+	}
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000u) + ((uint32_t) ts.tv_nsec / 1000000u);
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
@@ -0,0 +1,852 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Asynchronous KNXnet/IP Tunneling Discovery
+
+	kdrive_ap_enum_ip_tunn blocks for the whole search time and returns
+	all devices at the end. This sample implements the search with plain
+	UDP sockets instead:
+	- a SEARCH_REQUEST is sent on all IPv4 multicast interfaces at once
+	- discovery_start returns immediately, the SEARCH_RESPONSEs are decoded
+	  into ip_tunn_dev_t and passed to a callback as they arrive
+	- the callback returns 0 to stop the search (i.e. when the wanted
+	  device was found), discovery_cancel stops it from another thread
+	- a device which answers on several interfaces is reported once,
+	  on the interface which answered first
+	- the found devices are kept in a cache with a time to live, so a
+	  recently seen device is available without a new search
+
+	Only devices which support KNXnet/IP Tunneling are reported.
+
+	Start the sample with the argument "loopback" to run a simulated
+	KNXnet/IP server with three devices on the loopback interface (127.0.0.1).
+
+	This sample uses POSIX sockets and threads, i.e.
+	gcc -I../../include -o kdrive_express_ip_discovery kdrive_express_ip_discovery.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <poll.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN				(128)		/*!< kdriveExpress Error Messages */
+#define DISCOVERY_MULTICAST_GROUP		("224.0.23.12")	/*!< the KNXnet/IP system setup multicast address */
+#define DISCOVERY_PORT					(3671)		/*!< the KNXnet/IP port */
+#define DISCOVERY_TTL					(16)		/*!< multicast time to live */
+#define DISCOVERY_MAX_IFACES			(16)		/*!< max number of interfaces searched in parallel */
+#define DISCOVERY_MAX_DEVICES			(64)		/*!< max number of devices reported by one search */
+#define DISCOVERY_POLL_INTERVAL			(100)		/*!< the search thread checks the stop flag every 100 ms */
+#define DISCOVERY_DEFAULT_TIMEOUT		(3000)		/*!< search time in ms */
+#define DISCOVERY_CACHE_SIZE			(64)		/*!< max number of cached devices */
+#define DISCOVERY_CACHE_TTL				(60000)		/*!< time to live of a cached device, in ms */
+
+#define KNXNETIP_HEADER_LEN				(6)			/*!< KNXnet/IP header length */
+#define KNXNETIP_VERSION_10				(0x10)		/*!< KNXnet/IP protocol version 1.0 */
+#define KNXNETIP_SEARCH_REQUEST			(0x0201)	/*!< SEARCH_REQUEST service type */
+#define KNXNETIP_SEARCH_RESPONSE		(0x0202)	/*!< SEARCH_RESPONSE service type */
+#define KNXNETIP_HPAI_LEN				(8)			/*!< host protocol address information length */
+#define KNXNETIP_IPV4_UDP				(0x01)		/*!< HPAI host protocol code */
+#define KNXNETIP_DIB_DEVICE_INFO		(0x01)		/*!< device information DIB type */
+#define KNXNETIP_DIB_DEVICE_INFO_LEN	(54)		/*!< device information DIB length */
+#define KNXNETIP_DIB_SUPP_SVC_FAMILIES	(0x02)		/*!< supported service families DIB type */
+#define KNXNETIP_FAMILY_TUNNELING		(0x04)		/*!< KNXnet/IP Tunneling service family */
+#define KNXNETIP_DEVICE_NAME_LEN		(30)		/*!< device friendly name length in the device information DIB */
+
+#define LOOPBACK_DEVICES				(3)			/*!< number of simulated devices in loopback mode */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	Called for each found device, in the context of the search thread.
+	Return 0 to stop the search.
+*/
+typedef bool_t (*discovery_callback)(const ip_tunn_dev_t* item, void* user_data);
+
+/*!
+	A cached device
+*/
+typedef struct discovery_cache_item_t
+{
+	ip_tunn_dev_t device;
+	uint32_t seen; /*!< time the device was last seen (ms) */
+
+} discovery_cache_item_t;
+
+/*!
+	The recently seen devices.
+	An item is identified by its serial number and ip address
+*/
+typedef struct discovery_cache_t
+{
+	pthread_mutex_t mutex;
+	discovery_cache_item_t items[DISCOVERY_CACHE_SIZE];
+	uint32_t count;
+	uint32_t ttl; /*!< time to live in ms */
+
+} discovery_cache_t;
+
+/*!
+	A running search
+*/
+typedef struct discovery_t
+{
+	int sockets[DISCOVERY_MAX_IFACES]; /*!< one socket per interface, the responses are sent to its address */
+	char ifaces[DISCOVERY_MAX_IFACES][KDRIVE_MAX_IP_ADDRESS_LEN]; /*!< the interface addresses */
+	uint32_t iface_count;
+	uint16_t port; /*!< the KNXnet/IP port of the servers */
+
+	discovery_callback callback;
+	void* user_data;
+	discovery_cache_t* cache; /*!< updated with the found devices, may be 0 */
+	uint32_t timeout; /*!< search time in ms */
+
+	ip_tunn_dev_t found[DISCOVERY_MAX_DEVICES]; /*!< the devices reported by this search */
+	uint32_t found_count;
+
+	pthread_t thread; /*!< the search thread */
+	bool_t stop;
+	bool_t running; /*!< 1 when the search thread was started */
+
+} discovery_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Starts a search on all IPv4 multicast interfaces and returns.
+	\param iface_address search only on this interface or 0 for all interfaces
+	\param timeout the search time in ms
+	\param cache the found devices are added to the cache, may be 0
+	\param c the callback, called in the context of the search thread
+*/
+static error_t discovery_start(discovery_t* discovery, const char* iface_address, uint32_t timeout,
+                               discovery_cache_t* cache, discovery_callback c, void* user_data);
+
+/*!
+	Waits until the search is finished, i.e. the search time elapsed or
+	the callback returned 0
+*/
+static void discovery_wait(discovery_t* discovery);
+
+/*!
+	Stops the search and closes the sockets.
+	The callback is not called after discovery_cancel returned
+*/
+static void discovery_cancel(discovery_t* discovery);
+
+/*!
+	Opens a socket on the interface and sends the SEARCH_REQUEST
+*/
+static error_t discovery_search_on(discovery_t* discovery, struct in_addr iface);
+
+/*!
+	The search thread
+*/
+static void* discovery_receiver(void* arg);
+
+/*!
+	Decodes a SEARCH_RESPONSE.
+	Returns 0 if the frame is invalid or the device doesn't support Tunneling
+*/
+static bool_t discovery_decode(const uint8_t frame[], uint32_t frame_len, const struct sockaddr_in* from,
+                               const char* iface_address, ip_tunn_dev_t* device);
+
+/*!
+	Initializes the cache
+	\param ttl the time to live of an item in ms
+*/
+static void discovery_cache_init(discovery_cache_t* cache, uint32_t ttl);
+
+/*!
+	Adds or refreshes a device
+*/
+static void discovery_cache_update(discovery_cache_t* cache, const ip_tunn_dev_t* device);
+
+/*!
+	Removes the expired devices and copies the remaining ones to items.
+	\param [in,out] items_length the items array capacity (in) and the number of devices (out)
+*/
+static void discovery_cache_get(discovery_cache_t* cache, ip_tunn_dev_t items[], uint32_t* items_length);
+
+/*!
+	Returns 1 if both are the same device on the same ip address
+*/
+static bool_t is_same_device(const ip_tunn_dev_t* a, const ip_tunn_dev_t* b);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Runs the search against simulated devices on the loopback interface
+*/
+static void run_loopback(void);
+
+/*!
+	A simulated KNXnet/IP server, answers each SEARCH_REQUEST for LOOPBACK_DEVICES devices
+*/
+static void* loopback_server(void* arg);
+
+/*!
+	Prints a found device
+*/
+static bool_t on_device(const ip_tunn_dev_t* item, void* user_data);
+
+/*!
+	Stops the search when the device with the serial number was found
+*/
+static bool_t on_device_find(const ip_tunn_dev_t* item, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static discovery_cache_t cache_;
+static bool_t loopback_stop_ = 0; /*!< stops the simulated server */
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	discovery_t discovery;
+	ip_tunn_dev_t items[DISCOVERY_CACHE_SIZE];
+	uint32_t items_length = DISCOVERY_CACHE_SIZE;
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	discovery_cache_init(&cache_, DISCOVERY_CACHE_TTL);
+
+	if ((argc > 1) && (strcmp(argv[1], "loopback") == 0))
+	{
+		run_loopback();
+		return 0;
+	}
+
+	/* the devices are printed while the search is running */
+	if (discovery_start(&discovery, 0, DISCOVERY_DEFAULT_TIMEOUT, &cache_, &on_device, NULL) == KDRIVE_ERROR_NONE)
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Searching on %u interface(s) ...", discovery.iface_count);
+		discovery_wait(&discovery);
+		discovery_cancel(&discovery);
+	}
+
+	discovery_cache_get(&cache_, items, &items_length);
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u device(s) in the cache", items_length);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+error_t discovery_start(discovery_t* discovery, const char* iface_address, uint32_t timeout,
+                        discovery_cache_t* cache, discovery_callback c, void* user_data)
+{
+	struct ifaddrs* ifaddr = 0;
+	struct ifaddrs* ifa = 0;
+	struct in_addr iface;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	memset(discovery, 0, sizeof(discovery_t));
+	discovery->port = DISCOVERY_PORT;
+	discovery->callback = c;
+	discovery->user_data = user_data;
+	discovery->cache = cache;
+	discovery->timeout = timeout;
+
+	if (iface_address)
+	{
+		if (inet_pton(AF_INET, iface_address, &iface) != 1)
+		{
+			return KDRIVE_AP_KNX_NET_IP_ERROR;
+		}
+		e = discovery_search_on(discovery, iface);
+	}
+	else
+	{
+		if (getifaddrs(&ifaddr) != 0)
+		{
+			return KDRIVE_SOCKET_ERROR;
+		}
+
+		/* an interface which fails doesn't stop the search on the others */
+		for (ifa = ifaddr; ifa && (discovery->iface_count < DISCOVERY_MAX_IFACES); ifa = ifa->ifa_next)
+		{
+			if (ifa->ifa_addr && (ifa->ifa_addr->sa_family == AF_INET) &&
+			    (ifa->ifa_flags & IFF_UP) && (ifa->ifa_flags & IFF_MULTICAST) && !(ifa->ifa_flags & IFF_LOOPBACK))
+			{
+				e = discovery_search_on(discovery, ((struct sockaddr_in*) ifa->ifa_addr)->sin_addr);
+			}
+		}
+
+		freeifaddrs(ifaddr);
+	}
+
+	if (discovery->iface_count == 0)
+	{
+		discovery_cancel(discovery);
+		return (e != KDRIVE_ERROR_NONE) ? e : KDRIVE_SOCKET_ERROR;
+	}
+
+	if (pthread_create(&discovery->thread, NULL, &discovery_receiver, discovery) != 0)
+	{
+		discovery_cancel(discovery);
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+	discovery->running = 1;
+
+	return KDRIVE_ERROR_NONE;
+}
+
+void discovery_wait(discovery_t* discovery)
+{
+	if (discovery->running)
+	{
+		pthread_join(discovery->thread, NULL);
+		discovery->running = 0;
+	}
+}
+
+void discovery_cancel(discovery_t* discovery)
+{
+	uint32_t index = 0;
+
+	/* the search thread checks the flag at least every DISCOVERY_POLL_INTERVAL ms */
+	discovery->stop = 1;
+	discovery_wait(discovery);
+
+	for (index = 0; index < discovery->iface_count; ++index)
+	{
+		close(discovery->sockets[index]);
+	}
+	discovery->iface_count = 0;
+}
+
+/*!
+	The socket is bound to the interface address with an ephemeral port,
+	its address is sent as discovery endpoint (HPAI) in the SEARCH_REQUEST
+	so the servers send the SEARCH_RESPONSE to this socket.
+*/
+error_t discovery_search_on(discovery_t* discovery, struct in_addr iface)
+{
+	uint8_t frame[KNXNETIP_HEADER_LEN + KNXNETIP_HPAI_LEN];
+	struct sockaddr_in local;
+	struct sockaddr_in group;
+	socklen_t local_len = sizeof(local);
+	unsigned char ttl = DISCOVERY_TTL;
+	const int s = socket(AF_INET, SOCK_DGRAM, 0);
+
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr = iface;
+
+	memset(&group, 0, sizeof(group));
+	group.sin_family = AF_INET;
+	group.sin_port = htons(discovery->port);
+	inet_pton(AF_INET, DISCOVERY_MULTICAST_GROUP, &group.sin_addr);
+
+	if ((s < 0) ||
+	    (bind(s, (struct sockaddr*) &local, sizeof(local)) != 0) ||
+	    (getsockname(s, (struct sockaddr*) &local, &local_len) != 0) ||
+	    (setsockopt(s, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) != 0) ||
+	    (setsockopt(s, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0))
+	{
+		if (s >= 0)
+		{
+			close(s);
+		}
+		return KDRIVE_SOCKET_ERROR;
+	}
+
+	frame[0] = KNXNETIP_HEADER_LEN;
+	frame[1] = KNXNETIP_VERSION_10;
+	frame[2] = (uint8_t)(KNXNETIP_SEARCH_REQUEST >> 8);
+	frame[3] = (uint8_t)(KNXNETIP_SEARCH_REQUEST & 0xFF);
+	frame[4] = 0x00;
+	frame[5] = (uint8_t) sizeof(frame);
+	frame[6] = KNXNETIP_HPAI_LEN;
+	frame[7] = KNXNETIP_IPV4_UDP;
+	memcpy(&frame[8], &local.sin_addr, 4);
+	memcpy(&frame[12], &local.sin_port, 2);
+
+	if (sendto(s, frame, sizeof(frame), 0, (struct sockaddr*) &group, sizeof(group)) != (ssize_t) sizeof(frame))
+	{
+		close(s);
+		return KDRIVE_SOCKET_ERROR;
+	}
+
+	discovery->sockets[discovery->iface_count] = s;
+	inet_ntop(AF_INET, &iface, discovery->ifaces[discovery->iface_count], KDRIVE_MAX_IP_ADDRESS_LEN);
+	++discovery->iface_count;
+
+	return KDRIVE_ERROR_NONE;
+}
+
+/*!
+	Polls the sockets of all interfaces until the search time elapsed,
+	the callback returned 0 or discovery_cancel was called.
+	A device which was already reported by this search is skipped.
+*/
+void* discovery_receiver(void* arg)
+{
+	discovery_t* discovery = (discovery_t*) arg;
+	struct pollfd fds[DISCOVERY_MAX_IFACES];
+	uint8_t frame[512];
+	struct sockaddr_in from;
+	socklen_t from_len = 0;
+	ssize_t received = 0;
+	ip_tunn_dev_t device;
+	const uint32_t start = now_ms();
+	uint32_t elapsed = 0;
+	uint32_t index = 0;
+	uint32_t found = 0;
+	int ready = 0;
+
+	for (index = 0; index < discovery->iface_count; ++index)
+	{
+		fds[index].fd = discovery->sockets[index];
+		fds[index].events = POLLIN;
+	}
+
+	while (!discovery->stop && ((elapsed = now_ms() - start) < discovery->timeout))
+	{
+		ready = poll(fds, discovery->iface_count, (int)((discovery->timeout - elapsed < DISCOVERY_POLL_INTERVAL)
+		             ? discovery->timeout - elapsed : DISCOVERY_POLL_INTERVAL));
+		if (ready < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+
+		for (index = 0; (ready > 0) && !discovery->stop && (index < discovery->iface_count); ++index)
+		{
+			if (!(fds[index].revents & POLLIN))
+			{
+				continue;
+			}
+
+			from_len = sizeof(from);
+			received = recvfrom(fds[index].fd, frame, sizeof(frame), 0, (struct sockaddr*) &from, &from_len);
+			if ((received <= 0) ||
+			    !discovery_decode(frame, (uint32_t) received, &from, discovery->ifaces[index], &device))
+			{
+				continue;
+			}
+
+			for (found = 0; found < discovery->found_count; ++found)
+			{
+				if (is_same_device(&discovery->found[found], &device))
+				{
+					break;
+				}
+			}
+			if ((found < discovery->found_count) || (discovery->found_count == DISCOVERY_MAX_DEVICES))
+			{
+				continue;
+			}
+			discovery->found[discovery->found_count++] = device;
+
+			if (discovery->cache)
+			{
+				discovery_cache_update(discovery->cache, &device);
+			}
+
+			if (discovery->callback && !discovery->callback(&device, discovery->user_data))
+			{
+				discovery->stop = 1;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+	SEARCH_RESPONSE: header, control endpoint (HPAI), device information DIB,
+	supported service families DIB.
+	The ip address is taken from the control endpoint, or from the sender
+	if the server sent 0.0.0.0 (i.e. behind a NAT router).
+*/
+bool_t discovery_decode(const uint8_t frame[], uint32_t frame_len, const struct sockaddr_in* from,
+                        const char* iface_address, ip_tunn_dev_t* device)
+{
+	const uint8_t* hpai = &frame[KNXNETIP_HEADER_LEN];
+	const uint8_t* dib = &hpai[KNXNETIP_HPAI_LEN];
+	const uint8_t* families = &dib[KNXNETIP_DIB_DEVICE_INFO_LEN];
+	struct in_addr ip_address;
+	uint32_t total_len = 0;
+	uint32_t index = 0;
+	bool_t tunneling = 0;
+
+	if ((frame_len < KNXNETIP_HEADER_LEN + KNXNETIP_HPAI_LEN + KNXNETIP_DIB_DEVICE_INFO_LEN + 2) ||
+	    (frame[0] != KNXNETIP_HEADER_LEN) || (frame[1] != KNXNETIP_VERSION_10) ||
+	    (((frame[2] << 8) | frame[3]) != KNXNETIP_SEARCH_RESPONSE))
+	{
+		return 0;
+	}
+
+	total_len = (uint32_t)((frame[4] << 8) | frame[5]);
+	if ((total_len > frame_len) ||
+	    (total_len < KNXNETIP_HEADER_LEN + KNXNETIP_HPAI_LEN + KNXNETIP_DIB_DEVICE_INFO_LEN + 2) ||
+	    (hpai[0] != KNXNETIP_HPAI_LEN) || (hpai[1] != KNXNETIP_IPV4_UDP) ||
+	    (dib[0] != KNXNETIP_DIB_DEVICE_INFO_LEN) || (dib[1] != KNXNETIP_DIB_DEVICE_INFO))
+	{
+		return 0;
+	}
+
+	/* the families are (family, version) pairs */
+	if ((families[1] != KNXNETIP_DIB_SUPP_SVC_FAMILIES) ||
+	    (families + families[0] > frame + total_len))
+	{
+		return 0;
+	}
+	for (index = 2; index + 1 < families[0]; index += 2)
+	{
+		if (families[index] == KNXNETIP_FAMILY_TUNNELING)
+		{
+			tunneling = 1;
+		}
+	}
+	if (!tunneling)
+	{
+		return 0;
+	}
+
+	memset(device, 0, sizeof(ip_tunn_dev_t));
+
+	memcpy(&ip_address, &hpai[2], 4);
+	if (ip_address.s_addr == htonl(INADDR_ANY))
+	{
+		ip_address = from->sin_addr;
+	}
+	inet_ntop(AF_INET, &ip_address, device->ip_address, KDRIVE_MAX_IP_ADDRESS_LEN);
+	strncpy(device->iface_address, iface_address, KDRIVE_MAX_IP_ADDRESS_LEN - 1);
+
+	/* device information DIB: length, type, medium, status, address, project id, serial, multicast, mac, name */
+	device->prog_mode_enabled = (dib[3] & 0x01) ? 1 : 0;
+	device->ind_addr = (uint16_t)((dib[4] << 8) | dib[5]);
+	memcpy(device->serial_number, &dib[8], KDRIVE_SN_LEN);
+	memcpy(device->mac_address, &dib[18], KDRIVE_MAC_LEN);
+	memcpy(device->dev_name, &dib[24], KNXNETIP_DEVICE_NAME_LEN);
+	device->dev_name[KNXNETIP_DEVICE_NAME_LEN] = 0;
+
+	return 1;
+}
+
+void discovery_cache_init(discovery_cache_t* cache, uint32_t ttl)
+{
+	memset(cache, 0, sizeof(discovery_cache_t));
+	pthread_mutex_init(&cache->mutex, NULL);
+	cache->ttl = ttl;
+}
+
+/*!
+	When the cache is full the oldest item is replaced
+*/
+void discovery_cache_update(discovery_cache_t* cache, const ip_tunn_dev_t* device)
+{
+	const uint32_t now = now_ms();
+	uint32_t oldest = 0;
+	uint32_t index = 0;
+
+	pthread_mutex_lock(&cache->mutex);
+
+	for (index = 0; index < cache->count; ++index)
+	{
+		if (is_same_device(&cache->items[index].device, device))
+		{
+			break;
+		}
+		if ((now - cache->items[index].seen) > (now - cache->items[oldest].seen))
+		{
+			oldest = index;
+		}
+	}
+
+	if ((index == cache->count) && (cache->count == DISCOVERY_CACHE_SIZE))
+	{
+		index = oldest;
+	}
+	else if (index == cache->count)
+	{
+		++cache->count;
+	}
+
+	cache->items[index].device = *device;
+	cache->items[index].seen = now;
+
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+void discovery_cache_get(discovery_cache_t* cache, ip_tunn_dev_t items[], uint32_t* items_length)
+{
+	const uint32_t now = now_ms();
+	uint32_t count = 0;
+	uint32_t index = 0;
+
+	pthread_mutex_lock(&cache->mutex);
+
+	while (index < cache->count)
+	{
+		if ((now - cache->items[index].seen) > cache->ttl)
+		{
+			cache->items[index] = cache->items[--cache->count];
+			continue;
+		}
+		if (count < *items_length)
+		{
+			items[count++] = cache->items[index].device;
+		}
+		++index;
+	}
+
+	pthread_mutex_unlock(&cache->mutex);
+
+	*items_length = count;
+}
+
+bool_t is_same_device(const ip_tunn_dev_t* a, const ip_tunn_dev_t* b)
+{
+	return (memcmp(a->serial_number, b->serial_number, KDRIVE_SN_LEN) == 0) &&
+	       (strcmp(a->ip_address, b->ip_address) == 0);
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
+}
+
+/*!
+	Three searches on 127.0.0.1:
+	- a complete search, the devices are printed as they arrive
+	- a search which stops when the second device was found
+	- the cache, which holds the devices of both searches
+*/
+void run_loopback(void)
+{
+	discovery_t discovery;
+	ip_tunn_dev_t items[DISCOVERY_CACHE_SIZE];
+	uint32_t items_length = DISCOVERY_CACHE_SIZE;
+	uint8_t serial_number[KDRIVE_SN_LEN] = { 0x00, 0xC5, 0x01, 0x00, 0x00, 0x01 };
+	pthread_t server;
+	int server_socket = -1;
+	struct sockaddr_in local;
+	struct ip_mreq mreq;
+	struct timeval timeout;
+	int reuse = 1;
+	uint32_t start = 0;
+	uint32_t index = 0;
+
+	server_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(DISCOVERY_PORT);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	inet_pton(AF_INET, DISCOVERY_MULTICAST_GROUP, &mreq.imr_multiaddr);
+	inet_pton(AF_INET, "127.0.0.1", &mreq.imr_interface);
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 200000;
+
+	if ((server_socket < 0) ||
+	    (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0) ||
+	    (bind(server_socket, (struct sockaddr*) &local, sizeof(local)) != 0) ||
+	    (setsockopt(server_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) ||
+	    (setsockopt(server_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) ||
+	    (pthread_create(&server, NULL, &loopback_server, &server_socket) != 0))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to start the simulated server");
+		if (server_socket >= 0)
+		{
+			close(server_socket);
+		}
+		return;
+	}
+
+	for (index = 0; index < 2; ++index)
+	{
+		start = now_ms();
+		if (discovery_start(&discovery, "127.0.0.1", 1000, &cache_,
+		                    index ? &on_device_find : &on_device, serial_number) == KDRIVE_ERROR_NONE)
+		{
+			discovery_wait(&discovery);
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "search %u: %u device(s) in %u ms",
+			                 index + 1, discovery.found_count, now_ms() - start);
+			discovery_cancel(&discovery);
+		}
+	}
+
+	discovery_cache_get(&cache_, items, &items_length);
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u device(s) in the cache", items_length);
+
+	/* the server thread stops at the next receive timeout */
+	loopback_stop_ = 1;
+	pthread_join(server, NULL);
+	close(server_socket);
+}
+
+void* loopback_server(void* arg)
+{
+	const int s = *((int*) arg);
+	uint8_t request[64];
+	uint8_t response[KNXNETIP_HEADER_LEN + KNXNETIP_HPAI_LEN + KNXNETIP_DIB_DEVICE_INFO_LEN + 4];
+	uint8_t* dib = &response[KNXNETIP_HEADER_LEN + KNXNETIP_HPAI_LEN];
+	struct sockaddr_in endpoint;
+	ssize_t received = 0;
+	uint32_t index = 0;
+
+	while (!loopback_stop_)
+	{
+		received = recv(s, request, sizeof(request), 0);
+		if ((received < KNXNETIP_HEADER_LEN + KNXNETIP_HPAI_LEN) ||
+		    (((request[2] << 8) | request[3]) != KNXNETIP_SEARCH_REQUEST))
+		{
+			if ((received < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+			{
+				break;
+			}
+			continue;
+		}
+
+		/* the response goes to the discovery endpoint of the request */
+		memset(&endpoint, 0, sizeof(endpoint));
+		endpoint.sin_family = AF_INET;
+		memcpy(&endpoint.sin_addr, &request[8], 4);
+		memcpy(&endpoint.sin_port, &request[12], 2);
+
+		for (index = 0; index < LOOPBACK_DEVICES; ++index)
+		{
+			memset(response, 0, sizeof(response));
+			response[0] = KNXNETIP_HEADER_LEN;
+			response[1] = KNXNETIP_VERSION_10;
+			response[2] = (uint8_t)(KNXNETIP_SEARCH_RESPONSE >> 8);
+			response[3] = (uint8_t)(KNXNETIP_SEARCH_RESPONSE & 0xFF);
+			response[5] = (uint8_t) sizeof(response);
+			response[6] = KNXNETIP_HPAI_LEN;
+			response[7] = KNXNETIP_IPV4_UDP;
+			inet_pton(AF_INET, "127.0.0.1", &response[8]);
+			response[12] = (uint8_t)((DISCOVERY_PORT + index) >> 8);
+			response[13] = (uint8_t)((DISCOVERY_PORT + index) & 0xFF);
+
+			dib[0] = KNXNETIP_DIB_DEVICE_INFO_LEN;
+			dib[1] = KNXNETIP_DIB_DEVICE_INFO;
+			dib[2] = 0x02; /* TP1 */
+			dib[3] = (index == 0) ? 0x01 : 0x00; /* the first device is in programming mode */
+			dib[4] = 0x11;
+			dib[5] = (uint8_t)(0x01 + index);
+			dib[8] = 0x00;
+			dib[9] = 0xC5;
+			dib[10] = 0x01;
+			dib[13] = (uint8_t) index;
+			dib[18] = 0x00;
+			dib[19] = 0x24;
+			dib[20] = 0x6D;
+			dib[23] = (uint8_t) index;
+			snprintf((char*) &dib[24], KNXNETIP_DEVICE_NAME_LEN, "Simulated Interface %u", index);
+
+			dib[KNXNETIP_DIB_DEVICE_INFO_LEN] = 4;
+			dib[KNXNETIP_DIB_DEVICE_INFO_LEN + 1] = KNXNETIP_DIB_SUPP_SVC_FAMILIES;
+			dib[KNXNETIP_DIB_DEVICE_INFO_LEN + 2] = KNXNETIP_FAMILY_TUNNELING;
+			dib[KNXNETIP_DIB_DEVICE_INFO_LEN + 3] = 0x01;
+
+			sendto(s, response, sizeof(response), 0, (struct sockaddr*) &endpoint, sizeof(endpoint));
+
+			/* the same device again, i.e. as seen on a second interface */
+			sendto(s, response, sizeof(response), 0, (struct sockaddr*) &endpoint, sizeof(endpoint));
+
+			/* the devices answer one after another */
+			usleep(50000);
+		}
+	}
+
+	return NULL;
+}
+
+bool_t on_device(const ip_tunn_dev_t* item, void* user_data)
+{
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%s (%s): %d.%d.%d %s%s",
+	                 item->ip_address, item->iface_address,
+	                 (item->ind_addr >> 12) & 0x0F, (item->ind_addr >> 8) & 0x0F, item->ind_addr & 0xFF,
+	                 item->dev_name, item->prog_mode_enabled ? " [programming mode]" : "");
+	return 1;
+}
+
+bool_t on_device_find(const ip_tunn_dev_t* item, void* user_data)
+{
+	const uint8_t* serial_number = (const uint8_t*) user_data;
+
+	on_device(item, user_data);
+
+	if (memcmp(item->serial_number, serial_number, KDRIVE_SN_LEN) == 0)
+	{
+		kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Found the device, stopping the search");
+		return 0;
+	}
+
+	return 1;
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
@@ -0,0 +1,1013 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	When a tunneling connection is lost the access port emits
+	KDRIVE_EVENT_TERMINATED and the port is closed.
+
+	This sample shows an automatic reconnect:
+	- the event callback signals a reconnect thread (the access port
+	  must not be opened or closed in the context of the notification thread)
+	- the reconnect thread re-opens the tunnel with exponential backoff,
+	  the first attempt is made immediately
+	- the tunnel individual address and the layer are restored,
+	  change the layer with reconnect_set_layer (not kdrive_ap_set_layer)
+	  so the new layer is restored
+	- telegrams sent while the tunnel is down are held in a bounded
+	  buffer and replayed in order after the port was opened again.
+	  When the buffer is full the oldest telegram is dropped.
+
+	Start the sample with the argument "loopback" to connect to a
+	simulated KNXnet/IP tunneling server on 127.0.0.1. The server drops
+	the connection (DISCONNECT_REQUEST) and refuses new connections for
+	LOOPBACK_DOWN_TIME ms, the sample logs the time until the tunnel is
+	re-established and the number of telegrams which arrived.
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_ip_reconnect kdrive_express_ip_reconnect.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN			(128)	/*!< kdriveExpress Error Messages */
+#define SEND_BUFFER_SIZE			(128)	/*!< max number of telegrams buffered while disconnected */
+#define RECONNECT_BACKOFF_MIN		(50)	/*!< first backoff (after the immediate attempt) in ms */
+#define RECONNECT_BACKOFF_MAX		(5000)	/*!< max backoff in ms */
+
+#define KNXNETIP_HEADER_LEN						(6)			/*!< KNXnet/IP header length */
+#define KNXNETIP_VERSION_10						(0x10)		/*!< KNXnet/IP protocol version 1.0 */
+#define KNXNETIP_HPAI_LEN						(8)			/*!< host protocol address information length */
+#define KNXNETIP_IPV4_UDP						(0x01)		/*!< HPAI host protocol code */
+#define KNXNETIP_DESCRIPTION_REQUEST			(0x0203)	/*!< DESCRIPTION_REQUEST service type */
+#define KNXNETIP_DESCRIPTION_RESPONSE			(0x0204)	/*!< DESCRIPTION_RESPONSE service type */
+#define KNXNETIP_CONNECT_REQUEST				(0x0205)	/*!< CONNECT_REQUEST service type */
+#define KNXNETIP_CONNECT_RESPONSE				(0x0206)	/*!< CONNECT_RESPONSE service type */
+#define KNXNETIP_CONNECTIONSTATE_REQUEST		(0x0207)	/*!< CONNECTIONSTATE_REQUEST service type */
+#define KNXNETIP_DISCONNECT_REQUEST				(0x0209)	/*!< DISCONNECT_REQUEST service type */
+#define KNXNETIP_DEVICE_CONFIGURATION_REQUEST	(0x0310)	/*!< DEVICE_CONFIGURATION_REQUEST service type */
+#define KNXNETIP_TUNNELING_REQUEST				(0x0420)	/*!< TUNNELING_REQUEST service type */
+#define KNXNETIP_E_CONNECTION_ID				(0x21)		/*!< status: unknown communication channel */
+#define KNXNETIP_E_NO_MORE_CONNECTIONS			(0x24)		/*!< status: the server accepts no more connections */
+#define CEMI_M_PROP_READ_REQ					(0xFC)		/*!< cEMI M_PropRead.req */
+#define CEMI_M_PROP_WRITE_REQ					(0xF6)		/*!< cEMI M_PropWrite.req */
+#define CEMI_M_PROP_LEN							(7)			/*!< cEMI M_Prop service without data */
+
+#define LOOPBACK_TELEGRAMS			(50)	/*!< number of telegrams sent in loopback mode, one every 20 ms */
+#define LOOPBACK_DROP_AFTER			(10)	/*!< the server drops the connection after this many telegrams */
+#define LOOPBACK_DOWN_TIME			(100)	/*!< the server refuses connections for this time after the drop, in ms */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	A buffered GroupValue_Write
+*/
+typedef struct pending_write_t
+{
+	uint16_t address;
+	uint8_t value[KDRIVE_MAX_GROUP_VALUE_LEN];
+	uint32_t bits;
+
+} pending_write_t;
+
+/*!
+	A tunneling access port with automatic reconnect
+*/
+typedef struct reconnect_port_t
+{
+	int32_t ap; /*!< the access port descriptor */
+	char ip_address[KDRIVE_MAX_IP_ADDRESS_LEN + 6]; /*!< ip address and optional port */
+	char iface_address[KDRIVE_MAX_IP_ADDRESS_LEN]; /*!< interface address or empty for the default interface */
+	uint16_t tunnel_ind_addr; /*!< the tunnel individual address to restore, 0 if not set */
+	uint16_t layer; /*!< the layer to restore, protected by the mutex */
+
+	pthread_t thread; /*!< the reconnect thread */
+	pthread_mutex_t mutex; /*!< protects the state and the buffer */
+	pthread_cond_t cond; /*!< signals the reconnect thread */
+	bool_t connected; /*!< 1 when telegrams can be sent directly */
+	bool_t lost; /*!< 1 when the reconnect thread should reconnect */
+	bool_t stop; /*!< tells the reconnect thread to terminate */
+	uint32_t reconnects; /*!< number of successful reconnects */
+
+	pending_write_t buffer[SEND_BUFFER_SIZE]; /*!< telegrams sent while disconnected */
+	uint32_t head; /*!< buffer read position */
+	uint32_t count; /*!< number of buffered telegrams */
+	uint32_t dropped; /*!< number of telegrams dropped because the buffer was full */
+
+} reconnect_port_t;
+
+/*!
+	A simulated KNXnet/IP tunneling server with a single connection,
+	used by the loopback mode
+*/
+typedef struct sim_server_t
+{
+	int socket; /*!< control and data endpoint */
+	uint16_t port; /*!< the local port of the socket */
+	pthread_t thread;
+	pthread_mutex_t mutex; /*!< protects the connection state */
+	bool_t stop;
+	bool_t connected;
+	uint8_t channel; /*!< the communication channel id of the connection */
+	uint8_t rx_seq; /*!< the next expected sequence counter from the client */
+	uint8_t tx_seq; /*!< the sequence counter of the next request to the client */
+	struct sockaddr_in control; /*!< the control endpoint of the client */
+	struct sockaddr_in data; /*!< the data endpoint of the client */
+	uint32_t refuse_until; /*!< connect requests are refused until this time (ms) */
+	uint32_t received; /*!< number of received L_Data.req */
+
+} sim_server_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Opens the tunneling connection and starts the reconnect thread.
+	iface_address may be 0 to use the default network interface.
+	If tunnel_ind_addr is not 0 it is set after each (re-)connect.
+*/
+static error_t reconnect_open(reconnect_port_t* port, int32_t ap, const char* ip_address,
+                              const char* iface_address, uint16_t tunnel_ind_addr);
+
+/*!
+	Stops the reconnect thread and closes the access port
+*/
+static void reconnect_close(reconnect_port_t* port);
+
+/*!
+	Sets the layer (KDRIVE_LAYER_LINK, KDRIVE_LAYER_BUSMON, ...) of the access port.
+	The layer is restored after each reconnect. While the tunnel is down
+	it is set with the next reconnect
+*/
+static error_t reconnect_set_layer(reconnect_port_t* port, uint16_t layer);
+
+/*!
+	Sends a GroupValue_Write, or buffers it when the tunnel is down
+*/
+static error_t reconnect_group_write(reconnect_port_t* port, uint16_t address, const uint8_t* value, uint32_t bits);
+
+/*!
+	Has to be called from the event callback of the access port
+*/
+static void reconnect_on_event(reconnect_port_t* port, uint32_t e);
+
+/*!
+	The reconnect thread
+*/
+static void* reconnect_worker(void* arg);
+
+/*!
+	Opens the tunnel and restores the tunnel individual address and layer
+*/
+static error_t reconnect_attempt(reconnect_port_t* port);
+
+/*!
+	Sends the buffered telegrams. Returns with the mutex locked.
+	On success the port is marked as connected.
+*/
+static void reconnect_replay(reconnect_port_t* port);
+
+/*!
+	Appends a telegram to the buffer, drops the oldest when full.
+	The mutex must be locked.
+*/
+static void buffer_push(reconnect_port_t* port, uint16_t address, const uint8_t* value, uint32_t bits);
+
+/*!
+	Runs the reconnect against the simulated server
+*/
+static void run_loopback(int32_t ap);
+
+/*!
+	Starts the simulated server on an ephemeral port of 127.0.0.1
+*/
+static bool_t sim_server_start(sim_server_t* server);
+
+/*!
+	Stops the simulated server
+*/
+static void sim_server_stop(sim_server_t* server);
+
+/*!
+	Drops the connection with a DISCONNECT_REQUEST and refuses
+	new connections for down_time ms
+*/
+static void sim_server_drop(sim_server_t* server, uint32_t down_time);
+
+/*!
+	The receive thread of the simulated server
+*/
+static void* sim_server_thread(void* arg);
+
+/*!
+	Handles a frame received by the simulated server.
+	Called with the mutex locked
+*/
+static void sim_server_frame(sim_server_t* server, const uint8_t* frame, uint32_t frame_len,
+                             const struct sockaddr_in* from);
+
+/*!
+	Sends a KNXnet/IP frame with the service type and body
+*/
+static void sim_server_send(sim_server_t* server, const struct sockaddr_in* to, uint16_t service,
+                            const uint8_t* body, uint32_t body_len);
+
+/*!
+	Returns the endpoint of the HPAI, or from for a route back (NAT) HPAI
+*/
+static void sim_endpoint(const uint8_t* hpai, const struct sockaddr_in* from, struct sockaddr_in* endpoint);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*!
+	Called when an event occurs
+*/
+static void event_callback(int32_t ap, uint32_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static reconnect_port_t port;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	uint16_t address = 0x901;
+	uint8_t value = 0;
+	uint32_t index = 0;
+	int32_t ap = 0;
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	/*
+		We create a Access Port descriptor. This descriptor is then used for
+		all calls to that specific access port.
+	*/
+	ap = kdrive_ap_create();
+
+	/*
+		We check that we were able to allocate a new descriptor
+		This should always happen, unless a bad_alloc exception is internally thrown
+		which means the memory couldn't be allocated.
+	*/
+	if (ap == KDRIVE_INVALID_DESCRIPTOR)
+	{
+		kdrive_logger(KDRIVE_LOGGER_FATAL, "Unable to create access port. This is a terminal failure");
+		while (1)
+		{
+			;
+		}
+	}
+
+	/*
+		We register an event callback to notify of the Access Port Events
+		The reconnect handling is triggered by KDRIVE_EVENT_TERMINATED
+	*/
+	kdrive_set_event_callback(ap, &event_callback, &port);
+
+	if ((argc > 1) && (strcmp(argv[1], "loopback") == 0))
+	{
+		run_loopback(ap);
+		kdrive_ap_release(ap);
+		return 0;
+	}
+
+	/*
+		Open a Tunneling connection with a specific IP Interface,
+		you will probably have to change the IP address
+	*/
+	if (reconnect_open(&port, ap, "192.168.1.45", 0, 0) == KDRIVE_ERROR_NONE)
+	{
+		/* the layer set with the wrapper is restored after each reconnect */
+		reconnect_set_layer(&port, KDRIVE_LAYER_LINK);
+
+		/*
+			Toggle the group object once a second for one minute.
+			Unplug the network cable of the interface to see the reconnect.
+		*/
+		for (index = 0; index < 60; ++index)
+		{
+			value = (uint8_t)(index & 1);
+			reconnect_group_write(&port, address, &value, 1);
+			sleep(1);
+		}
+
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Reconnects: %u, dropped telegrams: %u",
+		                 port.reconnects, port.dropped);
+
+		reconnect_close(&port);
+	}
+
+	/* releases the access port */
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+error_t reconnect_open(reconnect_port_t* port, int32_t ap, const char* ip_address,
+                       const char* iface_address, uint16_t tunnel_ind_addr)
+{
+	error_t e = KDRIVE_ERROR_NONE;
+
+	memset(port, 0, sizeof(reconnect_port_t));
+	port->ap = ap;
+	port->tunnel_ind_addr = tunnel_ind_addr;
+	port->layer = KDRIVE_LAYER_LINK;
+	strncpy(port->ip_address, ip_address, sizeof(port->ip_address) - 1);
+	if (iface_address)
+	{
+		strncpy(port->iface_address, iface_address, sizeof(port->iface_address) - 1);
+	}
+	pthread_mutex_init(&port->mutex, NULL);
+	pthread_cond_init(&port->cond, NULL);
+
+	e = reconnect_attempt(port);
+	if (e != KDRIVE_ERROR_NONE)
+	{
+		return e;
+	}
+
+	/* remember the layer so we can restore it after a reconnect */
+	kdrive_ap_get_layer(ap, &port->layer);
+	port->connected = 1;
+
+	if (pthread_create(&port->thread, NULL, &reconnect_worker, port) != 0)
+	{
+		kdrive_ap_close(ap);
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+
+	return KDRIVE_ERROR_NONE;
+}
+
+error_t reconnect_set_layer(reconnect_port_t* port, uint16_t layer)
+{
+	bool_t connected = 0;
+
+	pthread_mutex_lock(&port->mutex);
+	port->layer = layer;
+	connected = port->connected;
+	pthread_mutex_unlock(&port->mutex);
+
+	return connected ? kdrive_ap_set_layer(port->ap, layer) : KDRIVE_ERROR_NONE;
+}
+
+void reconnect_close(reconnect_port_t* port)
+{
+	pthread_mutex_lock(&port->mutex);
+	port->stop = 1;
+	port->connected = 0;
+	pthread_cond_signal(&port->cond);
+	pthread_mutex_unlock(&port->mutex);
+
+	pthread_join(port->thread, NULL);
+	kdrive_ap_close(port->ap);
+}
+
+/*!
+	While the tunnel is down (or the buffer is replayed) the telegram
+	is appended to the buffer, so the order of the telegrams is kept.
+	When the send fails because the port was closed in the meantime
+	the telegram is buffered as well.
+*/
+error_t reconnect_group_write(reconnect_port_t* port, uint16_t address, const uint8_t* value, uint32_t bits)
+{
+	error_t e = KDRIVE_ERROR_NONE;
+
+	if (bits > KDRIVE_BITS(KDRIVE_MAX_GROUP_VALUE_LEN))
+	{
+		return KDRIVE_BUFFER_TOO_SMALL_ERROR;
+	}
+
+	pthread_mutex_lock(&port->mutex);
+
+	if (port->connected)
+	{
+		pthread_mutex_unlock(&port->mutex);
+
+		e = kdrive_ap_group_write(port->ap, address, value, bits);
+		if ((e == KDRIVE_ERROR_NONE) || kdrive_ap_is_open(port->ap))
+		{
+			return e;
+		}
+
+		pthread_mutex_lock(&port->mutex);
+	}
+
+	buffer_push(port, address, value, bits);
+	pthread_mutex_unlock(&port->mutex);
+
+	return KDRIVE_ERROR_NONE;
+}
+
+void reconnect_on_event(reconnect_port_t* port, uint32_t e)
+{
+	if (e == KDRIVE_EVENT_TERMINATED)
+	{
+		pthread_mutex_lock(&port->mutex);
+		port->connected = 0;
+		port->lost = 1;
+		pthread_cond_signal(&port->cond);
+		pthread_mutex_unlock(&port->mutex);
+	}
+}
+
+void* reconnect_worker(void* arg)
+{
+	reconnect_port_t* port = (reconnect_port_t*) arg;
+	uint32_t backoff = 0;
+	struct timespec deadline;
+
+	pthread_mutex_lock(&port->mutex);
+
+	while (!port->stop)
+	{
+		if (!port->lost)
+		{
+			pthread_cond_wait(&port->cond, &port->mutex);
+			continue;
+		}
+
+		/* wait for the backoff time, the first attempt is immediate */
+		if (backoff > 0)
+		{
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += backoff / 1000;
+			deadline.tv_nsec += (long)(backoff % 1000) * 1000000L;
+			if (deadline.tv_nsec >= 1000000000L)
+			{
+				++deadline.tv_sec;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&port->cond, &port->mutex, &deadline);
+			if (port->stop)
+			{
+				break;
+			}
+		}
+
+		/* a terminate during the attempt or the replay sets the flag again */
+		port->lost = 0;
+		pthread_mutex_unlock(&port->mutex);
+
+		if (reconnect_attempt(port) == KDRIVE_ERROR_NONE)
+		{
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Reconnected to %s", port->ip_address);
+			reconnect_replay(port);
+			++port->reconnects;
+			backoff = 0;
+			if (!port->connected)
+			{
+				port->lost = 1;
+			}
+		}
+		else
+		{
+			pthread_mutex_lock(&port->mutex);
+			port->lost = 1;
+			backoff = (backoff == 0) ? RECONNECT_BACKOFF_MIN : backoff * 2;
+			if (backoff > RECONNECT_BACKOFF_MAX)
+			{
+				backoff = RECONNECT_BACKOFF_MAX;
+			}
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Reconnect failed, next attempt in %u ms", backoff);
+		}
+	}
+
+	pthread_mutex_unlock(&port->mutex);
+
+	return NULL;
+}
+
+error_t reconnect_attempt(reconnect_port_t* port)
+{
+	error_t e = KDRIVE_ERROR_NONE;
+	uint16_t layer = 0;
+	uint16_t restore = 0;
+
+	pthread_mutex_lock(&port->mutex);
+	restore = port->layer;
+	pthread_mutex_unlock(&port->mutex);
+
+	/* the port is already closed after a terminate, this is a no-op then */
+	kdrive_ap_close(port->ap);
+
+	e = kdrive_ap_open_ip_ex(port->ap, port->ip_address, port->iface_address[0] ? port->iface_address : 0);
+	if (e != KDRIVE_ERROR_NONE)
+	{
+		return e;
+	}
+
+	if (port->tunnel_ind_addr != 0)
+	{
+		e = kdrive_ap_set_tunnel_ind_addr(port->ap, port->tunnel_ind_addr);
+		if (e != KDRIVE_ERROR_NONE)
+		{
+			kdrive_logger_ex(KDRIVE_LOGGER_WARNING, "Unable to restore tunnel individual address 0x%04X",
+			                 port->tunnel_ind_addr);
+		}
+	}
+
+	if ((kdrive_ap_get_layer(port->ap, &layer) == KDRIVE_ERROR_NONE) && (layer != restore))
+	{
+		if (kdrive_ap_set_layer(port->ap, restore) != KDRIVE_ERROR_NONE)
+		{
+			kdrive_logger_ex(KDRIVE_LOGGER_WARNING, "Unable to restore layer %u", restore);
+		}
+	}
+
+	return KDRIVE_ERROR_NONE;
+}
+
+/*!
+	The telegrams are sent one by one without holding the mutex,
+	new telegrams are appended to the buffer in the meantime.
+	When the tunnel is lost again during the replay the
+	telegram stays in the buffer.
+*/
+void reconnect_replay(reconnect_port_t* port)
+{
+	pending_write_t pending;
+
+	pthread_mutex_lock(&port->mutex);
+
+	while (port->count > 0)
+	{
+		pending = port->buffer[port->head];
+		pthread_mutex_unlock(&port->mutex);
+
+		if (kdrive_ap_group_write(port->ap, pending.address, pending.value, pending.bits) != KDRIVE_ERROR_NONE &&
+		    !kdrive_ap_is_open(port->ap))
+		{
+			pthread_mutex_lock(&port->mutex);
+			return;
+		}
+
+		pthread_mutex_lock(&port->mutex);
+		port->head = (port->head + 1) % SEND_BUFFER_SIZE;
+		--port->count;
+	}
+
+	port->connected = kdrive_ap_is_open(port->ap);
+}
+
+void buffer_push(reconnect_port_t* port, uint16_t address, const uint8_t* value, uint32_t bits)
+{
+	pending_write_t* pending = 0;
+
+	if (port->count == SEND_BUFFER_SIZE)
+	{
+		port->head = (port->head + 1) % SEND_BUFFER_SIZE;
+		--port->count;
+		++port->dropped;
+	}
+
+	pending = &port->buffer[(port->head + port->count) % SEND_BUFFER_SIZE];
+	pending->address = address;
+	pending->bits = bits;
+	memcpy(pending->value, value, (bits + 7) / 8);
+	++port->count;
+}
+
+/*!
+	The server drops the connection after LOOPBACK_DROP_AFTER telegrams.
+	The telegrams sent while the tunnel is down are buffered and
+	replayed, so the server receives all of them.
+*/
+void run_loopback(int32_t ap)
+{
+	sim_server_t server;
+	char address[KDRIVE_MAX_IP_ADDRESS_LEN + 6];
+	uint32_t index = 0;
+	uint32_t dropped_at = 0;
+	uint32_t reconnects = 0;
+	uint32_t received = 0;
+	uint8_t value = 0;
+	bool_t waiting = 0;
+
+	if (!sim_server_start(&server))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to start the simulated server");
+		return;
+	}
+
+	snprintf(address, sizeof(address), "127.0.0.1:%u", server.port);
+	if (reconnect_open(&port, ap, address, "127.0.0.1", 0) != KDRIVE_ERROR_NONE)
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to connect to the simulated server");
+		sim_server_stop(&server);
+		return;
+	}
+
+	for (index = 0; index < LOOPBACK_TELEGRAMS; ++index)
+	{
+		if (index == LOOPBACK_DROP_AFTER)
+		{
+			kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Server drops the connection");
+			dropped_at = now_ms();
+			waiting = 1;
+			sim_server_drop(&server, LOOPBACK_DOWN_TIME);
+		}
+
+		value = (uint8_t)(index & 1);
+		reconnect_group_write(&port, 0x0901, &value, 1);
+		usleep(20000);
+
+		pthread_mutex_lock(&port.mutex);
+		reconnects = port.reconnects;
+		pthread_mutex_unlock(&port.mutex);
+		if (waiting && (reconnects > 0))
+		{
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Reconnected within %u ms", now_ms() - dropped_at);
+			waiting = 0;
+		}
+	}
+
+	/* the last L_Data.con */
+	usleep(100000);
+
+	pthread_mutex_lock(&server.mutex);
+	received = server.received;
+	pthread_mutex_unlock(&server.mutex);
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Sent %u telegrams, the server received %u, dropped %u",
+	                 LOOPBACK_TELEGRAMS, received, port.dropped);
+
+	reconnect_close(&port);
+	sim_server_stop(&server);
+}
+
+bool_t sim_server_start(sim_server_t* server)
+{
+	struct sockaddr_in local;
+	struct timeval timeout;
+	socklen_t local_len = sizeof(local);
+
+	memset(server, 0, sizeof(sim_server_t));
+	pthread_mutex_init(&server->mutex, NULL);
+
+	server->socket = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	inet_pton(AF_INET, "127.0.0.1", &local.sin_addr);
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 100000;
+
+	if ((server->socket < 0) ||
+	    (bind(server->socket, (struct sockaddr*) &local, sizeof(local)) != 0) ||
+	    (getsockname(server->socket, (struct sockaddr*) &local, &local_len) != 0) ||
+	    (setsockopt(server->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0))
+	{
+		if (server->socket >= 0)
+		{
+			close(server->socket);
+		}
+		pthread_mutex_destroy(&server->mutex);
+		return 0;
+	}
+	server->port = ntohs(local.sin_port);
+
+	if (pthread_create(&server->thread, NULL, &sim_server_thread, server) != 0)
+	{
+		close(server->socket);
+		pthread_mutex_destroy(&server->mutex);
+		return 0;
+	}
+
+	return 1;
+}
+
+void sim_server_stop(sim_server_t* server)
+{
+	/* the thread checks the flag at least every 100 ms (SO_RCVTIMEO) */
+	pthread_mutex_lock(&server->mutex);
+	server->stop = 1;
+	pthread_mutex_unlock(&server->mutex);
+
+	pthread_join(server->thread, NULL);
+	close(server->socket);
+	pthread_mutex_destroy(&server->mutex);
+}
+
+void sim_server_drop(sim_server_t* server, uint32_t down_time)
+{
+	uint8_t body[2 + KNXNETIP_HPAI_LEN] = { 0, 0, KNXNETIP_HPAI_LEN, KNXNETIP_IPV4_UDP };
+
+	pthread_mutex_lock(&server->mutex);
+	if (server->connected)
+	{
+		body[0] = server->channel;
+		inet_pton(AF_INET, "127.0.0.1", &body[4]);
+		body[8] = (uint8_t)(server->port >> 8);
+		body[9] = (uint8_t)(server->port & 0xFF);
+		sim_server_send(server, &server->control, KNXNETIP_DISCONNECT_REQUEST, body, sizeof(body));
+		server->connected = 0;
+	}
+	server->refuse_until = now_ms() + down_time;
+	pthread_mutex_unlock(&server->mutex);
+}
+
+void* sim_server_thread(void* arg)
+{
+	sim_server_t* server = (sim_server_t*) arg;
+	uint8_t frame[256];
+	struct sockaddr_in from;
+	socklen_t from_len = 0;
+	ssize_t received = 0;
+	bool_t stop = 0;
+
+	while (!stop)
+	{
+		from_len = sizeof(from);
+		received = recvfrom(server->socket, frame, sizeof(frame), 0, (struct sockaddr*) &from, &from_len);
+		if ((received < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+		{
+			break;
+		}
+
+		pthread_mutex_lock(&server->mutex);
+		if ((received >= KNXNETIP_HEADER_LEN) && (frame[0] == KNXNETIP_HEADER_LEN) &&
+		    (frame[1] == KNXNETIP_VERSION_10) && (((frame[4] << 8) | frame[5]) == received))
+		{
+			sim_server_frame(server, frame, (uint32_t) received, &from);
+		}
+		stop = server->stop;
+		pthread_mutex_unlock(&server->mutex);
+	}
+
+	return NULL;
+}
+
+/*!
+	Answers the requests of a single tunneling client:
+	- DESCRIPTION_REQUEST with the device information and the service families
+	- CONNECT_REQUEST with a new channel, or E_NO_MORE_CONNECTIONS while down
+	- CONNECTIONSTATE_REQUEST and DISCONNECT_REQUEST
+	- TUNNELING_REQUEST with a TUNNELING_ACK, and an L_Data.req with an L_Data.con
+	- DEVICE_CONFIGURATION_REQUEST with a negative M_PropRead.con / M_PropWrite.con
+	A repeated request (same sequence counter) is acknowledged again only.
+	The response service types are the request service types plus one.
+*/
+void sim_server_frame(sim_server_t* server, const uint8_t* frame, uint32_t frame_len,
+                      const struct sockaddr_in* from)
+{
+	const uint16_t service = (uint16_t)((frame[2] << 8) | frame[3]);
+	const uint8_t* body = &frame[KNXNETIP_HEADER_LEN];
+	const uint32_t body_len = frame_len - KNXNETIP_HEADER_LEN;
+	uint8_t response[128];
+	struct sockaddr_in endpoint;
+	uint32_t cemi_len = 0;
+
+	memset(response, 0, sizeof(response));
+
+	switch (service)
+	{
+		case KNXNETIP_DESCRIPTION_REQUEST:
+			if (body_len >= KNXNETIP_HPAI_LEN)
+			{
+				/* device information DIB (TP1, 1.1.255) and the core, management and tunneling families */
+				response[0] = 54;
+				response[1] = 0x01;
+				response[2] = 0x02;
+				response[4] = 0x11;
+				response[5] = 0xFF;
+				response[9] = 0xC5;
+				snprintf((char*) &response[24], 30, "Simulated Tunneling Server");
+				response[54] = 8;
+				response[55] = 0x02;
+				response[56] = 0x02;
+				response[57] = 0x01;
+				response[58] = 0x03;
+				response[59] = 0x01;
+				response[60] = 0x04;
+				response[61] = 0x01;
+				sim_endpoint(body, from, &endpoint);
+				sim_server_send(server, &endpoint, KNXNETIP_DESCRIPTION_RESPONSE, response, 62);
+			}
+			break;
+
+		case KNXNETIP_CONNECT_REQUEST:
+			if (body_len >= 2 * KNXNETIP_HPAI_LEN + 4)
+			{
+				sim_endpoint(body, from, &endpoint);
+				if ((int32_t)(server->refuse_until - now_ms()) > 0)
+				{
+					response[1] = KNXNETIP_E_NO_MORE_CONNECTIONS;
+					sim_server_send(server, &endpoint, KNXNETIP_CONNECT_RESPONSE, response, 2);
+					break;
+				}
+
+				server->connected = 1;
+				server->channel = (uint8_t)((server->channel % 255) + 1);
+				server->rx_seq = 0;
+				server->tx_seq = 0;
+				server->control = endpoint;
+				sim_endpoint(&body[KNXNETIP_HPAI_LEN], from, &server->data);
+
+				/* channel, status, data endpoint, CRD with the individual address 1.1.255 */
+				response[0] = server->channel;
+				response[2] = KNXNETIP_HPAI_LEN;
+				response[3] = KNXNETIP_IPV4_UDP;
+				inet_pton(AF_INET, "127.0.0.1", &response[4]);
+				response[8] = (uint8_t)(server->port >> 8);
+				response[9] = (uint8_t)(server->port & 0xFF);
+				response[10] = 4;
+				response[11] = body[2 * KNXNETIP_HPAI_LEN + 1];
+				response[12] = 0x11;
+				response[13] = 0xFF;
+				sim_server_send(server, &endpoint, KNXNETIP_CONNECT_RESPONSE, response, 14);
+			}
+			break;
+
+		case KNXNETIP_CONNECTIONSTATE_REQUEST:
+		case KNXNETIP_DISCONNECT_REQUEST:
+			if (body_len >= 2 + KNXNETIP_HPAI_LEN)
+			{
+				response[0] = body[0];
+				response[1] = (server->connected && (body[0] == server->channel)) ? 0 : KNXNETIP_E_CONNECTION_ID;
+				if ((service == KNXNETIP_DISCONNECT_REQUEST) && (body[0] == server->channel))
+				{
+					server->connected = 0;
+				}
+				sim_endpoint(&body[2], from, &endpoint);
+				sim_server_send(server, &endpoint, (uint16_t)(service + 1), response, 2);
+			}
+			break;
+
+		case KNXNETIP_TUNNELING_REQUEST:
+		case KNXNETIP_DEVICE_CONFIGURATION_REQUEST:
+			if ((body_len < 5) || (body[0] != 4) || !server->connected || (body[1] != server->channel))
+			{
+				break;
+			}
+
+			/* connection header: length, channel, sequence counter, status */
+			response[0] = 4;
+			response[1] = server->channel;
+			response[2] = body[2];
+			sim_server_send(server, &server->data, (uint16_t)(service + 1), response, 4);
+			if (body[2] != server->rx_seq)
+			{
+				break;
+			}
+			++server->rx_seq;
+
+			cemi_len = body_len - 4;
+			if (cemi_len > sizeof(response) - 4)
+			{
+				break;
+			}
+			memcpy(&response[4], &body[4], cemi_len);
+			response[2] = server->tx_seq;
+
+			if ((service == KNXNETIP_TUNNELING_REQUEST) && (body[4] == KDRIVE_CEMI_L_DATA_REQ))
+			{
+				++server->received;
+				++server->tx_seq;
+				response[4] = KDRIVE_CEMI_L_DATA_CON;
+				sim_server_send(server, &server->data, service, response, 4 + cemi_len);
+			}
+			else if (((body[4] == CEMI_M_PROP_READ_REQ) || (body[4] == CEMI_M_PROP_WRITE_REQ)) &&
+			         (cemi_len >= CEMI_M_PROP_LEN))
+			{
+				/* negative confirmation: number of elements 0, error code "void DP" */
+				++server->tx_seq;
+				response[4] = (uint8_t)(body[4] - 1);
+				response[4 + 5] &= 0x0F;
+				response[4 + CEMI_M_PROP_LEN] = 0x07;
+				sim_server_send(server, &server->data, service, response, 4 + CEMI_M_PROP_LEN + 1);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+void sim_server_send(sim_server_t* server, const struct sockaddr_in* to, uint16_t service,
+                     const uint8_t* body, uint32_t body_len)
+{
+	uint8_t frame[KNXNETIP_HEADER_LEN + 128];
+	const uint32_t frame_len = KNXNETIP_HEADER_LEN + body_len;
+
+	frame[0] = KNXNETIP_HEADER_LEN;
+	frame[1] = KNXNETIP_VERSION_10;
+	frame[2] = (uint8_t)(service >> 8);
+	frame[3] = (uint8_t)(service & 0xFF);
+	frame[4] = (uint8_t)(frame_len >> 8);
+	frame[5] = (uint8_t)(frame_len & 0xFF);
+	memcpy(&frame[KNXNETIP_HEADER_LEN], body, body_len);
+
+	sendto(server->socket, frame, frame_len, 0, (const struct sockaddr*) to, sizeof(struct sockaddr_in));
+}
+
+void sim_endpoint(const uint8_t* hpai, const struct sockaddr_in* from, struct sockaddr_in* endpoint)
+{
+	memset(endpoint, 0, sizeof(struct sockaddr_in));
+	endpoint->sin_family = AF_INET;
+	memcpy(&endpoint->sin_addr, &hpai[2], 4);
+	memcpy(&endpoint->sin_port, &hpai[6], 2);
+
+	if ((endpoint->sin_addr.s_addr == 0) || (endpoint->sin_port == 0))
+	{
+		*endpoint = *from;
+	}
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000u) + ((uint32_t) ts.tv_nsec / 1000000u);
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
+
+/*!
+	The event callback is called when an Access Port event is raised
+*/
+void event_callback(int32_t ap, uint32_t e, void* user_data)
+{
+	switch (e)
+	{
+		case KDRIVE_EVENT_OPENED:
+			kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Access Port Opened");
+			break;
+
+		case KDRIVE_EVENT_CLOSED:
+			kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Access Port Closed");
+			break;
+
+		case KDRIVE_EVENT_TERMINATED:
+			kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Access Port Terminated");
+			break;
+
+		default:
+			break;
+	}
+
+	reconnect_on_event((reconnect_port_t*) user_data, e);
+}
@@ -0,0 +1,648 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	KNXnet/IP Routing
+
+	The access port supports KNXnet/IP Tunneling (kdrive_ap_open_ip etc).
+	A tunnel has a window of one frame and an interface has only a
+	few tunneling connections. With KNXnet/IP Routing the telegrams are
+	sent as ROUTING_INDICATION to a multicast group, there is no
+	acknowledge and no connection, so several processes can share the
+	backbone without using tunneling connections.
+
+	This sample implements routing with plain UDP sockets:
+	- ROUTING_INDICATION: the cEMI L_Data.ind frames are passed to a telegram
+	  callback (kdrive_ap_telegram_callback), so the kdrive_ap_get_xxx and
+	  kdrive_ap_is_xxx functions can be used to decode them
+	- ROUTING_BUSY: sending is paused for the busy wait time plus a
+	  random time which grows with the number of busy frames received
+	- ROUTING_LOST_MESSAGE: the number of lost messages is accumulated
+
+	Start the sample with the argument "loopback" to run two routing
+	instances in this process on the loopback interface (127.0.0.1).
+
+	This sample uses POSIX sockets and threads, i.e.
+	gcc -I../../include -o kdrive_express_ip_routing kdrive_express_ip_routing.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN				(128)		/*!< kdriveExpress Error Messages */
+#define MAX_TELEGRAM_LEN				(64)		/*!< max cEMI telegram length */
+#define ROUTING_MULTICAST_GROUP			("224.0.23.12")	/*!< the KNXnet/IP system setup multicast address */
+#define ROUTING_PORT					(3671)		/*!< the KNXnet/IP port */
+#define ROUTING_TTL						(16)		/*!< multicast time to live */
+#define ROUTING_RCVBUF					(1024 * 1024)	/*!< receive buffer size, holds bursts at high telegram rates */
+
+#define KNXNETIP_HEADER_LEN				(6)			/*!< KNXnet/IP header length */
+#define KNXNETIP_VERSION_10				(0x10)		/*!< KNXnet/IP protocol version 1.0 */
+#define KNXNETIP_ROUTING_INDICATION		(0x0530)	/*!< ROUTING_INDICATION service type */
+#define KNXNETIP_ROUTING_LOST_MESSAGE	(0x0531)	/*!< ROUTING_LOST_MESSAGE service type */
+#define KNXNETIP_ROUTING_BUSY			(0x0532)	/*!< ROUTING_BUSY service type */
+#define CEMI_MIN_LEN					(10)		/*!< cEMI L_Data without additional info: message code, additional info length, control 1 + 2, source, destination, length, TPCI */
+
+#define ROUTING_BUSY_RANDOM_WAIT		(50)		/*!< max random wait per received busy frame, in ms */
+#define ROUTING_BUSY_SLOW_DURATION		(100)		/*!< time per received busy frame before the busy counter decreases, in ms */
+#define ROUTING_BUSY_DECREMENT			(5)			/*!< the busy counter decreases by one every 5 ms */
+
+#define LOOPBACK_TELEGRAMS				(10000)		/*!< number of telegrams sent in loopback mode */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	A KNXnet/IP routing endpoint
+*/
+typedef struct routing_t
+{
+	int rx_socket; /*!< bound to the routing port, joined to the multicast group */
+	int tx_socket; /*!< used to send, its port identifies our own frames */
+	struct sockaddr_in group; /*!< the multicast group and port */
+	struct in_addr iface; /*!< the interface address */
+	struct in_addr tx_addr; /*!< the source address of our frames, identifies our own frames with tx_port */
+	uint16_t tx_port; /*!< the local port of tx_socket */
+	uint16_t ind_addr; /*!< source address for routing_group_write */
+
+	kdrive_ap_telegram_callback callback; /*!< called for each received L_Data.ind */
+	void* user_data;
+	pthread_t thread; /*!< the receive thread */
+	pthread_mutex_t mutex; /*!< protects the flow control state and the counters */
+	bool_t stop; /*!< set with the mutex locked */
+
+	bool_t running; /*!< 1 when the receive thread was started */
+	bool_t paused; /*!< 1 while pause_until is valid */
+	uint32_t pause_until; /*!< sending is paused until this time (ms) */
+	unsigned int seed; /*!< random seed of the busy wait */
+	uint32_t busy_since; /*!< time of the last received busy frame (ms) */
+	uint32_t busy_count; /*!< the number of busy frames received (N) */
+
+	uint32_t sent; /*!< number of sent routing indications */
+	uint32_t received; /*!< number of received routing indications */
+	uint32_t busy_received; /*!< number of received busy frames */
+	uint32_t lost; /*!< sum of the lost messages reported by the routers */
+
+} routing_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Opens a KNXnet/IP routing endpoint.
+	This is the routing counterpart of kdrive_ap_open_ip_ex.
+	\param multicast_group the routing multicast address or 0 for 224.0.23.12
+	\param iface_address the interface adaptor ip address or 0 for the default interface
+	\param c the telegram callback, called in the context of the receive thread
+*/
+static error_t routing_open(routing_t* routing, const char* multicast_group, const char* iface_address,
+                            kdrive_ap_telegram_callback c, void* user_data);
+
+/*!
+	Stops the receive thread and closes the sockets
+*/
+static void routing_close(routing_t* routing);
+
+/*!
+	Sends a cEMI frame as ROUTING_INDICATION.
+	Waits while the sending is paused because of ROUTING_BUSY.
+*/
+static error_t routing_send(routing_t* routing, const uint8_t telegram[], uint32_t telegram_len);
+
+/*!
+	Sends a GroupValue_Write as ROUTING_INDICATION
+*/
+static error_t routing_group_write(routing_t* routing, uint16_t address, const uint8_t* value, uint32_t bits);
+
+/*!
+	Sends a ROUTING_BUSY, i.e. to test the flow control
+*/
+static error_t routing_send_busy(routing_t* routing, uint16_t wait_time);
+
+/*!
+	The receive thread
+*/
+static void* routing_receiver(void* arg);
+
+/*!
+	Handles a received ROUTING_BUSY
+*/
+static void routing_on_busy(routing_t* routing, uint16_t wait_time);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Runs two routing endpoints on the loopback interface
+*/
+static void run_loopback(void);
+
+/*!
+	Telegram Callback Handler
+*/
+static void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	routing_t routing;
+	uint8_t value = 1;
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	if ((argc > 1) && (strcmp(argv[1], "loopback") == 0))
+	{
+		run_loopback();
+		return 0;
+	}
+
+	if (routing_open(&routing, 0, 0, &on_telegram, NULL) == KDRIVE_ERROR_NONE)
+	{
+		routing.ind_addr = 0x11FA;
+
+		/* send a 1-Bit boolean GroupValueWrite telegram: on */
+		routing_group_write(&routing, 0x901, &value, 1);
+
+		kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Press [Enter] to exit the application ...");
+		getchar();
+
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "sent %u, received %u, busy %u, lost %u",
+		                 routing.sent, routing.received, routing.busy_received, routing.lost);
+
+		routing_close(&routing);
+	}
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+error_t routing_open(routing_t* routing, const char* multicast_group, const char* iface_address,
+                     kdrive_ap_telegram_callback c, void* user_data)
+{
+	struct sockaddr_in local;
+	struct ip_mreq mreq;
+	struct timeval timeout;
+	socklen_t local_len = sizeof(local);
+	int reuse = 1;
+	int rcvbuf = ROUTING_RCVBUF;
+	unsigned char ttl = ROUTING_TTL;
+	unsigned char loop = 1;
+
+	memset(routing, 0, sizeof(routing_t));
+	routing->rx_socket = -1;
+	routing->tx_socket = -1;
+	routing->callback = c;
+	routing->user_data = user_data;
+	pthread_mutex_init(&routing->mutex, NULL);
+
+	routing->group.sin_family = AF_INET;
+	routing->group.sin_port = htons(ROUTING_PORT);
+	routing->iface.s_addr = htonl(INADDR_ANY);
+	if ((inet_pton(AF_INET, multicast_group ? multicast_group : ROUTING_MULTICAST_GROUP, &routing->group.sin_addr) != 1) ||
+	    (iface_address && (inet_pton(AF_INET, iface_address, &routing->iface) != 1)))
+	{
+		return KDRIVE_AP_KNX_NET_IP_ERROR;
+	}
+
+	/* the receive socket: bound to the routing port, shared with other processes */
+	routing->rx_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(ROUTING_PORT);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	mreq.imr_multiaddr = routing->group.sin_addr;
+	mreq.imr_interface = routing->iface;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 200000;
+
+	if ((routing->rx_socket < 0) ||
+	    (setsockopt(routing->rx_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0) ||
+	    (bind(routing->rx_socket, (struct sockaddr*) &local, sizeof(local)) != 0) ||
+	    (setsockopt(routing->rx_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) ||
+	    (setsockopt(routing->rx_socket, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) != 0) ||
+	    (setsockopt(routing->rx_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0))
+	{
+		routing_close(routing);
+		return KDRIVE_SOCKET_ERROR;
+	}
+
+	/* the send socket: an ephemeral port, so we can recognize our own frames */
+	routing->tx_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr = routing->iface;
+
+	if ((routing->tx_socket < 0) ||
+	    (bind(routing->tx_socket, (struct sockaddr*) &local, sizeof(local)) != 0) ||
+	    (getsockname(routing->tx_socket, (struct sockaddr*) &local, &local_len) != 0) ||
+	    (setsockopt(routing->tx_socket, IPPROTO_IP, IP_MULTICAST_IF, &routing->iface, sizeof(routing->iface)) != 0) ||
+	    (setsockopt(routing->tx_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0) ||
+	    (setsockopt(routing->tx_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0))
+	{
+		routing_close(routing);
+		return KDRIVE_SOCKET_ERROR;
+	}
+	routing->tx_port = ntohs(local.sin_port);
+	routing->seed = (unsigned int) now_ms() ^ ((unsigned int) getpid() << 16) ^ routing->tx_port;
+
+	/* with the default interface the kernel chooses the source address, ask it with a connected socket */
+	routing->tx_addr = routing->iface;
+	if (routing->tx_addr.s_addr == htonl(INADDR_ANY))
+	{
+		int probe = socket(AF_INET, SOCK_DGRAM, 0);
+		local_len = sizeof(local);
+		if ((probe >= 0) &&
+		    (connect(probe, (struct sockaddr*) &routing->group, sizeof(routing->group)) == 0) &&
+		    (getsockname(probe, (struct sockaddr*) &local, &local_len) == 0))
+		{
+			routing->tx_addr = local.sin_addr;
+		}
+		if (probe >= 0)
+		{
+			close(probe);
+		}
+	}
+
+	if (pthread_create(&routing->thread, NULL, &routing_receiver, routing) != 0)
+	{
+		routing_close(routing);
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+	routing->running = 1;
+
+	return KDRIVE_ERROR_NONE;
+}
+
+void routing_close(routing_t* routing)
+{
+	if (routing->rx_socket >= 0)
+	{
+		/* the receive thread checks the flag at least every 200 ms (SO_RCVTIMEO) */
+		pthread_mutex_lock(&routing->mutex);
+		routing->stop = 1;
+		pthread_mutex_unlock(&routing->mutex);
+		if (routing->running)
+		{
+			pthread_join(routing->thread, NULL);
+			routing->running = 0;
+		}
+		close(routing->rx_socket);
+		routing->rx_socket = -1;
+	}
+
+	if (routing->tx_socket >= 0)
+	{
+		close(routing->tx_socket);
+		routing->tx_socket = -1;
+	}
+}
+
+error_t routing_send(routing_t* routing, const uint8_t telegram[], uint32_t telegram_len)
+{
+	uint8_t frame[KNXNETIP_HEADER_LEN + MAX_TELEGRAM_LEN];
+	uint32_t frame_len = KNXNETIP_HEADER_LEN + telegram_len;
+	int32_t pause = 0;
+
+	if (telegram_len > MAX_TELEGRAM_LEN)
+	{
+		return KDRIVE_BUFFER_TOO_SMALL_ERROR;
+	}
+
+	/* flow control: wait while paused by a ROUTING_BUSY */
+	pthread_mutex_lock(&routing->mutex);
+	if (routing->paused)
+	{
+		pause = (int32_t)(routing->pause_until - now_ms());
+		routing->paused = (pause > 0);
+	}
+	pthread_mutex_unlock(&routing->mutex);
+
+	if (pause > 0)
+	{
+		usleep((useconds_t) pause * 1000);
+	}
+
+	frame[0] = KNXNETIP_HEADER_LEN;
+	frame[1] = KNXNETIP_VERSION_10;
+	frame[2] = (uint8_t)(KNXNETIP_ROUTING_INDICATION >> 8);
+	frame[3] = (uint8_t)(KNXNETIP_ROUTING_INDICATION & 0xFF);
+	frame[4] = (uint8_t)(frame_len >> 8);
+	frame[5] = (uint8_t)(frame_len & 0xFF);
+	memcpy(&frame[KNXNETIP_HEADER_LEN], telegram, telegram_len);
+
+	if (sendto(routing->tx_socket, frame, frame_len, 0, (struct sockaddr*) &routing->group, sizeof(routing->group)) != (ssize_t) frame_len)
+	{
+		return KDRIVE_SOCKET_ERROR;
+	}
+
+	pthread_mutex_lock(&routing->mutex);
+	++routing->sent;
+	pthread_mutex_unlock(&routing->mutex);
+
+	return KDRIVE_ERROR_NONE;
+}
+
+/*!
+	Builds a cEMI L_Data.ind: with routing the frames are sent as indications.
+	Values with 6 bits or less are encoded in the APCI octet.
+*/
+error_t routing_group_write(routing_t* routing, uint16_t address, const uint8_t* value, uint32_t bits)
+{
+	uint8_t telegram[10 + KDRIVE_MAX_GROUP_VALUE_LEN];
+	uint32_t length = (bits + 7) / 8;
+
+	if (length > KDRIVE_MAX_GROUP_VALUE_LEN)
+	{
+		return KDRIVE_BUFFER_TOO_SMALL_ERROR;
+	}
+
+	telegram[0] = KDRIVE_CEMI_L_DATA_IND;
+	telegram[1] = 0x00; /* no additional info */
+	telegram[2] = 0xBC; /* standard frame, not repeated, broadcast, low priority */
+	telegram[3] = 0xE0; /* group address, hop count 6 */
+	telegram[4] = (uint8_t)(routing->ind_addr >> 8);
+	telegram[5] = (uint8_t)(routing->ind_addr & 0xFF);
+	telegram[6] = (uint8_t)(address >> 8);
+	telegram[7] = (uint8_t)(address & 0xFF);
+	telegram[9] = 0x00; /* TPCI: UDP */
+
+	if (bits <= 6)
+	{
+		telegram[8] = 1;
+		telegram[10] = (uint8_t)(0x80 | (value[0] & 0x3F));
+		return routing_send(routing, telegram, 11);
+	}
+
+	telegram[8] = (uint8_t)(1 + length);
+	telegram[10] = 0x80;
+	memcpy(&telegram[11], value, length);
+
+	return routing_send(routing, telegram, 11 + length);
+}
+
+error_t routing_send_busy(routing_t* routing, uint16_t wait_time)
+{
+	uint8_t frame[KNXNETIP_HEADER_LEN + 6] =
+	{
+		KNXNETIP_HEADER_LEN, KNXNETIP_VERSION_10,
+		(uint8_t)(KNXNETIP_ROUTING_BUSY >> 8), (uint8_t)(KNXNETIP_ROUTING_BUSY & 0xFF),
+		0x00, KNXNETIP_HEADER_LEN + 6,
+		0x06, /* structure length */
+		0x00, /* device state */
+		(uint8_t)(wait_time >> 8), (uint8_t)(wait_time & 0xFF),
+		0x00, 0x00 /* busy control field */
+	};
+
+	if (sendto(routing->tx_socket, frame, sizeof(frame), 0, (struct sockaddr*) &routing->group, sizeof(routing->group)) != (ssize_t) sizeof(frame))
+	{
+		return KDRIVE_SOCKET_ERROR;
+	}
+
+	return KDRIVE_ERROR_NONE;
+}
+
+void* routing_receiver(void* arg)
+{
+	routing_t* routing = (routing_t*) arg;
+	uint8_t frame[KNXNETIP_HEADER_LEN + 256];
+	struct sockaddr_in from;
+	socklen_t from_len = 0;
+	ssize_t received = 0;
+	uint16_t service = 0;
+	uint16_t total_len = 0;
+	const uint8_t* body = &frame[KNXNETIP_HEADER_LEN];
+	bool_t stop = 0;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&routing->mutex);
+		stop = routing->stop;
+		pthread_mutex_unlock(&routing->mutex);
+		if (stop)
+		{
+			break;
+		}
+
+		from_len = sizeof(from);
+		received = recvfrom(routing->rx_socket, frame, sizeof(frame), 0, (struct sockaddr*) &from, &from_len);
+		if (received < 0)
+		{
+			if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK))
+			{
+				continue;
+			}
+			break;
+		}
+
+		/* our own frames come back because of IP_MULTICAST_LOOP */
+		if ((ntohs(from.sin_port) == routing->tx_port) && (from.sin_addr.s_addr == routing->tx_addr.s_addr))
+		{
+			continue;
+		}
+
+		if ((received < KNXNETIP_HEADER_LEN) || (frame[0] != KNXNETIP_HEADER_LEN) || (frame[1] != KNXNETIP_VERSION_10))
+		{
+			continue;
+		}
+
+		service = (uint16_t)((frame[2] << 8) | frame[3]);
+		total_len = (uint16_t)((frame[4] << 8) | frame[5]);
+		if ((total_len < KNXNETIP_HEADER_LEN) || (total_len > received))
+		{
+			continue;
+		}
+
+		switch (service)
+		{
+			case KNXNETIP_ROUTING_INDICATION:
+				/* the additional info and the APDU have to be within the frame */
+				if ((total_len < KNXNETIP_HEADER_LEN + CEMI_MIN_LEN + body[1]) ||
+				    (total_len < KNXNETIP_HEADER_LEN + CEMI_MIN_LEN + body[1] + body[8 + body[1]]))
+				{
+					break;
+				}
+				pthread_mutex_lock(&routing->mutex);
+				++routing->received;
+				pthread_mutex_unlock(&routing->mutex);
+				if (routing->callback && (body[0] == KDRIVE_CEMI_L_DATA_IND))
+				{
+					routing->callback(body, total_len - KNXNETIP_HEADER_LEN, routing->user_data);
+				}
+				break;
+
+			case KNXNETIP_ROUTING_LOST_MESSAGE:
+				if ((total_len >= KNXNETIP_HEADER_LEN + 4) && (body[0] == 4))
+				{
+					pthread_mutex_lock(&routing->mutex);
+					routing->lost += (uint32_t)((body[2] << 8) | body[3]);
+					pthread_mutex_unlock(&routing->mutex);
+				}
+				break;
+
+			case KNXNETIP_ROUTING_BUSY:
+				if ((total_len >= KNXNETIP_HEADER_LEN + 6) && (body[0] == 6))
+				{
+					routing_on_busy(routing, (uint16_t)((body[2] << 8) | body[3]));
+				}
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+	Flow control as described in KNXnet/IP Routing:
+	- the busy counter N is incremented for each ROUTING_BUSY
+	- sending pauses for the wait time plus a random time in [0, N * 50 ms]
+	- after N * 100 ms without a further busy frame, N is decremented every 5 ms
+*/
+void routing_on_busy(routing_t* routing, uint16_t wait_time)
+{
+	uint32_t now = now_ms();
+	uint32_t quiet = 0;
+	uint32_t slow_duration = 0;
+	uint32_t decrement = 0;
+
+	pthread_mutex_lock(&routing->mutex);
+
+	if (routing->busy_count > 0)
+	{
+		quiet = now - routing->busy_since;
+		slow_duration = routing->busy_count * ROUTING_BUSY_SLOW_DURATION;
+		if (quiet > slow_duration)
+		{
+			decrement = (quiet - slow_duration) / ROUTING_BUSY_DECREMENT;
+			routing->busy_count = (decrement >= routing->busy_count) ? 0 : routing->busy_count - decrement;
+		}
+	}
+
+	++routing->busy_count;
+	++routing->busy_received;
+	routing->busy_since = now;
+	routing->pause_until = now + wait_time + (uint32_t)(rand_r(&routing->seed) % (routing->busy_count * ROUTING_BUSY_RANDOM_WAIT + 1));
+	routing->paused = 1;
+
+	pthread_mutex_unlock(&routing->mutex);
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000u) + ((uint32_t) ts.tv_nsec / 1000000u);
+}
+
+/*!
+	Endpoint a sends LOOPBACK_TELEGRAMS group value writes, endpoint b counts them.
+	Then b sends a ROUTING_BUSY with 100 ms and we measure the pause of a.
+*/
+void run_loopback(void)
+{
+	routing_t a;
+	routing_t b;
+	uint32_t index = 0;
+	uint8_t value = 0;
+	uint32_t start = 0;
+	uint32_t elapsed = 0;
+	uint32_t received = 0;
+
+	if ((routing_open(&a, 0, "127.0.0.1", 0, 0) != KDRIVE_ERROR_NONE) ||
+	    (routing_open(&b, 0, "127.0.0.1", 0, 0) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the routing endpoints on the loopback interface");
+		return;
+	}
+
+	a.ind_addr = 0x11FA;
+	start = now_ms();
+
+	for (index = 0; index < LOOPBACK_TELEGRAMS; ++index)
+	{
+		value = (uint8_t)(index & 1);
+		routing_group_write(&a, (uint16_t)(0x0900 + (index % 64)), &value, 1);
+	}
+
+	elapsed = now_ms() - start;
+	usleep(100000);
+
+	/* the counters are updated by the receive threads */
+	pthread_mutex_lock(&b.mutex);
+	received = b.received;
+	pthread_mutex_unlock(&b.mutex);
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "sent %u telegrams in %u ms, received %u",
+	                 a.sent, elapsed, received);
+
+	routing_send_busy(&b, 100);
+	usleep(20000);
+
+	start = now_ms();
+	routing_group_write(&a, 0x0901, &value, 1);
+	elapsed = now_ms() - start;
+
+	pthread_mutex_lock(&a.mutex);
+	received = a.busy_received;
+	pthread_mutex_unlock(&a.mutex);
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "busy received %u, send paused for %u ms",
+	                 received, elapsed);
+
+	routing_close(&a);
+	routing_close(&b);
+}
+
+/*!
+	Displays the received GroupValue_Write telegrams
+*/
+void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	static uint8_t data[KDRIVE_MAX_GROUP_VALUE_LEN];
+	uint32_t data_len = KDRIVE_MAX_GROUP_VALUE_LEN;
+	uint16_t address = 0;
+
+	if (kdrive_ap_is_group_write(telegram, telegram_len) &&
+	    (kdrive_ap_get_dest(telegram, telegram_len, &address) == KDRIVE_ERROR_NONE) &&
+	    (kdrive_ap_get_group_data(telegram, telegram_len, data, &data_len) == KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "A_GroupValue_Write: 0x%04x ", address);
+		kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "A_GroupValue_Write Data :", data, data_len);
+	}
+}
@@ -0,0 +1,581 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	An access port uses one tunneling connection, and a tunneling
+	connection has only one outstanding request (it waits for the
+	TUNNELING_ACK before it sends the next telegram).
+
+	Most KNX IP Interfaces offer several tunneling connections
+	(see kdrive_ap_get_additional_ind_addr). This sample opens a pool of
+	access ports to the same interface, one tunnel each, and spreads
+	the outbound telegrams over the tunnels. Each tunnel has its own
+	sender thread and queue. The tunnel is selected by the destination
+	address, so telegrams for the same address stay in order.
+
+	Each tunnel receives every telegram from the bus, so the received
+	telegrams are deduplicated before they are passed to the application:
+	a telegram is a duplicate when the same frame was received on another
+	tunnel within POOL_DEDUP_WINDOW ms. A frame received twice on the same
+	tunnel is a new telegram.
+
+	Start the sample with the argument "bench" to compare the send
+	throughput of one tunnel with the throughput of the pool.
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_ip_tunnel_pool kdrive_express_ip_tunnel_pool.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define MAX_TELEGRAM_LEN		(64)	/*!< max telegram buffer size */
+#define POOL_MAX_TUNNELS		(8)		/*!< max number of tunnels in the pool */
+#define POOL_QUEUE_SIZE			(128)	/*!< capacity of the send queue of each tunnel */
+#define POOL_DEDUP_ENTRIES		(256)	/*!< size of the deduplication table (power of 2) */
+#define POOL_DEDUP_WINDOW		(200)	/*!< deduplication time window in ms */
+#define BENCH_TELEGRAMS			(500)	/*!< number of telegrams sent per benchmark run */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	A queued GroupValue_Write
+*/
+typedef struct pool_write_t
+{
+	uint16_t address;
+	uint8_t value[KDRIVE_MAX_GROUP_VALUE_LEN];
+	uint32_t bits;
+
+} pool_write_t;
+
+/*!
+	A tunnel of the pool: an access port with its sender thread
+*/
+typedef struct pool_tunnel_t
+{
+	int32_t ap; /*!< the access port descriptor */
+	uint32_t key; /*!< the telegram callback key */
+	uint16_t ind_addr; /*!< the individual address of the tunnel */
+	uint32_t index; /*!< the index in the pool */
+	pthread_t thread; /*!< the sender thread */
+	pthread_mutex_t mutex; /*!< protects the queue */
+	pthread_cond_t not_empty;
+	pthread_cond_t idle; /*!< signaled when the queue is empty and no telegram is in flight */
+	pthread_cond_t not_full;
+	pool_write_t queue[POOL_QUEUE_SIZE];
+	uint32_t head;
+	uint32_t count;
+	bool_t busy; /*!< 1 while a telegram is in flight */
+	uint32_t sent; /*!< number of sent telegrams */
+	uint32_t errors; /*!< number of failed sends */
+	bool_t stop;
+	struct tunnel_pool_t* pool;
+
+} pool_tunnel_t;
+
+/*!
+	An entry of the deduplication table
+*/
+typedef struct dedup_entry_t
+{
+	uint32_t hash; /*!< hash of the frame, 0 if unused */
+	uint32_t timestamp; /*!< time of the first reception in ms */
+	uint32_t tunnels; /*!< bit mask of the tunnels which received the frame */
+
+} dedup_entry_t;
+
+/*!
+	A pool of tunneling connections to the same interface
+*/
+typedef struct tunnel_pool_t
+{
+	pool_tunnel_t tunnels[POOL_MAX_TUNNELS];
+	uint32_t tunnel_count;
+	uint32_t active_count; /*!< number of tunnels used for sending */
+	kdrive_ap_telegram_callback callback; /*!< the application telegram callback */
+	void* user_data;
+	pthread_mutex_t dedup_mutex;
+	dedup_entry_t dedup[POOL_DEDUP_ENTRIES];
+	uint32_t duplicates; /*!< number of suppressed duplicates */
+
+} tunnel_pool_t;
+
+/*!
+	Passed as user data to the telegram callback of a tunnel
+*/
+typedef struct pool_receiver_t
+{
+	tunnel_pool_t* pool;
+	uint32_t index;
+
+} pool_receiver_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Opens up to tunnel_count tunnels to the interface.
+	Stops when the interface has no more free tunneling connections.
+	Returns the number of opened tunnels, 0 on error.
+*/
+static uint32_t pool_open(tunnel_pool_t* pool, const char* ip_address, uint32_t tunnel_count,
+                          kdrive_ap_telegram_callback c, void* user_data);
+
+/*!
+	Waits until all queued telegrams are sent and closes the tunnels
+*/
+static void pool_close(tunnel_pool_t* pool);
+
+/*!
+	Queues a GroupValue_Write on the tunnel selected by the destination address.
+	Waits when the queue of the tunnel is full.
+*/
+static error_t pool_group_write(tunnel_pool_t* pool, uint16_t address, const uint8_t* value, uint32_t bits);
+
+/*!
+	Waits until all queued telegrams are sent
+*/
+static void pool_flush(tunnel_pool_t* pool);
+
+/*!
+	The sender thread of a tunnel
+*/
+static void* pool_sender(void* arg);
+
+/*!
+	The telegram callback of the tunnels
+*/
+static void on_pool_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Returns 1 if the frame was already received on another tunnel
+*/
+static bool_t pool_is_duplicate(tunnel_pool_t* pool, uint32_t index, const uint8_t* telegram, uint32_t telegram_len);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Sends BENCH_TELEGRAMS telegrams with 1 tunnel and with all tunnels
+*/
+static void run_benchmark(tunnel_pool_t* pool);
+
+/*!
+	Telegram Callback Handler
+*/
+static void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static tunnel_pool_t pool;
+static pool_receiver_t receivers[POOL_MAX_TUNNELS];
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	uint8_t value = 1;
+	uint32_t tunnel_count = 0;
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	/*
+		Open up to 4 tunneling connections with a specific IP Interface,
+		you will probably have to change the IP address
+	*/
+	tunnel_count = pool_open(&pool, "192.168.1.45", 4, &on_telegram, NULL);
+	if (tunnel_count > 0)
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Opened %u tunnel(s)", tunnel_count);
+
+		if ((argc > 1) && (strcmp(argv[1], "bench") == 0))
+		{
+			run_benchmark(&pool);
+		}
+		else
+		{
+			/* send a 1-Bit boolean GroupValueWrite telegram: on */
+			pool_group_write(&pool, 0x901, &value, 1);
+
+			kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Press [Enter] to exit the application ...");
+			getchar();
+		}
+
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Suppressed duplicates: %u", pool.duplicates);
+	}
+
+	pool_close(&pool);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+uint32_t pool_open(tunnel_pool_t* pool, const char* ip_address, uint32_t tunnel_count,
+                   kdrive_ap_telegram_callback c, void* user_data)
+{
+	pool_tunnel_t* tunnel = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	memset(pool, 0, sizeof(tunnel_pool_t));
+	pool->callback = c;
+	pool->user_data = user_data;
+	pthread_mutex_init(&pool->dedup_mutex, NULL);
+
+	if (tunnel_count > POOL_MAX_TUNNELS)
+	{
+		tunnel_count = POOL_MAX_TUNNELS;
+	}
+
+	while (pool->tunnel_count < tunnel_count)
+	{
+		tunnel = &pool->tunnels[pool->tunnel_count];
+		tunnel->pool = pool;
+		tunnel->index = pool->tunnel_count;
+		tunnel->ap = kdrive_ap_create();
+		if (tunnel->ap == KDRIVE_INVALID_DESCRIPTOR)
+		{
+			break;
+		}
+
+		e = kdrive_ap_open_ip(tunnel->ap, ip_address);
+		if (e != KDRIVE_ERROR_NONE)
+		{
+			/* KDRIVE_AP_NO_MORE_CONNECTIONS_ERROR: all tunnels of the interface are in use */
+			kdrive_ap_release(tunnel->ap);
+			break;
+		}
+
+		kdrive_ap_get_tunnel_ind_addr(tunnel->ap, &tunnel->ind_addr);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Tunnel %u: individual address 0x%04X",
+		                 tunnel->index, tunnel->ind_addr);
+
+		pthread_mutex_init(&tunnel->mutex, NULL);
+		pthread_cond_init(&tunnel->not_empty, NULL);
+		pthread_cond_init(&tunnel->not_full, NULL);
+		pthread_cond_init(&tunnel->idle, NULL);
+
+		if (pthread_create(&tunnel->thread, NULL, &pool_sender, tunnel) != 0)
+		{
+			kdrive_ap_close(tunnel->ap);
+			kdrive_ap_release(tunnel->ap);
+			break;
+		}
+
+		receivers[tunnel->index].pool = pool;
+		receivers[tunnel->index].index = tunnel->index;
+		kdrive_ap_register_telegram_callback(tunnel->ap, &on_pool_telegram, &receivers[tunnel->index], &tunnel->key);
+
+		++pool->tunnel_count;
+	}
+
+	pool->active_count = pool->tunnel_count;
+
+	return pool->tunnel_count;
+}
+
+void pool_close(tunnel_pool_t* pool)
+{
+	uint32_t index = 0;
+	pool_tunnel_t* tunnel = 0;
+
+	pool_flush(pool);
+
+	for (index = 0; index < pool->tunnel_count; ++index)
+	{
+		tunnel = &pool->tunnels[index];
+
+		pthread_mutex_lock(&tunnel->mutex);
+		tunnel->stop = 1;
+		pthread_cond_signal(&tunnel->not_empty);
+		pthread_mutex_unlock(&tunnel->mutex);
+		pthread_join(tunnel->thread, NULL);
+
+		kdrive_ap_remove_telegram_callback(tunnel->ap, tunnel->key);
+		kdrive_ap_close(tunnel->ap);
+		kdrive_ap_release(tunnel->ap);
+	}
+
+	pool->tunnel_count = 0;
+}
+
+error_t pool_group_write(tunnel_pool_t* pool, uint16_t address, const uint8_t* value, uint32_t bits)
+{
+	pool_tunnel_t* tunnel = 0;
+	pool_write_t* write = 0;
+
+	if (pool->active_count == 0)
+	{
+		return KDRIVE_AP_PORT_NOT_OPEN_ERROR;
+	}
+	if (bits > KDRIVE_BITS(KDRIVE_MAX_GROUP_VALUE_LEN))
+	{
+		return KDRIVE_BUFFER_TOO_SMALL_ERROR;
+	}
+
+	tunnel = &pool->tunnels[(((uint32_t) address * 2654435761u) >> 16) % pool->active_count];
+
+	pthread_mutex_lock(&tunnel->mutex);
+
+	while (tunnel->count == POOL_QUEUE_SIZE)
+	{
+		pthread_cond_wait(&tunnel->not_full, &tunnel->mutex);
+	}
+
+	write = &tunnel->queue[(tunnel->head + tunnel->count) % POOL_QUEUE_SIZE];
+	write->address = address;
+	write->bits = bits;
+	memcpy(write->value, value, (bits + 7) / 8);
+	++tunnel->count;
+
+	pthread_cond_signal(&tunnel->not_empty);
+	pthread_mutex_unlock(&tunnel->mutex);
+
+	return KDRIVE_ERROR_NONE;
+}
+
+void pool_flush(tunnel_pool_t* pool)
+{
+	uint32_t index = 0;
+	pool_tunnel_t* tunnel = 0;
+
+	for (index = 0; index < pool->tunnel_count; ++index)
+	{
+		tunnel = &pool->tunnels[index];
+		pthread_mutex_lock(&tunnel->mutex);
+		while ((tunnel->count > 0) || tunnel->busy)
+		{
+			pthread_cond_wait(&tunnel->idle, &tunnel->mutex);
+		}
+		pthread_mutex_unlock(&tunnel->mutex);
+	}
+}
+
+void* pool_sender(void* arg)
+{
+	pool_tunnel_t* tunnel = (pool_tunnel_t*) arg;
+	pool_write_t write;
+
+	pthread_mutex_lock(&tunnel->mutex);
+
+	while (1)
+	{
+		if (tunnel->count == 0)
+		{
+			pthread_cond_broadcast(&tunnel->idle);
+			if (tunnel->stop)
+			{
+				break;
+			}
+			pthread_cond_wait(&tunnel->not_empty, &tunnel->mutex);
+			continue;
+		}
+
+		write = tunnel->queue[tunnel->head];
+		tunnel->head = (tunnel->head + 1) % POOL_QUEUE_SIZE;
+		--tunnel->count;
+		tunnel->busy = 1;
+		pthread_cond_signal(&tunnel->not_full);
+		pthread_mutex_unlock(&tunnel->mutex);
+
+		/* blocks until the interface acknowledged the tunneling request */
+		if (kdrive_ap_group_write(tunnel->ap, write.address, write.value, write.bits) == KDRIVE_ERROR_NONE)
+		{
+			++tunnel->sent;
+		}
+		else
+		{
+			++tunnel->errors;
+		}
+
+		pthread_mutex_lock(&tunnel->mutex);
+		tunnel->busy = 0;
+	}
+
+	pthread_mutex_unlock(&tunnel->mutex);
+
+	return NULL;
+}
+
+void on_pool_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	pool_receiver_t* receiver = (pool_receiver_t*) user_data;
+	tunnel_pool_t* pool = receiver->pool;
+
+	if (!pool_is_duplicate(pool, receiver->index, telegram, telegram_len) && pool->callback)
+	{
+		pool->callback(telegram, telegram_len, pool->user_data);
+	}
+}
+
+/*!
+	The frame is hashed without the additional info (i.e. time stamps
+	differ between the tunnels) and without the repeat flag.
+	The first tunnel which receives a frame delivers it. The same frame
+	on another tunnel within the window is a duplicate. The same frame
+	again on a tunnel which already delivered it is a new telegram.
+*/
+bool_t pool_is_duplicate(tunnel_pool_t* pool, uint32_t index, const uint8_t* telegram, uint32_t telegram_len)
+{
+	dedup_entry_t* entry = 0;
+	uint32_t hash = 2166136261u;
+	uint32_t offset = 0;
+	uint32_t now = now_ms();
+	uint32_t mask = 1u << index;
+	uint8_t octet = 0;
+	bool_t duplicate = 0;
+
+	/* cEMI: message code, additional info length, additional info, control field 1, ... */
+	if ((telegram_len < 2) || (telegram_len > MAX_TELEGRAM_LEN) || ((uint32_t) telegram[1] + 2 >= telegram_len))
+	{
+		return 0;
+	}
+
+	hash = (hash ^ telegram[0]) * 16777619u;
+	for (offset = (uint32_t) telegram[1] + 2; offset < telegram_len; ++offset)
+	{
+		octet = telegram[offset];
+		if (offset == (uint32_t) telegram[1] + 2)
+		{
+			octet &= (uint8_t) ~0x20; /* repeat flag */
+		}
+		hash = (hash ^ octet) * 16777619u;
+	}
+	if (hash == 0)
+	{
+		hash = 1;
+	}
+
+	pthread_mutex_lock(&pool->dedup_mutex);
+
+	entry = &pool->dedup[hash & (POOL_DEDUP_ENTRIES - 1)];
+	if ((entry->hash == hash) && ((now - entry->timestamp) < POOL_DEDUP_WINDOW) && !(entry->tunnels & mask))
+	{
+		entry->tunnels |= mask;
+		++pool->duplicates;
+		duplicate = 1;
+	}
+	else
+	{
+		entry->hash = hash;
+		entry->timestamp = now;
+		entry->tunnels = mask;
+	}
+
+	pthread_mutex_unlock(&pool->dedup_mutex);
+
+	return duplicate;
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000u) + ((uint32_t) ts.tv_nsec / 1000000u);
+}
+
+/*!
+	The benchmark writes to 64 different group addresses,
+	first with one tunnel and then with all tunnels of the pool.
+*/
+void run_benchmark(tunnel_pool_t* pool)
+{
+	uint32_t runs[2] = { 1, pool->tunnel_count };
+	uint32_t run = 0;
+	uint32_t index = 0;
+	uint32_t start = 0;
+	uint32_t elapsed = 0;
+	uint8_t value = 0;
+
+	for (run = 0; run < ((pool->tunnel_count > 1) ? 2 : 1); ++run)
+	{
+		pool->active_count = runs[run];
+		start = now_ms();
+
+		for (index = 0; index < BENCH_TELEGRAMS; ++index)
+		{
+			value = (uint8_t)(index & 1);
+			pool_group_write(pool, (uint16_t)(0x0900 + (index % 64)), &value, 1);
+		}
+		pool_flush(pool);
+
+		elapsed = now_ms() - start;
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u tunnel(s): %u telegrams in %u ms (%.1f telegrams/s)",
+		                 runs[run], BENCH_TELEGRAMS, elapsed, (elapsed > 0) ? (BENCH_TELEGRAMS * 1000.0 / elapsed) : 0.0);
+	}
+
+	pool->active_count = pool->tunnel_count;
+}
+
+/*!
+	Called once per telegram, regardless of the number of tunnels
+*/
+void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	uint16_t address = 0;
+
+	if (kdrive_ap_is_group_write(telegram, telegram_len) &&
+	    (kdrive_ap_get_dest(telegram, telegram_len, &address) == KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "A_GroupValue_Write: 0x%04x ", address);
+	}
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
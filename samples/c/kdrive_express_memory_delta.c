@@ -0,0 +1,382 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Writes a memory region of a device, but only the octets which changed.
+
+	kdrive_sp_memory_write writes and verifies every chunk of a region,
+	even when only a few parameters changed. memory_delta_write reads the
+	current contents with kdrive_sp_memory_block_read, computes the
+	changed ranges and writes only those with
+	kdrive_sp_memory_write_without_verify. Two ranges are merged when the
+	merged range needs fewer telegrams, i.e. when the gap between them is
+	smaller than the overhead of a telegram. At the end the written span
+	is read back once with kdrive_sp_memory_block_read and compared.
+
+	The sample changes two octets of a parameter block, writes them
+	and restores the original contents.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define MAX_REGION_LEN			(1024)	/*!< max size of a region */
+#define MAX_RANGES				(64)	/*!< max number of changed ranges */
+#define MAX_BLOCK_READ_LEN		(255)	/*!< the number of kdrive_sp_memory_block_read is 8 bits */
+#define MEMORY_APDU_HEADER_LEN	(3)		/*!< APCI with number (2) and memory address (2), minus the TPCI octet */
+#define MEMORY_MAX_CHUNK_LEN	(63)	/*!< the number field of A_Memory_Write is 6 bits */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	A range of changed octets, relative to the region start
+*/
+typedef struct delta_range_t
+{
+	uint32_t offset;
+	uint32_t length;
+
+} delta_range_t;
+
+/*!
+	Statistics of a delta write
+*/
+typedef struct delta_stats_t
+{
+	uint32_t changed; /*!< number of changed octets */
+	uint32_t ranges; /*!< number of written ranges, after merging */
+	uint32_t written; /*!< number of written octets, including merged gaps */
+	uint32_t telegrams; /*!< number of A_Memory_Write telegrams */
+	uint32_t full_telegrams; /*!< number of telegrams to write the whole region */
+
+} delta_stats_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Writes length octets of data to the device memory at memory_addr,
+	only the octets which differ from the current contents are written.
+	Returns KDRIVE_SP_DEVICE_ERROR if the verification read doesn't match.
+*/
+static error_t memory_delta_write(int32_t sp, uint16_t ind_addr, uint16_t memory_addr,
+                                  const uint8_t data[], uint32_t length, delta_stats_t* stats);
+
+/*!
+	Reads length octets from the device memory with kdrive_sp_memory_block_read
+*/
+static error_t memory_region_read(int32_t sp, uint16_t ind_addr, uint16_t memory_addr,
+                                  uint8_t data[], uint32_t length);
+
+/*!
+	Computes the merged changed ranges of current and data.
+	Returns the number of ranges, MAX_RANGES + 1 if there are too many.
+*/
+static uint32_t delta_ranges(const uint8_t current[], const uint8_t data[], uint32_t length,
+                             uint32_t chunk_len, delta_range_t ranges[], uint32_t* changed);
+
+/*!
+	Returns the number of telegrams to write length octets
+*/
+static uint32_t telegram_count(uint32_t length, uint32_t chunk_len);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+/*!
+	The address of the device and the
+	parameter block we modify
+*/
+static uint16_t address = 0x5102;
+static uint16_t region_addr = 0x4400;
+static uint32_t region_len = 128;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+	int32_t sp = KDRIVE_INVALID_DESCRIPTOR;
+	uint8_t original[MAX_REGION_LEN];
+	uint8_t modified[MAX_REGION_LEN];
+	delta_stats_t stats;
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	ap = kdrive_ap_create();
+	if ((ap == KDRIVE_INVALID_DESCRIPTOR) ||
+	    (kdrive_ap_enum_usb(ap) == 0) ||
+	    (kdrive_ap_open_usb(ap, 0) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the access port");
+		kdrive_ap_release(ap);
+		return -1;
+	}
+
+	sp = kdrive_sp_create(ap);
+	kdrive_sp_set_co(sp, 1);
+
+	if (memory_region_read(sp, address, region_addr, original, region_len) == KDRIVE_ERROR_NONE)
+	{
+		/* change two parameters */
+		memcpy(modified, original, region_len);
+		modified[5] ^= 0x01;
+		modified[9] ^= 0x80;
+
+		if (memory_delta_write(sp, address, region_addr, modified, region_len, &stats) == KDRIVE_ERROR_NONE)
+		{
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION,
+			                 "%u octets changed: %u range(s), %u octets in %u telegram(s) instead of %u",
+			                 stats.changed, stats.ranges, stats.written, stats.telegrams, stats.full_telegrams);
+		}
+
+		/* and restore them */
+		memory_delta_write(sp, address, region_addr, original, region_len, &stats);
+	}
+
+	kdrive_sp_release(sp);
+	kdrive_ap_close(ap);
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+error_t memory_delta_write(int32_t sp, uint16_t ind_addr, uint16_t memory_addr,
+                           const uint8_t data[], uint32_t length, delta_stats_t* stats)
+{
+	uint8_t current[MAX_REGION_LEN];
+	uint8_t response[MEMORY_MAX_CHUNK_LEN];
+	uint32_t response_length = 0;
+	delta_range_t ranges[MAX_RANGES + 1];
+	uint32_t range_count = 0;
+	uint32_t apdu_length = 0;
+	uint32_t chunk_len = 0;
+	uint32_t index = 0;
+	uint32_t position = 0;
+	uint32_t chunk = 0;
+	uint32_t first = 0;
+	uint32_t last = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	memset(stats, 0, sizeof(delta_stats_t));
+
+	if ((length == 0) || (length > MAX_REGION_LEN) || ((uint32_t) memory_addr + length > 0x10000))
+	{
+		return KDRIVE_SP_INVALID_INPUT_PARAMETER_ERROR;
+	}
+
+	if ((kdrive_sp_get_max_apdu_length(sp, &apdu_length) != KDRIVE_ERROR_NONE) ||
+	    (apdu_length <= MEMORY_APDU_HEADER_LEN))
+	{
+		apdu_length = 15;
+	}
+	chunk_len = apdu_length - MEMORY_APDU_HEADER_LEN;
+	if (chunk_len > MEMORY_MAX_CHUNK_LEN)
+	{
+		chunk_len = MEMORY_MAX_CHUNK_LEN;
+	}
+	stats->full_telegrams = telegram_count(length, chunk_len);
+
+	e = memory_region_read(sp, ind_addr, memory_addr, current, length);
+	if (e != KDRIVE_ERROR_NONE)
+	{
+		return e;
+	}
+
+	range_count = delta_ranges(current, data, length, chunk_len, ranges, &stats->changed);
+	if (range_count > MAX_RANGES)
+	{
+		/* scattered changes, write the whole region */
+		ranges[0].offset = 0;
+		ranges[0].length = length;
+		range_count = 1;
+	}
+	if (range_count == 0)
+	{
+		return KDRIVE_ERROR_NONE;
+	}
+
+	for (index = 0; (index < range_count) && (e == KDRIVE_ERROR_NONE); ++index)
+	{
+		for (position = 0; (position < ranges[index].length) && (e == KDRIVE_ERROR_NONE); position += chunk)
+		{
+			chunk = ranges[index].length - position;
+			if (chunk > chunk_len)
+			{
+				chunk = chunk_len;
+			}
+
+			response_length = sizeof(response);
+			e = kdrive_sp_memory_write_without_verify(sp, ind_addr,
+			        (uint16_t)(memory_addr + ranges[index].offset + position),
+			        &data[ranges[index].offset + position], chunk, response, &response_length);
+			++stats->telegrams;
+		}
+		stats->written += ranges[index].length;
+	}
+	stats->ranges = range_count;
+
+	if (e == KDRIVE_ERROR_NONE)
+	{
+		/* one read over the written span verifies all ranges */
+		first = ranges[0].offset;
+		last = ranges[range_count - 1].offset + ranges[range_count - 1].length;
+		e = memory_region_read(sp, ind_addr, (uint16_t)(memory_addr + first), &current[first], last - first);
+		if ((e == KDRIVE_ERROR_NONE) && (memcmp(&current[first], &data[first], last - first) != 0))
+		{
+			e = KDRIVE_SP_DEVICE_ERROR;
+		}
+	}
+
+	return e;
+}
+
+/*!
+	A block read can return less than requested
+	(i.e. at the end of a valid memory block),
+	we continue with the remaining octets.
+*/
+error_t memory_region_read(int32_t sp, uint16_t ind_addr, uint16_t memory_addr,
+                           uint8_t data[], uint32_t length)
+{
+	uint32_t position = 0;
+	uint32_t number = 0;
+	uint32_t data_length = 0;
+	uint16_t block_addr = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	while ((position < length) && (e == KDRIVE_ERROR_NONE))
+	{
+		number = length - position;
+		if (number > MAX_BLOCK_READ_LEN)
+		{
+			number = MAX_BLOCK_READ_LEN;
+		}
+
+		block_addr = (uint16_t)(memory_addr + position);
+		data_length = number;
+		e = kdrive_sp_memory_block_read(sp, ind_addr, &block_addr, (uint8_t) number, &data[position], &data_length);
+
+		if ((e == KDRIVE_ERROR_NONE) &&
+		    ((data_length == 0) || (block_addr != (uint16_t)(memory_addr + position))))
+		{
+			/* the memory at the requested address is not valid */
+			e = KDRIVE_SP_DEVICE_ERROR;
+		}
+
+		position += data_length;
+	}
+
+	return e;
+}
+
+/*!
+	Two ranges are merged when the merged range is written
+	with fewer telegrams than the two separate ranges.
+*/
+uint32_t delta_ranges(const uint8_t current[], const uint8_t data[], uint32_t length,
+                      uint32_t chunk_len, delta_range_t ranges[], uint32_t* changed)
+{
+	delta_range_t* previous = 0;
+	uint32_t count = 0;
+	uint32_t offset = 0;
+	uint32_t end = 0;
+	uint32_t merged = 0;
+
+	*changed = 0;
+
+	while (offset < length)
+	{
+		if (current[offset] == data[offset])
+		{
+			++offset;
+			continue;
+		}
+
+		end = offset;
+		while ((end < length) && (current[end] != data[end]))
+		{
+			++end;
+		}
+		*changed += end - offset;
+
+		previous = (count > 0) ? &ranges[count - 1] : 0;
+		merged = end - (previous ? previous->offset : 0);
+		if (previous &&
+		    (telegram_count(merged, chunk_len) <
+		     telegram_count(previous->length, chunk_len) + telegram_count(end - offset, chunk_len)))
+		{
+			previous->length = merged;
+		}
+		else
+		{
+			if (count == MAX_RANGES)
+			{
+				return MAX_RANGES + 1;
+			}
+			ranges[count].offset = offset;
+			ranges[count].length = end - offset;
+			++count;
+		}
+
+		offset = end;
+	}
+
+	return count;
+}
+
+uint32_t telegram_count(uint32_t length, uint32_t chunk_len)
+{
+	return (length + chunk_len - 1) / chunk_len;
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
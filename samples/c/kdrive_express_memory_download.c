@@ -0,0 +1,430 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Downloads an application image into the memory of a device.
+
+	kdrive_sp_memory_write moves one buffer with one A_Memory_Write, with
+	the default maximum APDU length of 15 that is 12 octets per telegram.
+	The transport layer connection has a window of one telegram (each
+	T_Data_Connected is acknowledged before the next is sent), so the
+	download time is the number of telegrams times the round trip time.
+	This sample reduces the number of telegrams:
+
+	- The chunk size follows the maximum APDU length supported by both
+	  the interface (kdrive_ap_get_max_apdu_length) and the device
+	  (PID_MAX_APDU_LENGTH), so long frames carry up to 63 octets.
+	- Segments can be compared with the device memory first. Chunks
+	  which already match are not written.
+	- The chunks are written with kdrive_sp_memory_write_without_verify,
+	  only segments marked for verification are read back.
+
+	A progress callback is called after each chunk.
+
+	Start the sample with the image file and the start address in the
+	device, i.e. kdrive_express_memory_download app.bin 4000
+	Add "bench" to download the image with the standard and the long
+	APDU length and again with the unchanged chunks skipped.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN			(128)	/*!< kdriveExpress Error Messages */
+#define MAX_IMAGE_LEN				(0x10000)	/*!< max size of an application image */
+#define STANDARD_APDU_LEN			(15)	/*!< max APDU length of a standard frame */
+#define MEMORY_APDU_HEADER_LEN		(3)		/*!< APCI with number (2) and memory address (2), minus the TPCI octet */
+#define MEMORY_MAX_CHUNK_LEN		(63)	/*!< the number field of A_Memory_Write is 6 bits */
+#define PID_MAX_APDU_LENGTH			(56)	/*!< device object property: max APDU length */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	A contiguous range of the image which is written to the device memory
+*/
+typedef struct memory_segment_t
+{
+	uint16_t memory_addr; /*!< start address in the device memory */
+	uint32_t offset; /*!< start offset in the image */
+	uint32_t length; /*!< number of octets */
+	bool_t skip_unchanged; /*!< compare with the device memory and only write the changed chunks */
+	bool_t verify; /*!< read back the written chunks */
+
+} memory_segment_t;
+
+/*!
+	Called after each chunk with the number of processed and total octets
+*/
+typedef void (*download_progress_callback)(uint32_t done, uint32_t total, void* user_data);
+
+/*!
+	Statistics of a download
+*/
+typedef struct download_stats_t
+{
+	uint32_t chunk_len; /*!< the used chunk size */
+	uint32_t written; /*!< number of written chunks */
+	uint32_t skipped; /*!< number of chunks which already matched */
+	uint32_t verified; /*!< number of chunks read back */
+	uint32_t elapsed; /*!< time in ms */
+
+} download_stats_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Downloads the segments of image to the device ind_addr.
+	The chunk size is derived from the max APDU length of the access port ap
+	and of the device, max_apdu_length limits it further (0: no limit).
+	Returns KDRIVE_ERROR_NONE or the error of the first failed chunk,
+	KDRIVE_SP_DEVICE_ERROR if a read back didn't match.
+*/
+static error_t memory_download(int32_t ap, int32_t sp, uint16_t ind_addr, const uint8_t image[],
+                               const memory_segment_t segments[], uint32_t segment_count,
+                               uint32_t max_apdu_length, download_progress_callback c, void* user_data,
+                               download_stats_t* stats);
+
+/*!
+	Returns the max APDU length supported by the interface and the device
+*/
+static uint32_t get_max_apdu_length(int32_t ap, int32_t sp, uint16_t ind_addr);
+
+/*!
+	Reads length octets of the device memory in one A_Memory_Read
+*/
+static error_t read_chunk(int32_t sp, uint16_t ind_addr, uint16_t memory_addr, uint8_t data[], uint32_t length);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Runs the download with different options and prints the times
+*/
+static void run_benchmark(int32_t ap, int32_t sp, const uint8_t image[], memory_segment_t* segment);
+
+/*!
+	Prints the progress in 10% steps
+*/
+static void on_progress(uint32_t done, uint32_t total, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+/*!
+	The address of the device that we download to
+*/
+static uint16_t address = 0x5102;
+
+static uint8_t image[MAX_IMAGE_LEN];
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+	int32_t sp = KDRIVE_INVALID_DESCRIPTOR;
+	memory_segment_t segment;
+	download_stats_t stats;
+	FILE* file = 0;
+	unsigned int memory_addr = 0;
+	size_t image_len = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	if ((argc < 3) || (sscanf(argv[2], "%x", &memory_addr) != 1) || (memory_addr > 0xFFFF))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Usage: kdrive_express_memory_download <image file> <hex address> [bench]");
+		return -1;
+	}
+
+	file = fopen(argv[1], "rb");
+	if (!file)
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "Unable to open %s", argv[1]);
+		return -1;
+	}
+	image_len = fread(image, 1, sizeof(image), file);
+	fclose(file);
+
+	if ((image_len == 0) || (memory_addr + image_len > 0x10000))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "The image doesn't fit into the device memory");
+		return -1;
+	}
+
+	ap = kdrive_ap_create();
+	if ((ap == KDRIVE_INVALID_DESCRIPTOR) ||
+	    (kdrive_ap_enum_usb(ap) == 0) ||
+	    (kdrive_ap_open_usb(ap, 0) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the access port");
+		kdrive_ap_release(ap);
+		return -1;
+	}
+
+	sp = kdrive_sp_create(ap);
+	kdrive_sp_set_co(sp, 1);
+
+	segment.memory_addr = (uint16_t) memory_addr;
+	segment.offset = 0;
+	segment.length = (uint32_t) image_len;
+	segment.skip_unchanged = 1;
+	segment.verify = 1;
+
+	if ((argc > 3) && (strcmp(argv[3], "bench") == 0))
+	{
+		run_benchmark(ap, sp, image, &segment);
+	}
+	else
+	{
+		e = memory_download(ap, sp, address, image, &segment, 1, 0, &on_progress, NULL, &stats);
+		if (e == KDRIVE_ERROR_NONE)
+		{
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION,
+			                 "Downloaded %u octets in %u ms: %u chunks of %u octets written, %u skipped, %u verified",
+			                 segment.length, stats.elapsed, stats.written, stats.chunk_len, stats.skipped, stats.verified);
+		}
+	}
+
+	kdrive_sp_release(sp);
+	kdrive_ap_close(ap);
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+error_t memory_download(int32_t ap, int32_t sp, uint16_t ind_addr, const uint8_t image[],
+                        const memory_segment_t segments[], uint32_t segment_count,
+                        uint32_t max_apdu_length, download_progress_callback c, void* user_data,
+                        download_stats_t* stats)
+{
+	const memory_segment_t* segment = 0;
+	uint8_t data[MEMORY_MAX_CHUNK_LEN];
+	uint8_t response[MEMORY_MAX_CHUNK_LEN];
+	uint32_t response_length = 0;
+	uint32_t apdu_length = get_max_apdu_length(ap, sp, ind_addr);
+	uint32_t chunk_len = 0;
+	uint32_t total = 0;
+	uint32_t done = 0;
+	uint32_t index = 0;
+	uint32_t position = 0;
+	uint32_t length = 0;
+	uint32_t start = now_ms();
+	uint16_t memory_addr = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	memset(stats, 0, sizeof(download_stats_t));
+
+	if ((max_apdu_length > 0) && (max_apdu_length < apdu_length))
+	{
+		apdu_length = max_apdu_length;
+	}
+	kdrive_sp_set_max_apdu_length(sp, apdu_length);
+
+	chunk_len = apdu_length - MEMORY_APDU_HEADER_LEN;
+	if (chunk_len > MEMORY_MAX_CHUNK_LEN)
+	{
+		chunk_len = MEMORY_MAX_CHUNK_LEN;
+	}
+	stats->chunk_len = chunk_len;
+
+	for (index = 0; index < segment_count; ++index)
+	{
+		total += segments[index].length;
+	}
+
+	for (index = 0; (index < segment_count) && (e == KDRIVE_ERROR_NONE); ++index)
+	{
+		segment = &segments[index];
+
+		for (position = 0; (position < segment->length) && (e == KDRIVE_ERROR_NONE); position += length)
+		{
+			length = segment->length - position;
+			if (length > chunk_len)
+			{
+				length = chunk_len;
+			}
+			memory_addr = (uint16_t)(segment->memory_addr + position);
+
+			if (segment->skip_unchanged &&
+			    (read_chunk(sp, ind_addr, memory_addr, data, length) == KDRIVE_ERROR_NONE) &&
+			    (memcmp(data, &image[segment->offset + position], length) == 0))
+			{
+				++stats->skipped;
+			}
+			else
+			{
+				response_length = sizeof(response);
+				e = kdrive_sp_memory_write_without_verify(sp, ind_addr, memory_addr,
+				        &image[segment->offset + position], length, response, &response_length);
+				if (e == KDRIVE_ERROR_NONE)
+				{
+					++stats->written;
+
+					if (segment->verify)
+					{
+						e = read_chunk(sp, ind_addr, memory_addr, data, length);
+						if ((e == KDRIVE_ERROR_NONE) && (memcmp(data, &image[segment->offset + position], length) != 0))
+						{
+							e = KDRIVE_SP_DEVICE_ERROR;
+						}
+						++stats->verified;
+					}
+				}
+			}
+
+			if (e == KDRIVE_ERROR_NONE)
+			{
+				done += length;
+				if (c)
+				{
+					c(done, total, user_data);
+				}
+			}
+		}
+	}
+
+	stats->elapsed = now_ms() - start;
+
+	return e;
+}
+
+/*!
+	PID_MAX_APDU_LENGTH is optional, devices without it
+	only support standard frames
+*/
+uint32_t get_max_apdu_length(int32_t ap, int32_t sp, uint16_t ind_addr)
+{
+	uint32_t interface_length = STANDARD_APDU_LEN;
+	uint32_t device_length = STANDARD_APDU_LEN;
+	uint8_t data[2];
+	uint32_t data_length = sizeof(data);
+
+	if (kdrive_ap_get_max_apdu_length(ap, &interface_length) != KDRIVE_ERROR_NONE)
+	{
+		interface_length = STANDARD_APDU_LEN;
+	}
+
+	kdrive_sp_set_max_apdu_length(sp, STANDARD_APDU_LEN);
+	if ((kdrive_sp_prop_value_read(sp, ind_addr, 0, PID_MAX_APDU_LENGTH, 1, 1, data, &data_length) == KDRIVE_ERROR_NONE) &&
+	    (data_length == 2))
+	{
+		device_length = ((uint32_t) data[0] << 8) | data[1];
+	}
+
+	if (device_length < interface_length)
+	{
+		interface_length = device_length;
+	}
+
+	return (interface_length < STANDARD_APDU_LEN) ? STANDARD_APDU_LEN : interface_length;
+}
+
+error_t read_chunk(int32_t sp, uint16_t ind_addr, uint16_t memory_addr, uint8_t data[], uint32_t length)
+{
+	uint32_t data_length = length;
+	error_t e = kdrive_sp_memory_read(sp, ind_addr, memory_addr, (uint8_t) length, data, &data_length);
+
+	return ((e == KDRIVE_ERROR_NONE) && (data_length != length)) ? KDRIVE_SP_DEVICE_ERROR : e;
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000u) + ((uint32_t) ts.tv_nsec / 1000000u);
+}
+
+/*!
+	The first two runs write every chunk, the third
+	run finds the image already in the device.
+*/
+void run_benchmark(int32_t ap, int32_t sp, const uint8_t image[], memory_segment_t* segment)
+{
+	download_stats_t stats;
+	uint32_t apdu_lengths[3] = { STANDARD_APDU_LEN, 0, 0 };
+	bool_t skip_unchanged[3] = { 0, 0, 1 };
+	uint32_t run = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	segment->verify = 0;
+
+	for (run = 0; run < 3; ++run)
+	{
+		segment->skip_unchanged = skip_unchanged[run];
+		e = memory_download(ap, sp, address, image, segment, 1, apdu_lengths[run], NULL, NULL, &stats);
+
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION,
+		                 "chunk %u octets%s: %u octets in %u ms (%u written, %u skipped)%s",
+		                 stats.chunk_len, skip_unchanged[run] ? ", skip unchanged" : "", segment->length,
+		                 stats.elapsed, stats.written, stats.skipped, (e == KDRIVE_ERROR_NONE) ? "" : " failed");
+	}
+}
+
+void on_progress(uint32_t done, uint32_t total, void* user_data)
+{
+	static uint32_t reported = 0;
+	uint32_t percent = (total > 0) ? (done * 100 / total) : 100;
+
+	if ((percent / 10 != reported / 10) || (done == total))
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Download %u%% (%u of %u octets)", percent, done, total);
+		reported = percent;
+	}
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
@@ -0,0 +1,644 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Programs a list of devices in parallel.
+
+	Each job runs the same sequence on one device:
+	  kdrive_sp_authorize_request
+	  kdrive_sp_load_state_write (start loading)
+	  kdrive_sp_memory_write (in chunks of the max APDU length)
+	  kdrive_sp_load_state_write (load completed)
+	  kdrive_sp_restart_device_type0
+
+	The jobs run on worker threads, each with its own service port. The
+	service ports are spread over the given access ports (one per
+	tunneling connection). The bus load is limited per line (the
+	individual address without the device part): at most
+	JOBS_PER_LINE jobs run on a line at the same time, and the service
+	calls of a line are at least line_gap ms apart. So the jobs of
+	different lines run in parallel, and the rollout time goes down with
+	the number of lines.
+
+	The progress (after each step) and the result of each job are
+	reported through callbacks, which are never called concurrently.
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_programming_jobs kdrive_express_programming_jobs.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define JOBS_MAX_PORTS			(8)		/*!< max number of access ports */
+#define JOBS_MAX_WORKERS		(32)	/*!< max number of concurrent service ports */
+#define JOBS_MAX_LINES			(256)	/*!< number of lines (area and line of the individual address) */
+#define JOBS_PER_LINE			(1)		/*!< max number of concurrent jobs per line */
+#define JOBS_LINE_GAP			(20)	/*!< default min. time in ms between two service calls on a line */
+#define MEMORY_APDU_HEADER_LEN	(3)		/*!< APCI with number (2) and memory address (2), minus the TPCI octet */
+#define MEMORY_MAX_CHUNK_LEN	(63)	/*!< the number field of A_Memory_Write is 6 bits */
+#define LOAD_EVENT_START		(1)		/*!< load event: start loading */
+#define LOAD_EVENT_COMPLETE		(2)		/*!< load event: load completed */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	The steps of a job, in order
+*/
+typedef enum job_step_t
+{
+	JOB_STEP_AUTHORIZE,
+	JOB_STEP_START_LOADING,
+	JOB_STEP_MEMORY_WRITE,
+	JOB_STEP_LOAD_COMPLETED,
+	JOB_STEP_RESTART,
+	JOB_STEP_DONE
+
+} job_step_t;
+
+/*!
+	The description of the programming of one device
+*/
+typedef struct programming_job_t
+{
+	uint16_t ind_addr; /*!< the device */
+	uint32_t key; /*!< the authorize key */
+	uint8_t object_index; /*!< the object of the load state (i.e. the application program object) */
+	uint16_t memory_addr; /*!< start address of the memory image */
+	const uint8_t* data; /*!< the memory image */
+	uint32_t data_length;
+
+} programming_job_t;
+
+/*!
+	Called after each step of a job, step is the completed step
+*/
+typedef void (*job_progress_callback)(uint32_t job, job_step_t step, void* user_data);
+
+/*!
+	Called when a job is finished, error is KDRIVE_ERROR_NONE
+	or the error of the failed step
+*/
+typedef void (*job_finished_callback)(uint32_t job, job_step_t step, error_t error, void* user_data);
+
+/*!
+	A worker with its own service port
+*/
+typedef struct job_worker_t
+{
+	pthread_t thread;
+	int32_t sp; /*!< the service port descriptor */
+	struct job_runner_t* runner;
+
+} job_worker_t;
+
+/*!
+	Runs a list of jobs
+*/
+typedef struct job_runner_t
+{
+	const programming_job_t* jobs;
+	uint32_t job_count;
+	bool_t* started; /*!< 1 for each job taken by a worker */
+	uint32_t finished; /*!< number of finished jobs */
+	uint32_t failed; /*!< number of failed jobs */
+	uint32_t line_gap; /*!< min. time in ms between two service calls on a line */
+	uint8_t line_jobs[JOBS_MAX_LINES]; /*!< number of running jobs per line */
+	uint32_t line_next[JOBS_MAX_LINES]; /*!< time in ms of the next allowed service call per line */
+	pthread_mutex_t mutex; /*!< protects the job and line state */
+	pthread_cond_t line_free; /*!< signaled when a job is finished */
+	pthread_mutex_t callback_mutex; /*!< serializes the callbacks */
+	job_progress_callback progress;
+	job_finished_callback finish;
+	void* user_data;
+	uint32_t worker_count;
+	job_worker_t workers[JOBS_MAX_WORKERS];
+
+} job_runner_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Runs the jobs with up to concurrency service ports, spread over the access ports aps.
+	line_gap is the min. time in ms between two service calls on a line (0: JOBS_LINE_GAP).
+	Returns when all jobs are finished. Returns the number of failed jobs.
+*/
+static uint32_t jobs_run(const int32_t aps[], uint32_t ap_count, uint32_t concurrency,
+                         const programming_job_t jobs[], uint32_t job_count, uint32_t line_gap,
+                         job_progress_callback progress, job_finished_callback finish, void* user_data);
+
+/*!
+	The worker thread
+*/
+static void* jobs_worker(void* arg);
+
+/*!
+	Takes the next job whose line has a free slot,
+	waits when all lines with pending jobs are busy.
+	Returns job_count when there are no more jobs.
+*/
+static uint32_t jobs_take(job_runner_t* runner);
+
+/*!
+	Runs the steps of a job
+*/
+static error_t jobs_execute(job_runner_t* runner, int32_t sp, uint32_t index, job_step_t* step);
+
+/*!
+	Waits until the next service call on the line of ind_addr is allowed
+*/
+static void jobs_throttle(job_runner_t* runner, uint16_t ind_addr);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Opens up to count tunneling connections to the interface.
+	Returns the number of opened tunnels.
+*/
+static uint32_t open_tunnels(const char* ip_address, int32_t aps[], uint32_t count);
+
+/*!
+	Prints the progress of the jobs
+*/
+static void on_progress(uint32_t job, job_step_t step, void* user_data);
+
+/*!
+	Prints the result of the jobs
+*/
+static void on_finished(uint32_t job, job_step_t step, error_t error, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static const char* step_names[] =
+{
+	"authorize", "start loading", "memory write", "load completed", "restart", "done"
+};
+
+/*!
+	The parameters we write to all devices
+*/
+static const uint8_t parameters[] =
+{
+	0x01, 0x00, 0x05, 0x0A, 0x00, 0x00, 0x64, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+};
+
+static programming_job_t jobs[150];
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t aps[JOBS_MAX_PORTS];
+	uint32_t ap_count = 0;
+	uint32_t index = 0;
+	uint32_t failed = 0;
+	uint32_t start = 0;
+	uint32_t job_count = sizeof(jobs) / sizeof(jobs[0]);
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	/*
+		150 devices on the lines 1.1, 1.2 and 1.3,
+		you will probably have to change the jobs
+	*/
+	for (index = 0; index < job_count; ++index)
+	{
+		jobs[index].ind_addr = (uint16_t)(0x1100 + ((index % 3) << 8) + 1 + (index / 3));
+		jobs[index].key = 0xFFFFFFFF;
+		jobs[index].object_index = 4;
+		jobs[index].memory_addr = 0x4400;
+		jobs[index].data = parameters;
+		jobs[index].data_length = sizeof(parameters);
+	}
+
+	/*
+		Open up to 4 tunneling connections with a specific IP Interface,
+		you will probably have to change the IP address
+	*/
+	ap_count = open_tunnels("192.168.1.45", aps, 4);
+	if (ap_count > 0)
+	{
+		start = now_ms();
+		failed = jobs_run(aps, ap_count, 0, jobs, job_count, 0, &on_progress, &on_finished, NULL);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u jobs finished in %u ms, %u failed",
+		                 job_count, now_ms() - start, failed);
+	}
+
+	for (index = 0; index < ap_count; ++index)
+	{
+		kdrive_ap_close(aps[index]);
+		kdrive_ap_release(aps[index]);
+	}
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Without an explicit concurrency there is one worker per line
+	with jobs (times JOBS_PER_LINE), more would only wait for a line.
+*/
+uint32_t jobs_run(const int32_t aps[], uint32_t ap_count, uint32_t concurrency,
+                  const programming_job_t jobs[], uint32_t job_count, uint32_t line_gap,
+                  job_progress_callback progress, job_finished_callback finish, void* user_data)
+{
+	job_runner_t runner;
+	job_worker_t* worker = 0;
+	bool_t lines[JOBS_MAX_LINES];
+	uint32_t line_count = 0;
+	uint32_t index = 0;
+	uint32_t now = 0;
+
+	if ((ap_count == 0) || (job_count == 0))
+	{
+		return job_count;
+	}
+
+	memset(&runner, 0, sizeof(job_runner_t));
+	runner.jobs = jobs;
+	runner.job_count = job_count;
+	runner.started = (bool_t*) calloc(job_count, sizeof(bool_t));
+	runner.line_gap = (line_gap > 0) ? line_gap : JOBS_LINE_GAP;
+	runner.progress = progress;
+	runner.finish = finish;
+	runner.user_data = user_data;
+
+	if (!runner.started)
+	{
+		return job_count;
+	}
+
+	/* the throttle compares with line_next, start from now (the clock wraps) */
+	now = now_ms();
+	for (index = 0; index < JOBS_MAX_LINES; ++index)
+	{
+		runner.line_next[index] = now;
+	}
+
+	pthread_mutex_init(&runner.mutex, NULL);
+	pthread_cond_init(&runner.line_free, NULL);
+	pthread_mutex_init(&runner.callback_mutex, NULL);
+
+	if (concurrency == 0)
+	{
+		memset(lines, 0, sizeof(lines));
+		for (index = 0; index < job_count; ++index)
+		{
+			if (!lines[jobs[index].ind_addr >> 8])
+			{
+				lines[jobs[index].ind_addr >> 8] = 1;
+				++line_count;
+			}
+		}
+		concurrency = line_count * JOBS_PER_LINE;
+	}
+	if (concurrency > JOBS_MAX_WORKERS)
+	{
+		concurrency = JOBS_MAX_WORKERS;
+	}
+
+	for (index = 0; index < concurrency; ++index)
+	{
+		worker = &runner.workers[runner.worker_count];
+		worker->runner = &runner;
+		worker->sp = kdrive_sp_create(aps[index % ap_count]);
+		if (worker->sp == KDRIVE_INVALID_DESCRIPTOR)
+		{
+			break;
+		}
+
+		kdrive_sp_set_co(worker->sp, 1);
+
+		if (pthread_create(&worker->thread, NULL, &jobs_worker, worker) != 0)
+		{
+			kdrive_sp_release(worker->sp);
+			break;
+		}
+
+		++runner.worker_count;
+	}
+
+	for (index = 0; index < runner.worker_count; ++index)
+	{
+		pthread_join(runner.workers[index].thread, NULL);
+		kdrive_sp_release(runner.workers[index].sp);
+	}
+
+	/* jobs not started, i.e. no worker could be created */
+	runner.failed += job_count - runner.finished;
+
+	pthread_mutex_destroy(&runner.callback_mutex);
+	pthread_cond_destroy(&runner.line_free);
+	pthread_mutex_destroy(&runner.mutex);
+	free(runner.started);
+
+	return runner.failed;
+}
+
+void* jobs_worker(void* arg)
+{
+	job_worker_t* worker = (job_worker_t*) arg;
+	job_runner_t* runner = worker->runner;
+	job_step_t step = JOB_STEP_AUTHORIZE;
+	uint32_t index = 0;
+	uint8_t line = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	while ((index = jobs_take(runner)) < runner->job_count)
+	{
+		e = jobs_execute(runner, worker->sp, index, &step);
+		line = (uint8_t)(runner->jobs[index].ind_addr >> 8);
+
+		pthread_mutex_lock(&runner->mutex);
+		--runner->line_jobs[line];
+		++runner->finished;
+		if (e != KDRIVE_ERROR_NONE)
+		{
+			++runner->failed;
+		}
+		pthread_cond_broadcast(&runner->line_free);
+		pthread_mutex_unlock(&runner->mutex);
+
+		pthread_mutex_lock(&runner->callback_mutex);
+		if (runner->finish)
+		{
+			runner->finish(index, step, e, runner->user_data);
+		}
+		pthread_mutex_unlock(&runner->callback_mutex);
+	}
+
+	return NULL;
+}
+
+uint32_t jobs_take(job_runner_t* runner)
+{
+	uint32_t index = 0;
+	bool_t pending = 0;
+	uint8_t line = 0;
+
+	pthread_mutex_lock(&runner->mutex);
+
+	while (1)
+	{
+		pending = 0;
+		for (index = 0; index < runner->job_count; ++index)
+		{
+			if (runner->started[index])
+			{
+				continue;
+			}
+			pending = 1;
+			line = (uint8_t)(runner->jobs[index].ind_addr >> 8);
+			if (runner->line_jobs[line] < JOBS_PER_LINE)
+			{
+				runner->started[index] = 1;
+				++runner->line_jobs[line];
+				pthread_mutex_unlock(&runner->mutex);
+				return index;
+			}
+		}
+
+		if (!pending)
+		{
+			break;
+		}
+		pthread_cond_wait(&runner->line_free, &runner->mutex);
+	}
+
+	pthread_mutex_unlock(&runner->mutex);
+
+	return runner->job_count;
+}
+
+/*!
+	The restart has no response, so it is the last step.
+*/
+error_t jobs_execute(job_runner_t* runner, int32_t sp, uint32_t index, job_step_t* step)
+{
+	const programming_job_t* job = &runner->jobs[index];
+	uint32_t apdu_length = 0;
+	uint32_t chunk_len = 0;
+	uint32_t position = 0;
+	uint32_t length = 0;
+	uint8_t level = 0;
+	uint8_t load_state = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	if ((kdrive_sp_get_max_apdu_length(sp, &apdu_length) != KDRIVE_ERROR_NONE) ||
+	    (apdu_length <= MEMORY_APDU_HEADER_LEN))
+	{
+		apdu_length = 15;
+	}
+	chunk_len = apdu_length - MEMORY_APDU_HEADER_LEN;
+	if (chunk_len > MEMORY_MAX_CHUNK_LEN)
+	{
+		chunk_len = MEMORY_MAX_CHUNK_LEN;
+	}
+
+	for (*step = JOB_STEP_AUTHORIZE; (*step < JOB_STEP_DONE) && (e == KDRIVE_ERROR_NONE); ++*step)
+	{
+		switch (*step)
+		{
+			case JOB_STEP_AUTHORIZE:
+				jobs_throttle(runner, job->ind_addr);
+				e = kdrive_sp_authorize_request(sp, job->ind_addr, job->key, &level);
+				break;
+
+			case JOB_STEP_START_LOADING:
+				jobs_throttle(runner, job->ind_addr);
+				e = kdrive_sp_load_state_write(sp, job->ind_addr, job->object_index, LOAD_EVENT_START, &load_state);
+				break;
+
+			case JOB_STEP_MEMORY_WRITE:
+				for (position = 0; (position < job->data_length) && (e == KDRIVE_ERROR_NONE); position += length)
+				{
+					length = job->data_length - position;
+					if (length > chunk_len)
+					{
+						length = chunk_len;
+					}
+					jobs_throttle(runner, job->ind_addr);
+					e = kdrive_sp_memory_write(sp, job->ind_addr, (uint16_t)(job->memory_addr + position),
+					                           &job->data[position], length);
+				}
+				break;
+
+			case JOB_STEP_LOAD_COMPLETED:
+				jobs_throttle(runner, job->ind_addr);
+				e = kdrive_sp_load_state_write(sp, job->ind_addr, job->object_index, LOAD_EVENT_COMPLETE, &load_state);
+				break;
+
+			case JOB_STEP_RESTART:
+				jobs_throttle(runner, job->ind_addr);
+				e = kdrive_sp_restart_device_type0(sp, job->ind_addr);
+				break;
+
+			default:
+				break;
+		}
+
+		if (e == KDRIVE_ERROR_NONE)
+		{
+			pthread_mutex_lock(&runner->callback_mutex);
+			if (runner->progress)
+			{
+				runner->progress(index, *step, runner->user_data);
+			}
+			pthread_mutex_unlock(&runner->callback_mutex);
+		}
+		else
+		{
+			/* keep the failed step */
+			break;
+		}
+	}
+
+	return e;
+}
+
+void jobs_throttle(job_runner_t* runner, uint16_t ind_addr)
+{
+	uint8_t line = (uint8_t)(ind_addr >> 8);
+	uint32_t now = 0;
+	int32_t wait = 0;
+
+	pthread_mutex_lock(&runner->mutex);
+	now = now_ms();
+	wait = (int32_t)(runner->line_next[line] - now);
+	if (wait < 0)
+	{
+		wait = 0;
+	}
+	runner->line_next[line] = now + (uint32_t) wait + runner->line_gap;
+	pthread_mutex_unlock(&runner->mutex);
+
+	if (wait > 0)
+	{
+		usleep((useconds_t) wait * 1000);
+	}
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000u) + ((uint32_t) ts.tv_nsec / 1000000u);
+}
+
+uint32_t open_tunnels(const char* ip_address, int32_t aps[], uint32_t count)
+{
+	uint32_t opened = 0;
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+
+	if (count > JOBS_MAX_PORTS)
+	{
+		count = JOBS_MAX_PORTS;
+	}
+
+	while (opened < count)
+	{
+		ap = kdrive_ap_create();
+		if (ap == KDRIVE_INVALID_DESCRIPTOR)
+		{
+			break;
+		}
+
+		if (kdrive_ap_open_ip(ap, ip_address) != KDRIVE_ERROR_NONE)
+		{
+			/* KDRIVE_AP_NO_MORE_CONNECTIONS_ERROR: all tunnels of the interface are in use */
+			kdrive_ap_release(ap);
+			break;
+		}
+
+		aps[opened++] = ap;
+	}
+
+	return opened;
+}
+
+void on_progress(uint32_t job, job_step_t step, void* user_data)
+{
+	uint16_t a = jobs[job].ind_addr;
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u.%u.%u: %s", (a >> 12) & 0x0F, (a >> 8) & 0x0F, a & 0xFF,
+	                 step_names[step]);
+}
+
+void on_finished(uint32_t job, job_step_t step, error_t error, void* user_data)
+{
+	uint16_t a = jobs[job].ind_addr;
+	char error_message[ERROR_MESSAGE_LEN];
+
+	if (error == KDRIVE_ERROR_NONE)
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u.%u.%u: programmed", (a >> 12) & 0x0F, (a >> 8) & 0x0F, a & 0xFF);
+	}
+	else
+	{
+		kdrive_get_error_message(error, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "%u.%u.%u: %s failed: %s", (a >> 12) & 0x0F, (a >> 8) & 0x0F,
+		                 a & 0xFF, step_names[step], error_message);
+	}
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message. The workers raise errors
+	concurrently, so the message buffer is local.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
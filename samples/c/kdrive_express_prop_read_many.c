@@ -0,0 +1,434 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Reads many property values of a device in one call.
+
+	prop_values_read_many takes a list of property value reads and
+	returns a result with its own error code for each of them. Requests
+	for adjacent elements of the same property are packed into one
+	A_PropertyValue_Read, up to 15 elements and up to the max APDU length
+	of the service port. Requests which don't fit into one response are
+	split. When a packed read fails the requests are read one by one,
+	so an error only affects the request which caused it.
+
+	The element size is needed for the packing. It is taken from the
+	request or from the property description (which is read once per
+	property). Properties with a variable element size are not packed.
+
+	All reads use the same service port, so with kdrive_sp_set_co
+	they run on its transport connection. The device services are
+	synchronous, one request is in flight at a time.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define PROP_MAX_VALUE_LEN		(64)	/*!< max size of a property value result */
+#define PROP_MAX_REQUESTS		(64)	/*!< max number of requests per call */
+#define PROP_MAX_ELEMS			(15)	/*!< the element count of A_PropertyValue_Read is 4 bits */
+#define PROP_APDU_HEADER_LEN	(5)		/*!< APCI (2), object index, property id, count and start index (2), minus the TPCI octet */
+#define STANDARD_APDU_LEN		(15)	/*!< max APDU length of a standard frame */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	A property value read
+*/
+typedef struct prop_read_request_t
+{
+	uint8_t object_index;
+	uint8_t prop_id;
+	uint16_t start_index;
+	uint8_t nr_of_elems;
+	uint8_t elem_size; /*!< octets per element, 0 to take it from the property description */
+
+} prop_read_request_t;
+
+/*!
+	The result of a property value read
+*/
+typedef struct prop_read_result_t
+{
+	error_t error; /*!< KDRIVE_ERROR_NONE if data is valid */
+	uint8_t data[PROP_MAX_VALUE_LEN];
+	uint32_t data_length;
+
+} prop_read_result_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Reads count property values from the device ind_addr.
+	results has count entries, result i belongs to request i.
+	Returns the number of A_PropertyValue_Read services used.
+*/
+static uint32_t prop_values_read_many(int32_t sp, uint16_t ind_addr, const prop_read_request_t requests[],
+                                      uint32_t count, prop_read_result_t results[]);
+
+/*!
+	Reads the values of one request, split into reads of max_elems elements
+*/
+static uint32_t prop_read_single(int32_t sp, uint16_t ind_addr, const prop_read_request_t* request,
+                                 uint32_t elem_size, uint32_t max_elems, prop_read_result_t* result);
+
+/*!
+	Returns the element size of a property data type, 0 if it is variable or unknown
+*/
+static uint32_t pdt_size(uint8_t type);
+
+/*!
+	Sorts the request indices by object index, property id and start index
+*/
+static int compare_requests(const void* a, const void* b);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+/*!
+	The address of the device that we read
+*/
+static uint16_t address = 0x5102;
+
+/*!
+	The request list, used by compare_requests
+*/
+static const prop_read_request_t* sort_requests = 0;
+
+/*!
+	The device object properties of our inventory
+*/
+static const prop_read_request_t inventory[] =
+{
+	{ 0, 11, 1, 1, 6 }, /* PID_SERIAL_NUMBER */
+	{ 0, 12, 1, 1, 2 }, /* PID_MANUFACTURER_ID */
+	{ 0, 13, 1, 1, 5 }, /* PID_PROG_VERSION */
+	{ 0, 15, 1, 1, 10 }, /* PID_ORDER_INFO */
+	{ 0, 25, 1, 1, 2 }, /* PID_VERSION */
+	{ 0, 78, 1, 1, 6 }, /* PID_HARDWARE_TYPE */
+	{ 1, 23, 1, 4, 2 }, /* first group addresses of the address table */
+	{ 1, 23, 5, 4, 2 },
+	{ 1, 23, 9, 4, 2 },
+};
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+	int32_t sp = KDRIVE_INVALID_DESCRIPTOR;
+	prop_read_result_t results[sizeof(inventory) / sizeof(inventory[0])];
+	uint32_t count = sizeof(inventory) / sizeof(inventory[0]);
+	uint32_t reads = 0;
+	uint32_t index = 0;
+	char message[ERROR_MESSAGE_LEN];
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	ap = kdrive_ap_create();
+	if ((ap == KDRIVE_INVALID_DESCRIPTOR) ||
+	    (kdrive_ap_enum_usb(ap) == 0) ||
+	    (kdrive_ap_open_usb(ap, 0) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the access port");
+		kdrive_ap_release(ap);
+		return -1;
+	}
+
+	sp = kdrive_sp_create(ap);
+	kdrive_sp_set_co(sp, 1);
+
+	reads = prop_values_read_many(sp, address, inventory, count, results);
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u requests in %u property value reads", count, reads);
+
+	for (index = 0; index < count; ++index)
+	{
+		if (results[index].error == KDRIVE_ERROR_NONE)
+		{
+			snprintf(message, sizeof(message), "Object %u PID %u [%u]: ", inventory[index].object_index,
+			         inventory[index].prop_id, inventory[index].start_index);
+			kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, message, results[index].data, results[index].data_length);
+		}
+		else
+		{
+			kdrive_get_error_message(results[index].error, message, sizeof(message));
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Object %u PID %u [%u]: %s", inventory[index].object_index,
+			                 inventory[index].prop_id, inventory[index].start_index, message);
+		}
+	}
+
+	kdrive_sp_release(sp);
+	kdrive_ap_close(ap);
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	The requests are sorted, so the requests for the same property
+	follow each other. A batch is a run of requests whose elements
+	are adjacent (or overlapping) and fit into one response.
+*/
+uint32_t prop_values_read_many(int32_t sp, uint16_t ind_addr, const prop_read_request_t requests[],
+                               uint32_t count, prop_read_result_t results[])
+{
+	uint32_t order[PROP_MAX_REQUESTS];
+	uint32_t sizes[PROP_MAX_REQUESTS];
+	uint8_t data[PROP_MAX_VALUE_LEN];
+	uint32_t data_length = 0;
+	property_description_t description;
+	const prop_read_request_t* request = 0;
+	const prop_read_request_t* first = 0;
+	prop_read_result_t* result = 0;
+	uint32_t apdu_length = 0;
+	uint32_t payload = 0;
+	uint32_t reads = 0;
+	uint32_t index = 0;
+	uint32_t next = 0;
+	uint32_t end = 0;
+	uint32_t offset = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	if ((kdrive_sp_get_max_apdu_length(sp, &apdu_length) != KDRIVE_ERROR_NONE) || (apdu_length < STANDARD_APDU_LEN))
+	{
+		apdu_length = STANDARD_APDU_LEN;
+	}
+	payload = apdu_length - PROP_APDU_HEADER_LEN;
+
+	for (index = 0; index < count; ++index)
+	{
+		memset(&results[index], 0, sizeof(prop_read_result_t));
+		results[index].error = KDRIVE_SP_INVALID_INPUT_PARAMETER_ERROR;
+	}
+	if (count > PROP_MAX_REQUESTS)
+	{
+		count = PROP_MAX_REQUESTS;
+	}
+
+	/* the element sizes, the description is read once per property */
+	for (index = 0; index < count; ++index)
+	{
+		request = &requests[index];
+		order[index] = index;
+		sizes[index] = request->elem_size;
+
+		if ((sizes[index] == 0) && (index > 0) && (request->object_index == requests[index - 1].object_index) &&
+		    (request->prop_id == requests[index - 1].prop_id))
+		{
+			sizes[index] = sizes[index - 1];
+		}
+		else if ((sizes[index] == 0) &&
+		         (kdrive_sp_property_description_read(sp, ind_addr, request->object_index,
+		                 request->prop_id, 0, &description) == KDRIVE_ERROR_NONE))
+		{
+			sizes[index] = pdt_size(description.type);
+		}
+	}
+
+	sort_requests = requests;
+	qsort(order, count, sizeof(uint32_t), &compare_requests);
+
+	for (index = 0; index < count; index = next)
+	{
+		first = &requests[order[index]];
+		end = first->start_index + first->nr_of_elems;
+		next = index + 1;
+
+		/* extend the batch while the next request is adjacent and fits */
+		while ((sizes[order[index]] > 0) && (first->nr_of_elems <= PROP_MAX_ELEMS) &&
+		       (first->nr_of_elems * sizes[order[index]] <= payload) && (next < count))
+		{
+			request = &requests[order[next]];
+			if ((request->object_index != first->object_index) || (request->prop_id != first->prop_id) ||
+			    (sizes[order[next]] != sizes[order[index]]) || (request->start_index > end))
+			{
+				break;
+			}
+			if (request->start_index + request->nr_of_elems > end)
+			{
+				if (((request->start_index + request->nr_of_elems - first->start_index) > PROP_MAX_ELEMS) ||
+				    ((request->start_index + request->nr_of_elems - first->start_index) * sizes[order[index]] > payload))
+				{
+					break;
+				}
+				end = request->start_index + request->nr_of_elems;
+			}
+			++next;
+		}
+
+		if (next == index + 1)
+		{
+			reads += prop_read_single(sp, ind_addr, first, sizes[order[index]],
+			                          (sizes[order[index]] > 0) ? payload / sizes[order[index]] : PROP_MAX_ELEMS,
+			                          &results[order[index]]);
+			continue;
+		}
+
+		data_length = sizeof(data);
+		e = kdrive_sp_prop_value_read(sp, ind_addr, first->object_index, first->prop_id,
+		                              (uint8_t)(end - first->start_index), first->start_index, data, &data_length);
+		++reads;
+
+		if ((e == KDRIVE_ERROR_NONE) && (data_length == (end - first->start_index) * sizes[order[index]]))
+		{
+			for (; index < next; ++index)
+			{
+				request = &requests[order[index]];
+				result = &results[order[index]];
+				offset = (request->start_index - first->start_index) * sizes[order[index]];
+				result->data_length = request->nr_of_elems * sizes[order[index]];
+				memcpy(result->data, &data[offset], result->data_length);
+				result->error = KDRIVE_ERROR_NONE;
+			}
+		}
+		else
+		{
+			/* i.e. an element of the batch doesn't exist, read the requests one by one */
+			for (; index < next; ++index)
+			{
+				reads += prop_read_single(sp, ind_addr, &requests[order[index]], sizes[order[index]],
+				                          payload / sizes[order[index]], &results[order[index]]);
+			}
+		}
+	}
+
+	return reads;
+}
+
+uint32_t prop_read_single(int32_t sp, uint16_t ind_addr, const prop_read_request_t* request,
+                          uint32_t elem_size, uint32_t max_elems, prop_read_result_t* result)
+{
+	uint32_t reads = 0;
+	uint32_t position = 0;
+	uint32_t elems = 0;
+	uint32_t data_length = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	if (max_elems > PROP_MAX_ELEMS)
+	{
+		max_elems = PROP_MAX_ELEMS;
+	}
+	if (max_elems == 0)
+	{
+		max_elems = 1;
+	}
+	if ((request->nr_of_elems == 0) || (request->nr_of_elems * elem_size > PROP_MAX_VALUE_LEN))
+	{
+		result->error = KDRIVE_SP_INVALID_INPUT_PARAMETER_ERROR;
+		return 0;
+	}
+
+	result->data_length = 0;
+
+	for (position = 0; (position < request->nr_of_elems) && (e == KDRIVE_ERROR_NONE); position += elems)
+	{
+		elems = request->nr_of_elems - position;
+		if (elems > max_elems)
+		{
+			elems = max_elems;
+		}
+
+		data_length = PROP_MAX_VALUE_LEN - result->data_length;
+		e = kdrive_sp_prop_value_read(sp, ind_addr, request->object_index, request->prop_id, (uint8_t) elems,
+		                              (uint16_t)(request->start_index + position),
+		                              &result->data[result->data_length], &data_length);
+		result->data_length += data_length;
+		++reads;
+	}
+
+	result->error = e;
+
+	return reads;
+}
+
+/*!
+	The sizes of the fixed size property data types (PDT)
+*/
+uint32_t pdt_size(uint8_t type)
+{
+	static const uint8_t sizes[] =
+	{
+		1, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4, 8, 10, 3, 5, 8, /* PDT_CONTROL .. PDT_DATE_TIME */
+		0, /* PDT_VARIABLE_LENGTH */
+		1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, /* PDT_GENERIC_01 .. PDT_GENERIC_20 */
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* reserved, PDT_UTF8 (0x2F) */
+		2, 6, 1, 1, 2, 1, 1 /* PDT_VERSION .. PDT_SCALING */
+	};
+
+	type &= 0x3F;
+
+	return (type < sizeof(sizes)) ? sizes[type] : 0;
+}
+
+int compare_requests(const void* a, const void* b)
+{
+	const prop_read_request_t* ra = &sort_requests[*(const uint32_t*) a];
+	const prop_read_request_t* rb = &sort_requests[*(const uint32_t*) b];
+
+	if (ra->object_index != rb->object_index)
+	{
+		return (int) ra->object_index - (int) rb->object_index;
+	}
+	if (ra->prop_id != rb->prop_id)
+	{
+		return (int) ra->prop_id - (int) rb->prop_id;
+	}
+	if (ra->start_index != rb->start_index)
+	{
+		return (int) ra->start_index - (int) rb->start_index;
+	}
+
+	return (int)(*(const uint32_t*) a) - (int)(*(const uint32_t*) b);
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
@@ -0,0 +1,462 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Discovers the interface objects and properties of a device
+	and keeps the result in a cache file.
+
+	The object/property layout is walked with
+	kdrive_sp_property_description_read (by property index, until the
+	device answers with an error) and PID_OBJECT_TYPE of each object.
+	This takes one request per property.
+
+	The layout is defined by the application of the device, so the tree
+	is stored in a cache file named after the manufacturer, the
+	application id and the application version of device descriptor
+	type 2. When a device with the same application is discovered again
+	the cached tree is used and only the device descriptor is read.
+
+	The cache file is a small binary file (big endian):
+	  "KPT1", manufacturer (2), app id (2), app version (1), object count (1)
+	  per object: object index (1), object type (2), property count (1)
+	  per property: prop id, prop index, write enable, type,
+	                max nr of elems (2), read level, write level
+
+	Start the sample with the cache directory, the default is the working directory.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define TREE_MAX_OBJECTS		(32)	/*!< max number of interface objects */
+#define TREE_MAX_PROPERTIES		(64)	/*!< max number of properties per object */
+#define TREE_PATH_LEN			(256)	/*!< max length of the cache file path */
+#define TREE_PROPERTY_LEN		(8)		/*!< size of a property in the cache file */
+#define PID_OBJECT_TYPE			(1)		/*!< interface object property: object type */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	An interface object with its properties
+*/
+typedef struct tree_object_t
+{
+	uint8_t object_index;
+	uint16_t object_type;
+	uint8_t property_count;
+	property_description_t properties[TREE_MAX_PROPERTIES];
+
+} tree_object_t;
+
+/*!
+	The object/property tree of a device
+*/
+typedef struct device_tree_t
+{
+	uint16_t manufacturer; /*!< from device descriptor type 2 */
+	uint16_t app_id;
+	uint8_t app_ver;
+	uint8_t object_count;
+	tree_object_t objects[TREE_MAX_OBJECTS];
+
+} device_tree_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Gets the object/property tree of the device ind_addr, from the
+	cache in cache_dir if available, otherwise from the device.
+	A tree read from the device is stored in the cache.
+	from_cache is set to 1 when the cached tree was used.
+*/
+static error_t tree_discover(int32_t sp, uint16_t ind_addr, const char* cache_dir,
+                             device_tree_t* tree, bool_t* from_cache);
+
+/*!
+	Walks the objects and properties of the device
+*/
+static error_t tree_read(int32_t sp, uint16_t ind_addr, device_tree_t* tree);
+
+/*!
+	Loads the cache file of the application of tree.
+	Returns 1 if the file exists and is valid.
+*/
+static bool_t tree_load(const char* cache_dir, device_tree_t* tree);
+
+/*!
+	Writes the cache file of tree
+*/
+static bool_t tree_save(const char* cache_dir, const device_tree_t* tree);
+
+/*!
+	Returns the cache file path of the application of tree
+*/
+static void tree_path(const char* cache_dir, const device_tree_t* tree, char path[TREE_PATH_LEN]);
+
+/*!
+	Prints the tree
+*/
+static void tree_print(const device_tree_t* tree);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+/*!
+	The address of the device that we discover
+*/
+static uint16_t address = 0x5102;
+
+static device_tree_t tree;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+	int32_t sp = KDRIVE_INVALID_DESCRIPTOR;
+	bool_t from_cache = 0;
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	ap = kdrive_ap_create();
+	if ((ap == KDRIVE_INVALID_DESCRIPTOR) ||
+	    (kdrive_ap_enum_usb(ap) == 0) ||
+	    (kdrive_ap_open_usb(ap, 0) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the access port");
+		kdrive_ap_release(ap);
+		return -1;
+	}
+
+	sp = kdrive_sp_create(ap);
+	kdrive_sp_set_co(sp, 1);
+
+	if (tree_discover(sp, address, (argc > 1) ? argv[1] : ".", &tree, &from_cache) == KDRIVE_ERROR_NONE)
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Property tree %s", from_cache ? "from cache" : "read from device");
+		tree_print(&tree);
+	}
+
+	kdrive_sp_release(sp);
+	kdrive_ap_close(ap);
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Devices without device descriptor type 2 have no key for the
+	cache, their tree is read every time.
+*/
+error_t tree_discover(int32_t sp, uint16_t ind_addr, const char* cache_dir,
+                      device_tree_t* tree, bool_t* from_cache)
+{
+	device_descriptor_type2_t desc;
+	bool_t cacheable = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	memset(tree, 0, sizeof(device_tree_t));
+	*from_cache = 0;
+
+	if (kdrive_sp_device_descriptor_type2_read(sp, ind_addr, &desc) == KDRIVE_ERROR_NONE)
+	{
+		tree->manufacturer = desc.manufacturer;
+		tree->app_id = desc.app_id;
+		tree->app_ver = desc.app_ver;
+		cacheable = 1;
+
+		if (tree_load(cache_dir, tree))
+		{
+			*from_cache = 1;
+			return KDRIVE_ERROR_NONE;
+		}
+	}
+
+	e = tree_read(sp, ind_addr, tree);
+	if ((e == KDRIVE_ERROR_NONE) && cacheable && !tree_save(cache_dir, tree))
+	{
+		kdrive_logger(KDRIVE_LOGGER_WARNING, "Unable to write the property tree cache");
+	}
+
+	return e;
+}
+
+/*!
+	The properties of an object are read by index (prop id 0),
+	a negative response or prop id 0 is the end of the object.
+	The first object without properties is the end of the tree.
+	Any other error (i.e. a timeout) aborts the read, so an
+	incomplete tree is never written to the cache.
+*/
+error_t tree_read(int32_t sp, uint16_t ind_addr, device_tree_t* tree)
+{
+	tree_object_t* object = 0;
+	property_description_t* property = 0;
+	uint8_t data[2];
+	uint32_t data_length = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	tree->object_count = 0;
+
+	while (tree->object_count < TREE_MAX_OBJECTS)
+	{
+		object = &tree->objects[tree->object_count];
+		object->object_index = tree->object_count;
+		object->property_count = 0;
+
+		while (object->property_count < TREE_MAX_PROPERTIES)
+		{
+			property = &object->properties[object->property_count];
+			e = kdrive_sp_property_description_read(sp, ind_addr, object->object_index, 0,
+			                                        object->property_count, property);
+			if (e == KDRIVE_SP_NEGATIVE_RESPONSE_ERROR)
+			{
+				break;
+			}
+			if (e != KDRIVE_ERROR_NONE)
+			{
+				return e;
+			}
+			if (property->prop_id == 0)
+			{
+				break;
+			}
+			++object->property_count;
+		}
+
+		if (object->property_count == 0)
+		{
+			break;
+		}
+
+		data_length = sizeof(data);
+		e = kdrive_sp_prop_value_read(sp, ind_addr, object->object_index, PID_OBJECT_TYPE, 1, 1,
+		                              data, &data_length);
+		if ((e == KDRIVE_ERROR_NONE) && (data_length == 2))
+		{
+			object->object_type = (uint16_t)((data[0] << 8) | data[1]);
+		}
+		else if ((e != KDRIVE_ERROR_NONE) && (e != KDRIVE_SP_NEGATIVE_RESPONSE_ERROR))
+		{
+			return e;
+		}
+
+		++tree->object_count;
+	}
+
+	return (tree->object_count > 0) ? KDRIVE_ERROR_NONE : KDRIVE_SP_DEVICE_ERROR;
+}
+
+bool_t tree_load(const char* cache_dir, device_tree_t* tree)
+{
+	char path[TREE_PATH_LEN];
+	uint8_t header[10];
+	uint8_t buffer[TREE_PROPERTY_LEN];
+	tree_object_t* object = 0;
+	property_description_t* property = 0;
+	FILE* file = 0;
+	uint32_t index = 0;
+	uint32_t prop = 0;
+	bool_t valid = 0;
+
+	tree_path(cache_dir, tree, path);
+	file = fopen(path, "rb");
+	if (!file)
+	{
+		return 0;
+	}
+
+	if ((fread(header, 1, sizeof(header), file) == sizeof(header)) && (memcmp(header, "KPT1", 4) == 0) &&
+	    (((header[4] << 8) | header[5]) == tree->manufacturer) && (((header[6] << 8) | header[7]) == tree->app_id) &&
+	    (header[8] == tree->app_ver) && (header[9] <= TREE_MAX_OBJECTS))
+	{
+		tree->object_count = header[9];
+		valid = 1;
+
+		for (index = 0; valid && (index < tree->object_count); ++index)
+		{
+			object = &tree->objects[index];
+			valid = (fread(buffer, 1, 4, file) == 4) && (buffer[3] <= TREE_MAX_PROPERTIES);
+			if (valid)
+			{
+				object->object_index = buffer[0];
+				object->object_type = (uint16_t)((buffer[1] << 8) | buffer[2]);
+				object->property_count = buffer[3];
+			}
+
+			for (prop = 0; valid && (prop < object->property_count); ++prop)
+			{
+				property = &object->properties[prop];
+				valid = (fread(buffer, 1, TREE_PROPERTY_LEN, file) == TREE_PROPERTY_LEN);
+				property->prop_id = buffer[0];
+				property->prop_index = buffer[1];
+				property->write_enable = buffer[2];
+				property->type = buffer[3];
+				property->max_nr_of_elems = (uint16_t)((buffer[4] << 8) | buffer[5]);
+				property->read_level = buffer[6];
+				property->write_level = buffer[7];
+			}
+		}
+	}
+
+	fclose(file);
+
+	if (!valid)
+	{
+		tree->object_count = 0;
+	}
+
+	return valid;
+}
+
+/*!
+	The file is written to a temporary file and renamed,
+	so a concurrent reader never sees a partial file.
+*/
+bool_t tree_save(const char* cache_dir, const device_tree_t* tree)
+{
+	char path[TREE_PATH_LEN];
+	char temp_path[TREE_PATH_LEN + 4];
+	uint8_t buffer[TREE_PROPERTY_LEN];
+	const tree_object_t* object = 0;
+	const property_description_t* property = 0;
+	FILE* file = 0;
+	uint32_t index = 0;
+	uint32_t prop = 0;
+	bool_t written = 1;
+
+	tree_path(cache_dir, tree, path);
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+	file = fopen(temp_path, "wb");
+	if (!file)
+	{
+		return 0;
+	}
+
+	memcpy(buffer, "KPT1", 4);
+	buffer[4] = (uint8_t)(tree->manufacturer >> 8);
+	buffer[5] = (uint8_t) tree->manufacturer;
+	buffer[6] = (uint8_t)(tree->app_id >> 8);
+	buffer[7] = (uint8_t) tree->app_id;
+	written = (fwrite(buffer, 1, 8, file) == 8);
+	buffer[0] = tree->app_ver;
+	buffer[1] = tree->object_count;
+	written = written && (fwrite(buffer, 1, 2, file) == 2);
+
+	for (index = 0; written && (index < tree->object_count); ++index)
+	{
+		object = &tree->objects[index];
+		buffer[0] = object->object_index;
+		buffer[1] = (uint8_t)(object->object_type >> 8);
+		buffer[2] = (uint8_t) object->object_type;
+		buffer[3] = object->property_count;
+		written = (fwrite(buffer, 1, 4, file) == 4);
+
+		for (prop = 0; written && (prop < object->property_count); ++prop)
+		{
+			property = &object->properties[prop];
+			buffer[0] = property->prop_id;
+			buffer[1] = property->prop_index;
+			buffer[2] = property->write_enable ? 1 : 0;
+			buffer[3] = property->type;
+			buffer[4] = (uint8_t)(property->max_nr_of_elems >> 8);
+			buffer[5] = (uint8_t) property->max_nr_of_elems;
+			buffer[6] = property->read_level;
+			buffer[7] = property->write_level;
+			written = (fwrite(buffer, 1, TREE_PROPERTY_LEN, file) == TREE_PROPERTY_LEN);
+		}
+	}
+
+	written = (fclose(file) == 0) && written;
+
+	if (!written || (rename(temp_path, path) != 0))
+	{
+		remove(temp_path);
+		return 0;
+	}
+
+	return 1;
+}
+
+void tree_path(const char* cache_dir, const device_tree_t* tree, char path[TREE_PATH_LEN])
+{
+	snprintf(path, TREE_PATH_LEN, "%s/%04X_%04X_%02X.kpt", cache_dir,
+	         tree->manufacturer, tree->app_id, tree->app_ver);
+}
+
+void tree_print(const device_tree_t* tree)
+{
+	const tree_object_t* object = 0;
+	const property_description_t* property = 0;
+	uint32_t index = 0;
+	uint32_t prop = 0;
+
+	for (index = 0; index < tree->object_count; ++index)
+	{
+		object = &tree->objects[index];
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Object %u: type %u, %u properties",
+		                 object->object_index, object->object_type, object->property_count);
+
+		for (prop = 0; prop < object->property_count; ++prop)
+		{
+			property = &object->properties[prop];
+			kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "  PID %3u: type 0x%02X, %u elements, read level %u, %s",
+			                 property->prop_id, property->type, property->max_nr_of_elems,
+			                 property->read_level, property->write_enable ? "writable" : "read only");
+		}
+	}
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message. The negative responses at the
+	end of each object are expected.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if ((e != KDRIVE_TIMEOUT_ERROR) && (e != KDRIVE_SP_NEGATIVE_RESPONSE_ERROR))
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
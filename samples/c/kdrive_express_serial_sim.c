@@ -0,0 +1,1064 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	A cEMI FT1.2 interface simulated on a pseudo-terminal.
+
+	The simulator creates a pty and answers on the master side like a
+	KNX FT1.2 interface with cEMI: it acknowledges the frames of the host
+	(0xE5), handles the reset, the frame count bit (repeated frames are
+	acknowledged but not processed again), M_PropRead/M_PropWrite,
+	M_Reset and L_Data.req (answered with a positive L_Data.con).
+	The frames of the interface are repeated until the host acknowledges
+	them.
+
+	Faults and load can be injected:
+	  -n percent   line noise: random octets before a frame of the interface
+	  -a percent   lost ACKs: the ACK of a host frame is not sent
+	  -b count     burst: count L_Data.ind telegrams every burst period
+	  -p ms        the burst period (default 1000)
+	  -r baud      pace the output like a serial line (8E1), 0 = unlimited
+
+	Modes:
+	  kdrive_express_serial_sim sim [options]
+	    runs the simulator, the slave device name is printed,
+	    i.e. use it as SERIAL_DEVICE in kdrive_express_tiny_serial.c
+	    together with kdrive_ap_open_serial_ft12
+	  kdrive_express_serial_sim bench [options]
+	    opens the slave with kdrive_ap_open_serial_ft12 and raises the
+	    L_Data.ind rate step by step. For each rate the received telegrams
+	    and the CPU time per telegram (process time minus simulator time)
+	    are reported. The maximum sustained rate is the highest rate with
+	    all telegrams received.
+
+	TinySerial uses its own serial protocol which is not described in this
+	SDK, only FT1.2 is simulated.
+
+	Runs without hardware and without root, i.e. in a CI job.
+	This sample uses POSIX threads and pseudo-terminals, i.e.
+	gcc -I../../include -o kdrive_express_serial_sim kdrive_express_serial_sim.c -lkdriveExpress -lpthread
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define SIM_RX_BUFFER_SIZE		(4096)	/*!< read buffer of the simulator */
+#define SIM_MAX_FRAME_LEN		(262)	/*!< 0x68 L L 0x68 + 255 octets + CS 0x16 */
+#define SIM_TX_QUEUE_SIZE		(256)	/*!< frames of the interface waiting for transmission */
+#define SIM_ACK_TIMEOUT			(100)	/*!< ms to wait for the ACK of the host */
+#define SIM_MAX_REPEATS			(3)		/*!< repeats of a frame which is not acknowledged */
+#define SIM_STEP_TIME			(2000)	/*!< ms per rate step in the benchmark */
+#define SIM_DRAIN_TIME			(3000)	/*!< max ms to wait for the queued telegrams after a step */
+#define SIM_DRAIN_LIMIT			(200)	/*!< max ms for a sustained step, a longer backlog means the line is saturated */
+
+#define FT12_START_VARIABLE		(0x68)
+#define FT12_START_FIXED		(0x10)
+#define FT12_END				(0x16)
+#define FT12_ACK				(0xE5)
+#define FT12_CTRL_RESET			(0x40)	/*!< reset request of the host */
+#define FT12_CTRL_FCB			(0x20)	/*!< frame count bit */
+#define FT12_CTRL_BAU			(0xD3)	/*!< send user data of the interface, FCB 0 */
+
+#define CEMI_L_DATA_REQ			(0x11)
+#define CEMI_L_DATA_CON			(0x2E)
+#define CEMI_L_DATA_IND			(0x29)
+#define CEMI_M_PROP_READ_REQ	(0xFC)
+#define CEMI_M_PROP_READ_CON	(0xFB)
+#define CEMI_M_PROP_WRITE_REQ	(0xF6)
+#define CEMI_M_PROP_WRITE_CON	(0xF5)
+#define CEMI_M_RESET_REQ		(0xF1)
+#define CEMI_M_RESET_IND		(0xF0)
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	The fault and load configuration
+*/
+typedef struct sim_config_t
+{
+	uint32_t noise_percent;
+	uint32_t ack_loss_percent;
+	uint32_t burst_size;
+	uint32_t burst_period; /*!< in ms */
+	uint32_t baud; /*!< 0 = unlimited */
+
+} sim_config_t;
+
+/*!
+	A frame of the interface
+*/
+typedef struct sim_frame_t
+{
+	uint8_t data[SIM_MAX_FRAME_LEN];
+	uint32_t length;
+
+} sim_frame_t;
+
+/*!
+	The counters of the simulator
+*/
+typedef struct sim_stats_t
+{
+	uint32_t host_frames; /*!< valid frames of the host */
+	uint32_t host_repeats; /*!< repeated frames of the host (same FCB) */
+	uint32_t acks_dropped;
+	uint32_t framing_errors; /*!< octets skipped by the parser */
+	uint32_t checksum_errors;
+	uint32_t frames_sent; /*!< frames of the interface, without repeats */
+	uint32_t frames_repeated;
+	uint32_t frames_dropped; /*!< not acknowledged after SIM_MAX_REPEATS */
+	uint32_t ind_sent; /*!< L_Data.ind of the bursts */
+	uint32_t ind_overflow; /*!< L_Data.ind which didn't fit into the queue */
+
+} sim_stats_t;
+
+/*!
+	The simulator
+*/
+typedef struct sim_t
+{
+	int master;
+	char slave_name[64];
+	pthread_mutex_t mutex; /*!< protects config and stats */
+	sim_config_t config;
+	sim_stats_t stats;
+	volatile int stop;
+
+	/* receive */
+	uint8_t rx[SIM_RX_BUFFER_SIZE];
+	uint32_t rx_len;
+	int last_fcb; /*!< FCB of the last host frame, -1 after reset */
+
+	/* transmit */
+	sim_frame_t queue[SIM_TX_QUEUE_SIZE];
+	uint32_t queue_head;
+	uint32_t queue_count;
+	uint8_t tx_fcb; /*!< FCB of the next frame of the interface */
+	int awaiting_ack;
+	uint32_t repeats;
+	double ack_deadline;
+	double tx_free; /*!< time when the paced line is free again */
+	double next_burst;
+	uint16_t sequence; /*!< sequence number in the burst telegrams */
+
+} sim_t;
+
+/*!
+	The counters of the benchmark telegram callback
+*/
+typedef struct bench_counter_t
+{
+	pthread_mutex_t mutex;
+	uint32_t received;
+	uint32_t out_of_order; /*!< lost or repeated telegrams */
+	int32_t last_sequence;
+
+} bench_counter_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Creates the pseudo-terminal. Returns 0 on success
+*/
+static int sim_open(sim_t* sim);
+
+/*!
+	The simulator thread
+*/
+static void* sim_thread(void* arg);
+
+/*!
+	Parses the receive buffer. Complete frames are handled in place,
+	only an incomplete frame at the end is moved to the front
+*/
+static void sim_parse(sim_t* sim);
+
+/*!
+	Handles a valid variable frame of the host
+*/
+static void sim_host_frame(sim_t* sim, uint8_t ctrl, const uint8_t* data, uint32_t length);
+
+/*!
+	Answers a cEMI message of the host
+*/
+static void sim_cemi(sim_t* sim, const uint8_t* cemi, uint32_t length);
+
+/*!
+	Queues a cEMI message for transmission to the host
+*/
+static int sim_queue(sim_t* sim, const uint8_t* cemi, uint32_t length);
+
+/*!
+	Sends the head of the queue (again) with the current FCB
+*/
+static void sim_send_head(sim_t* sim);
+
+/*!
+	Writes to the master, paced to the configured baud rate
+*/
+static void sim_write(sim_t* sim, const uint8_t* data, uint32_t length);
+
+/*!
+	Queues the burst telegrams when the burst period elapsed
+*/
+static void sim_burst(sim_t* sim, double now);
+
+/*!
+	Returns 1 with the given probability in percent
+*/
+static int sim_chance(uint32_t percent);
+
+/*!
+	Runs the benchmark against kdrive_ap_open_serial_ft12
+*/
+static int bench(sim_t* sim, pthread_t thread);
+
+/*!
+	The telegram callback of the benchmark
+*/
+static void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Returns the process CPU time in s
+*/
+static double process_cpu(void);
+
+/*!
+	Returns the CPU time of the thread in s
+*/
+static double thread_cpu(pthread_t thread);
+
+/*!
+	Returns the monotonic time in s
+*/
+static double now_s(void);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*!
+	Called on SIGINT
+*/
+static void on_signal(int sig);
+
+/*******************************
+** Private Variables
+********************************/
+
+static sim_t sim;
+static bench_counter_t counter;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	pthread_t thread;
+	const char* mode = (argc > 1) ? argv[1] : "sim";
+	int opt = 0;
+	int result = 0;
+
+	memset(&sim, 0, sizeof(sim_t));
+	sim.config.burst_period = 1000;
+	sim.last_fcb = -1;
+	sim.tx_fcb = FT12_CTRL_FCB;
+	pthread_mutex_init(&sim.mutex, NULL);
+
+	optind = 2;
+	while ((opt = getopt(argc, argv, "n:a:b:p:r:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				sim.config.noise_percent = (uint32_t) atoi(optarg);
+				break;
+			case 'a':
+				sim.config.ack_loss_percent = (uint32_t) atoi(optarg);
+				break;
+			case 'b':
+				sim.config.burst_size = (uint32_t) atoi(optarg);
+				break;
+			case 'p':
+				sim.config.burst_period = (uint32_t) atoi(optarg);
+				break;
+			case 'r':
+				sim.config.baud = (uint32_t) atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [sim|bench] [-n noise%%] [-a ack loss%%] [-b burst] [-p period ms] [-r baud]\n", argv[0]);
+				return -1;
+		}
+	}
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	srand((unsigned) time(NULL));
+
+	if (sim_open(&sim) != 0)
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to create the pseudo-terminal");
+		return -1;
+	}
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "FT1.2 interface simulated on %s", sim.slave_name);
+
+	if (pthread_create(&thread, NULL, &sim_thread, &sim) != 0)
+	{
+		close(sim.master);
+		return -1;
+	}
+
+	if (strcmp(mode, "bench") == 0)
+	{
+		result = bench(&sim, thread);
+	}
+	else
+	{
+		signal(SIGINT, &on_signal);
+		while (!sim.stop)
+		{
+			pause();
+		}
+	}
+
+	sim.stop = 1;
+	pthread_join(thread, NULL);
+	close(sim.master);
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION,
+	                 "host frames %u (repeated %u), acks dropped %u, framing errors %u, checksum errors %u",
+	                 sim.stats.host_frames, sim.stats.host_repeats, sim.stats.acks_dropped,
+	                 sim.stats.framing_errors, sim.stats.checksum_errors);
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION,
+	                 "frames sent %u (repeated %u, dropped %u), L_Data.ind %u (queue overflow %u)",
+	                 sim.stats.frames_sent, sim.stats.frames_repeated, sim.stats.frames_dropped,
+	                 sim.stats.ind_sent, sim.stats.ind_overflow);
+
+	pthread_mutex_destroy(&sim.mutex);
+
+	return result;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	The slave is set to raw mode once, so the pty doesn't
+	echo or translate before the host configures it
+*/
+int sim_open(sim_t* sim)
+{
+	struct termios tio;
+	const char* name = NULL;
+	int slave = -1;
+
+	sim->master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((sim->master < 0) || (grantpt(sim->master) != 0) || (unlockpt(sim->master) != 0) ||
+	        ((name = ptsname(sim->master)) == NULL))
+	{
+		if (sim->master >= 0)
+		{
+			close(sim->master);
+		}
+		return -1;
+	}
+	strncpy(sim->slave_name, name, sizeof(sim->slave_name) - 1);
+
+	slave = open(sim->slave_name, O_RDWR | O_NOCTTY);
+	if (slave >= 0)
+	{
+		if (tcgetattr(slave, &tio) == 0)
+		{
+			cfmakeraw(&tio);
+			tcsetattr(slave, TCSANOW, &tio);
+		}
+		close(slave);
+	}
+
+	fcntl(sim->master, F_SETFL, fcntl(sim->master, F_GETFL) | O_NONBLOCK);
+
+	return 0;
+}
+
+/*!
+	One thread does everything: it reads as much as available,
+	parses it, handles the ACK timeout and the bursts.
+	EIO on the master only means that the slave is not open
+*/
+void* sim_thread(void* arg)
+{
+	sim_t* sim = (sim_t*) arg;
+	struct pollfd pfd;
+	double now = 0;
+	int timeout = 0;
+	ssize_t n = 0;
+
+	pfd.fd = sim->master;
+	pfd.events = POLLIN;
+	sim->next_burst = now_s();
+
+	while (!sim->stop)
+	{
+		now = now_s();
+		timeout = 10;
+		if (sim->awaiting_ack)
+		{
+			timeout = (int)((sim->ack_deadline - now) * 1000) + 1;
+			timeout = (timeout < 1) ? 1 : ((timeout > 10) ? 10 : timeout);
+		}
+
+		if ((poll(&pfd, 1, timeout) > 0) && (pfd.revents & POLLIN))
+		{
+			n = read(sim->master, sim->rx + sim->rx_len, SIM_RX_BUFFER_SIZE - sim->rx_len);
+			if (n > 0)
+			{
+				sim->rx_len += (uint32_t) n;
+				sim_parse(sim);
+			}
+		}
+		else if (pfd.revents & (POLLHUP | POLLERR))
+		{
+			usleep(10000);
+		}
+
+		now = now_s();
+		if (sim->awaiting_ack && (now >= sim->ack_deadline))
+		{
+			pthread_mutex_lock(&sim->mutex);
+			if (sim->repeats < SIM_MAX_REPEATS)
+			{
+				++sim->repeats;
+				++sim->stats.frames_repeated;
+				pthread_mutex_unlock(&sim->mutex);
+				sim_send_head(sim);
+			}
+			else
+			{
+				++sim->stats.frames_dropped;
+				pthread_mutex_unlock(&sim->mutex);
+				sim->awaiting_ack = 0;
+				sim->queue_head = (sim->queue_head + 1) % SIM_TX_QUEUE_SIZE;
+				--sim->queue_count;
+				sim->tx_fcb ^= FT12_CTRL_FCB;
+			}
+		}
+
+		sim_burst(sim, now);
+
+		if (!sim->awaiting_ack && (sim->queue_count > 0))
+		{
+			sim->repeats = 0;
+			sim_send_head(sim);
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+	Scans for ACK, fixed and variable frames. An octet which doesn't
+	start a valid frame is skipped and counted as framing error,
+	so the parser resynchronises after line noise.
+*/
+void sim_parse(sim_t* sim)
+{
+	const uint8_t* p = sim->rx;
+	uint32_t pos = 0;
+	uint32_t avail = 0;
+	uint32_t frame_len = 0;
+	uint32_t index = 0;
+	uint8_t cs = 0;
+
+	while (pos < sim->rx_len)
+	{
+		avail = sim->rx_len - pos;
+
+		if (p[pos] == FT12_ACK)
+		{
+			if (sim->awaiting_ack)
+			{
+				sim->awaiting_ack = 0;
+				sim->queue_head = (sim->queue_head + 1) % SIM_TX_QUEUE_SIZE;
+				--sim->queue_count;
+				sim->tx_fcb ^= FT12_CTRL_FCB;
+			}
+			++pos;
+		}
+		else if (p[pos] == FT12_START_FIXED)
+		{
+			if (avail < 4)
+			{
+				break;
+			}
+			if ((p[pos + 3] == FT12_END) && (p[pos + 1] == p[pos + 2]))
+			{
+				if ((p[pos + 1] & 0x4F) == FT12_CTRL_RESET)
+				{
+					sim->last_fcb = -1;
+					sim->tx_fcb = FT12_CTRL_FCB;
+				}
+				if (sim_chance(sim->config.ack_loss_percent))
+				{
+					pthread_mutex_lock(&sim->mutex);
+					++sim->stats.acks_dropped;
+					pthread_mutex_unlock(&sim->mutex);
+				}
+				else
+				{
+					sim_write(sim, (const uint8_t[]) { FT12_ACK }, 1);
+				}
+				pos += 4;
+			}
+			else
+			{
+				++sim->stats.framing_errors;
+				++pos;
+			}
+		}
+		else if (p[pos] == FT12_START_VARIABLE)
+		{
+			if (avail < 4)
+			{
+				break;
+			}
+			if ((p[pos + 1] != p[pos + 2]) || (p[pos + 3] != FT12_START_VARIABLE) || (p[pos + 1] == 0))
+			{
+				++sim->stats.framing_errors;
+				++pos;
+				continue;
+			}
+			frame_len = (uint32_t) p[pos + 1] + 6;
+			if (avail < frame_len)
+			{
+				break;
+			}
+			for (cs = 0, index = 4; index < frame_len - 2; ++index)
+			{
+				cs = (uint8_t)(cs + p[pos + index]);
+			}
+			if (p[pos + frame_len - 1] != FT12_END)
+			{
+				++sim->stats.framing_errors;
+				++pos;
+			}
+			else if (p[pos + frame_len - 2] != cs)
+			{
+				++sim->stats.checksum_errors;
+				pos += frame_len;
+			}
+			else
+			{
+				sim_host_frame(sim, p[pos + 4], p + pos + 5, frame_len - 7);
+				pos += frame_len;
+			}
+		}
+		else
+		{
+			++sim->stats.framing_errors;
+			++pos;
+		}
+	}
+
+	/* keep the incomplete frame */
+	if (pos > 0)
+	{
+		sim->rx_len -= pos;
+		if (sim->rx_len > 0)
+		{
+			memmove(sim->rx, sim->rx + pos, sim->rx_len);
+		}
+	}
+}
+
+/*!
+	A frame with the same FCB as the previous one is a repetition
+	(the host didn't get our ACK): it is acknowledged again but not processed.
+	A lost ACK is simulated after the frame was processed, so the
+	repetition of the host takes the duplicate path.
+*/
+void sim_host_frame(sim_t* sim, uint8_t ctrl, const uint8_t* data, uint32_t length)
+{
+	const int fcb = (ctrl & FT12_CTRL_FCB) ? 1 : 0;
+	const int repeated = (sim->last_fcb == fcb);
+
+	pthread_mutex_lock(&sim->mutex);
+	++sim->stats.host_frames;
+	if (repeated)
+	{
+		++sim->stats.host_repeats;
+	}
+	pthread_mutex_unlock(&sim->mutex);
+
+	if (!repeated)
+	{
+		sim->last_fcb = fcb;
+		sim_cemi(sim, data, length);
+	}
+
+	if (sim_chance(sim->config.ack_loss_percent))
+	{
+		pthread_mutex_lock(&sim->mutex);
+		++sim->stats.acks_dropped;
+		pthread_mutex_unlock(&sim->mutex);
+		return;
+	}
+	sim_write(sim, (const uint8_t[]) { FT12_ACK }, 1);
+}
+
+/*!
+	The property values are those of a cEMI server object
+	(interface object type 8). Unknown properties are answered
+	with a negative M_PropRead.con (no elements, error code 0x07).
+*/
+void sim_cemi(sim_t* sim, const uint8_t* cemi, uint32_t length)
+{
+	static const uint8_t serial_number[KDRIVE_SN_LEN] = { 0x00, 0xC5, 0x53, 0x49, 0x4D, 0x01 };
+	uint8_t response[SIM_MAX_FRAME_LEN];
+	uint32_t response_len = 0;
+
+	if (length == 0)
+	{
+		return;
+	}
+
+	switch (cemi[0])
+	{
+		case CEMI_L_DATA_REQ:
+			if ((length >= 10) && (length <= sizeof(response)))
+			{
+				memcpy(response, cemi, length);
+				response[0] = CEMI_L_DATA_CON;
+				response[2 + cemi[1]] &= 0xFE; /* ctrl1: confirm ok */
+				sim_queue(sim, response, length);
+			}
+			break;
+
+		case CEMI_M_PROP_READ_REQ:
+			if (length >= 7)
+			{
+				memcpy(response, cemi, 7);
+				response[0] = CEMI_M_PROP_READ_CON;
+				response_len = 7;
+				switch (cemi[4])
+				{
+					case 11: /* PID_SERIAL_NUMBER */
+						memcpy(response + 7, serial_number, KDRIVE_SN_LEN);
+						response_len += KDRIVE_SN_LEN;
+						break;
+					case 12: /* PID_MANUFACTURER_ID */
+						response[7] = 0x00;
+						response[8] = 0xC5;
+						response_len += 2;
+						break;
+					case 52: /* PID_COMM_MODE: data link layer */
+						response[7] = 0x00;
+						response_len += 1;
+						break;
+					default:
+						response[5] &= 0x0F; /* no elements */
+						response[7] = 0x07; /* error: void DP */
+						response_len += 1;
+						break;
+				}
+				sim_queue(sim, response, response_len);
+			}
+			break;
+
+		case CEMI_M_PROP_WRITE_REQ:
+			if (length >= 7)
+			{
+				memcpy(response, cemi, 7);
+				response[0] = CEMI_M_PROP_WRITE_CON;
+				sim_queue(sim, response, 7);
+			}
+			break;
+
+		case CEMI_M_RESET_REQ:
+			response[0] = CEMI_M_RESET_IND;
+			sim_queue(sim, response, 1);
+			break;
+
+		default:
+			break;
+	}
+}
+
+int sim_queue(sim_t* sim, const uint8_t* cemi, uint32_t length)
+{
+	sim_frame_t* frame = NULL;
+	uint32_t index = 0;
+	uint8_t cs = 0;
+
+	if ((sim->queue_count >= SIM_TX_QUEUE_SIZE) || (length + 7 > SIM_MAX_FRAME_LEN) || (length + 1 > 255))
+	{
+		return -1;
+	}
+
+	frame = &sim->queue[(sim->queue_head + sim->queue_count) % SIM_TX_QUEUE_SIZE];
+	frame->data[0] = FT12_START_VARIABLE;
+	frame->data[1] = (uint8_t)(length + 1);
+	frame->data[2] = (uint8_t)(length + 1);
+	frame->data[3] = FT12_START_VARIABLE;
+	frame->data[4] = 0; /* control field, set on transmission */
+	memcpy(frame->data + 5, cemi, length);
+	for (index = 0; index < length; ++index)
+	{
+		cs = (uint8_t)(cs + cemi[index]);
+	}
+	frame->data[5 + length] = cs; /* without the control field */
+	frame->data[6 + length] = FT12_END;
+	frame->length = length + 7;
+
+	++sim->queue_count;
+
+	return 0;
+}
+
+/*!
+	The control field depends on the FCB at the time of transmission,
+	the checksum is corrected accordingly. Noise is only injected before
+	the first transmission of a frame.
+*/
+void sim_send_head(sim_t* sim)
+{
+	sim_frame_t* frame = &sim->queue[sim->queue_head];
+	const uint8_t ctrl = (uint8_t)(FT12_CTRL_BAU | sim->tx_fcb);
+	const uint8_t old_ctrl = frame->data[4];
+	uint8_t noise[4];
+	uint32_t index = 0;
+
+	frame->data[4] = ctrl;
+	frame->data[frame->length - 2] = (uint8_t)(frame->data[frame->length - 2] - old_ctrl + ctrl);
+
+	if ((sim->repeats == 0) && sim_chance(sim->config.noise_percent))
+	{
+		for (index = 0; index < sizeof(noise); ++index)
+		{
+			noise[index] = (uint8_t) rand();
+		}
+		sim_write(sim, noise, 1 + (uint32_t)(rand() % (int) sizeof(noise)));
+	}
+
+	sim_write(sim, frame->data, frame->length);
+
+	if (sim->repeats == 0)
+	{
+		pthread_mutex_lock(&sim->mutex);
+		++sim->stats.frames_sent;
+		pthread_mutex_unlock(&sim->mutex);
+	}
+	sim->awaiting_ack = 1;
+	sim->ack_deadline = now_s() + (SIM_ACK_TIMEOUT / 1000.0);
+}
+
+/*!
+	A serial octet with 8E1 takes 11 bits.
+	A full pty buffer (EAGAIN) is waited out
+*/
+void sim_write(sim_t* sim, const uint8_t* data, uint32_t length)
+{
+	struct pollfd pfd;
+	double now = 0;
+	ssize_t n = 0;
+
+	if (sim->config.baud > 0)
+	{
+		now = now_s();
+		if (sim->tx_free > now)
+		{
+			usleep((useconds_t)((sim->tx_free - now) * 1e6));
+		}
+		else
+		{
+			sim->tx_free = now;
+		}
+		sim->tx_free += (double)(length * 11) / sim->config.baud;
+	}
+
+	pfd.fd = sim->master;
+	pfd.events = POLLOUT;
+	while ((length > 0) && !sim->stop)
+	{
+		n = write(sim->master, data, length);
+		if (n > 0)
+		{
+			data += n;
+			length -= (uint32_t) n;
+		}
+		else if ((n < 0) && (errno == EAGAIN))
+		{
+			poll(&pfd, 1, 10);
+		}
+		else
+		{
+			return;
+		}
+	}
+}
+
+/*!
+	The burst telegrams are GroupValue_Write telegrams from 1.1.250
+	to 0/0/1 with a 2 octet sequence number as value.
+*/
+void sim_burst(sim_t* sim, double now)
+{
+	uint8_t ind[] = { CEMI_L_DATA_IND, 0x00, 0xBC, 0xE0, 0x11, 0xFA, 0x00, 0x01, 0x03, 0x00, 0x80, 0x00, 0x00 };
+	uint32_t burst_size = 0;
+	uint32_t burst_period = 0;
+	uint32_t index = 0;
+
+	pthread_mutex_lock(&sim->mutex);
+	burst_size = sim->config.burst_size;
+	burst_period = sim->config.burst_period ? sim->config.burst_period : 1;
+	pthread_mutex_unlock(&sim->mutex);
+
+	if ((burst_size == 0) || (now < sim->next_burst))
+	{
+		return;
+	}
+
+	/* don't catch up after a long pause */
+	sim->next_burst = (now - sim->next_burst > 1.0) ? now : sim->next_burst;
+	sim->next_burst += burst_period / 1000.0;
+
+	for (index = 0; index < burst_size; ++index)
+	{
+		ind[11] = (uint8_t)(sim->sequence >> 8);
+		ind[12] = (uint8_t) sim->sequence;
+
+		pthread_mutex_lock(&sim->mutex);
+		if (sim_queue(sim, ind, sizeof(ind)) == 0)
+		{
+			++sim->sequence;
+			++sim->stats.ind_sent;
+		}
+		else
+		{
+			++sim->stats.ind_overflow;
+		}
+		pthread_mutex_unlock(&sim->mutex);
+	}
+}
+
+int sim_chance(uint32_t percent)
+{
+	return (percent > 0) && ((uint32_t)(rand() % 100) < percent);
+}
+
+/*!
+	The rate is raised each step by the burst size, with a burst
+	period of 100 ms. A step is sustained if every telegram of the
+	step fit into the queue of the simulator and was received once,
+	in order, without a backlog of more than SIM_DRAIN_LIMIT ms.
+*/
+int bench(sim_t* sim, pthread_t thread)
+{
+	const uint32_t sizes[] = { 1, 2, 5, 10, 20, 50, 100 };
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+	uint32_t key = 0;
+	uint32_t step = 0;
+	uint32_t sent = 0;
+	uint32_t overflow = 0;
+	uint32_t received = 0;
+	uint32_t out_of_order = 0;
+	uint32_t sustained = 0;
+	uint32_t rate = 0;
+	uint32_t wait = 0;
+	bool_t failed = 0;
+	double cpu_start = 0;
+	double sim_cpu_start = 0;
+	double cpu = 0;
+
+	ap = kdrive_ap_create();
+	if ((ap == KDRIVE_INVALID_DESCRIPTOR) || (kdrive_ap_open_serial_ft12(ap, sim->slave_name) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the simulated interface");
+		kdrive_ap_release(ap);
+		return -1;
+	}
+
+	pthread_mutex_init(&counter.mutex, NULL);
+	counter.last_sequence = -1;
+	kdrive_ap_register_telegram_callback(ap, &on_telegram, &counter, &key);
+
+	for (step = 0; step < sizeof(sizes) / sizeof(sizes[0]); ++step)
+	{
+		rate = sizes[step] * 10;
+
+		pthread_mutex_lock(&counter.mutex);
+		counter.received = 0;
+		counter.out_of_order = 0;
+		pthread_mutex_unlock(&counter.mutex);
+
+		pthread_mutex_lock(&sim->mutex);
+		sent = sim->stats.ind_sent;
+		overflow = sim->stats.ind_overflow;
+		sim->config.burst_size = sizes[step];
+		sim->config.burst_period = 100;
+		pthread_mutex_unlock(&sim->mutex);
+
+		cpu_start = process_cpu();
+		sim_cpu_start = thread_cpu(thread);
+		usleep(SIM_STEP_TIME * 1000);
+
+		/* stop the bursts and let the queue drain */
+		pthread_mutex_lock(&sim->mutex);
+		sim->config.burst_size = 0;
+		sent = sim->stats.ind_sent - sent;
+		overflow = sim->stats.ind_overflow - overflow;
+		pthread_mutex_unlock(&sim->mutex);
+
+		for (wait = 0; wait < SIM_DRAIN_TIME; wait += 10)
+		{
+			pthread_mutex_lock(&counter.mutex);
+			received = counter.received;
+			out_of_order = counter.out_of_order;
+			pthread_mutex_unlock(&counter.mutex);
+			if (received >= sent)
+			{
+				break;
+			}
+			usleep(10 * 1000);
+		}
+
+		/* the CPU time of the simulator doesn't count */
+		cpu = (process_cpu() - cpu_start) - (thread_cpu(thread) - sim_cpu_start);
+
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION,
+		                 "%5u telegrams/s: sent %5u, overflow %5u, received %5u, out of order %3u, process CPU %.1f us/telegram",
+		                 rate, sent, overflow, received, out_of_order, received ? (cpu * 1e6) / received : 0.0);
+
+		/* the rate is sustained if it and all lower rates passed */
+		failed = failed || (received != sent) || (overflow != 0) || (out_of_order != 0) || (wait > SIM_DRAIN_LIMIT);
+		if (!failed)
+		{
+			sustained = rate;
+		}
+	}
+
+	kdrive_ap_remove_telegram_callback(ap, key);
+	kdrive_ap_close(ap);
+	kdrive_ap_release(ap);
+
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Maximum sustained rate: %u telegrams/s", sustained);
+
+	pthread_mutex_destroy(&counter.mutex);
+
+	return 0;
+}
+
+void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	bench_counter_t* c = (bench_counter_t*) user_data;
+	uint8_t message_code = 0;
+	uint16_t address = 0;
+	uint8_t data[KDRIVE_MAX_GROUP_VALUE_LEN];
+	uint32_t data_len = sizeof(data);
+	int32_t sequence = 0;
+
+	if ((kdrive_ap_get_message_code(telegram, telegram_len, &message_code) != KDRIVE_ERROR_NONE) ||
+	        (message_code != KDRIVE_CEMI_L_DATA_IND) ||
+	        (kdrive_ap_get_src(telegram, telegram_len, &address) != KDRIVE_ERROR_NONE) ||
+	        (address != 0x11FA) ||
+	        (kdrive_ap_get_group_data(telegram, telegram_len, data, &data_len) != KDRIVE_ERROR_NONE) ||
+	        (data_len != 2))
+	{
+		return;
+	}
+
+	sequence = (data[0] << 8) | data[1];
+
+	pthread_mutex_lock(&c->mutex);
+	++c->received;
+	if ((c->last_sequence >= 0) && (sequence != ((c->last_sequence + 1) & 0xFFFF)))
+	{
+		++c->out_of_order;
+	}
+	c->last_sequence = sequence;
+	pthread_mutex_unlock(&c->mutex);
+}
+
+double process_cpu(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (double) usage.ru_utime.tv_sec + ((double) usage.ru_utime.tv_usec / 1e6) +
+	       (double) usage.ru_stime.tv_sec + ((double) usage.ru_stime.tv_usec / 1e6);
+}
+
+double thread_cpu(pthread_t thread)
+{
+	struct timespec ts;
+	clockid_t clock;
+
+	if ((pthread_getcpuclockid(thread, &clock) != 0) || (clock_gettime(clock, &ts) != 0))
+	{
+		return 0;
+	}
+	return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
+
+void on_signal(int sig)
+{
+	sim.stop = 1;
+}
@@ -0,0 +1,507 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Service calls with a deadline and cancellation.
+
+	A kdrive service call blocks until the response arrives or the
+	response timeout of the service port elapses. This sample wraps the
+	service calls so that the caller returns at its own deadline or as
+	soon as another thread calls service_cancel.
+
+	Each call runs on a worker thread with its own service port. The
+	response timeout of that service port is set to the time remaining
+	until the deadline, so the library gives up at about the same time.
+	When the caller returns early the call is abandoned: the worker
+	finishes in the background, releases its service port and discards
+	the result. The service arguments are copied into the call, so an
+	abandoned worker never writes to the memory of the caller, and the
+	next call does not wait for it. The abandoned workers still use the
+	access port: call service_channel_drain before the access port is
+	closed.
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_service_deadline kdrive_express_service_deadline.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define MAX_PROP_DATA_LEN		(64)	/*!< max property data buffer size */
+#define SERVICE_DEADLINE		(2000)	/*!< deadline of a call in ms */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	The service function run by the worker.
+	args points to the copy of the arguments owned by the call
+*/
+typedef error_t (*service_function_t)(int32_t sp, void* args);
+
+/*!
+	A single service call, shared by the caller and the worker.
+	It is freed by the last of the two
+*/
+typedef struct service_call_t
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct service_channel_t* channel; /*!< the channel of the call, outlives the worker */
+	int32_t ap;
+	service_function_t function;
+	void* args; /*!< the copy of the arguments */
+	uint32_t args_size;
+	uint32_t timeout; /*!< response timeout for the worker service port */
+	bool_t done; /*!< set by the worker */
+	bool_t cancelled; /*!< set by service_cancel */
+	uint32_t refs; /*!< 2 while both the caller and the worker use the call */
+	error_t result;
+
+} service_call_t;
+
+/*!
+	Service channel: holds the call in progress of an application
+	thread, which can be cancelled. Use one channel per thread
+*/
+typedef struct service_channel_t
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t idle; /*!< signalled when the last worker finished */
+	int32_t ap;
+	service_call_t* current; /*!< the call in progress, or NULL */
+	uint32_t workers; /*!< number of workers still running, including abandoned ones */
+
+} service_channel_t;
+
+/*!
+	The arguments of the property value read service
+*/
+typedef struct prop_value_read_args_t
+{
+	uint16_t ind_addr;
+	uint8_t object_index;
+	uint8_t prop_id;
+	uint8_t nr_of_elems;
+	uint16_t start_index;
+	uint8_t data[MAX_PROP_DATA_LEN];
+	uint32_t data_length;
+
+} prop_value_read_args_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Initializes the service channel
+*/
+static void service_channel_init(service_channel_t* channel, int32_t ap);
+
+/*!
+	Waits until all workers of the channel finished, including the
+	abandoned ones. Call it before the access port is closed
+*/
+static void service_channel_drain(service_channel_t* channel);
+
+/*!
+	Releases the resources of the channel, drain it first
+*/
+static void service_channel_destroy(service_channel_t* channel);
+
+/*!
+	Runs function on a worker thread and waits until it is finished,
+	the deadline (in ms) elapsed or the call was cancelled.
+	args (args_size octets) is copied to the call and copied back on success.
+	Returns the result of the function, KDRIVE_TIMEOUT_ERROR on deadline
+	or KDRIVE_SP_OPERATION_CANCELLED_ERROR on cancellation.
+*/
+static error_t service_call(service_channel_t* channel, service_function_t function,
+                            void* args, uint32_t args_size, uint32_t deadline);
+
+/*!
+	Cancels the call in progress on the channel. Thread-safe,
+	the waiting caller returns immediately
+*/
+static void service_cancel(service_channel_t* channel);
+
+/*!
+	Reads a property value with a deadline, see kdrive_sp_prop_value_read
+*/
+static error_t deadline_prop_value_read(service_channel_t* channel, uint16_t ind_addr,
+                                        uint8_t object_index, uint8_t prop_id, uint8_t nr_of_elems,
+                                        uint16_t start_index, uint8_t data[], uint32_t* data_length,
+                                        uint32_t deadline);
+
+/*!
+	The service function of deadline_prop_value_read
+*/
+static error_t prop_value_read_function(int32_t sp, void* args);
+
+/*!
+	The worker thread of a call
+*/
+static void* call_worker(void* arg);
+
+/*!
+	Drops one reference of the call and frees it with the last reference.
+	Called with the call mutex locked, unlocks it
+*/
+static void call_unref(service_call_t* call);
+
+/*!
+	The thread which cancels the call after a while (the "user")
+*/
+static void* cancel_thread(void* arg);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static service_channel_t channel;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	int32_t ap = KDRIVE_INVALID_DESCRIPTOR;
+	pthread_t thread;
+	uint8_t data[MAX_PROP_DATA_LEN];
+	uint32_t data_length = sizeof(data);
+	error_t e = KDRIVE_ERROR_NONE;
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	ap = kdrive_ap_create();
+	if ((ap == KDRIVE_INVALID_DESCRIPTOR) ||
+	    (kdrive_ap_enum_usb(ap) == 0) ||
+	    (kdrive_ap_open_usb(ap, 0) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the access port");
+		kdrive_ap_release(ap);
+		return -1;
+	}
+
+	service_channel_init(&channel, ap);
+
+	/* read the manufacturer of 1.1.1 (object 0, PID_MANUFACTURER_ID) */
+	e = deadline_prop_value_read(&channel, 0x1101, 0, 12, 1, 1, data, &data_length, SERVICE_DEADLINE);
+	if (e == KDRIVE_ERROR_NONE)
+	{
+		kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "Manufacturer:", data, data_length);
+	}
+	else
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Read finished with 0x%04X", e);
+	}
+
+	/* the same read, cancelled by another thread after 100 ms */
+	if (pthread_create(&thread, NULL, &cancel_thread, &channel) == 0)
+	{
+		data_length = sizeof(data);
+		e = deadline_prop_value_read(&channel, 0x1101, 0, 12, 1, 1, data, &data_length, SERVICE_DEADLINE);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Read finished with 0x%04X", e);
+		pthread_join(thread, NULL);
+	}
+
+	/* the cancelled worker is still reading on a service port of ap */
+	service_channel_drain(&channel);
+	service_channel_destroy(&channel);
+
+	kdrive_ap_close(ap);
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+void service_channel_init(service_channel_t* channel, int32_t ap)
+{
+	memset(channel, 0, sizeof(service_channel_t));
+	pthread_mutex_init(&channel->mutex, NULL);
+	pthread_cond_init(&channel->idle, NULL);
+	channel->ap = ap;
+}
+
+void service_channel_drain(service_channel_t* channel)
+{
+	pthread_mutex_lock(&channel->mutex);
+	while (channel->workers > 0)
+	{
+		pthread_cond_wait(&channel->idle, &channel->mutex);
+	}
+	pthread_mutex_unlock(&channel->mutex);
+}
+
+void service_channel_destroy(service_channel_t* channel)
+{
+	pthread_cond_destroy(&channel->idle);
+	pthread_mutex_destroy(&channel->mutex);
+}
+
+/*!
+	The call is created with two references, one for the caller and
+	one for the worker. The call is published on the channel before the
+	worker starts, so a cancel in between is not lost. The condition is
+	waited on with CLOCK_REALTIME, the default clock of a condition variable.
+*/
+error_t service_call(service_channel_t* channel, service_function_t function,
+                     void* args, uint32_t args_size, uint32_t deadline)
+{
+	service_call_t* call = NULL;
+	struct timespec abs_deadline;
+	pthread_t thread;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	call = (service_call_t*) calloc(1, sizeof(service_call_t));
+	if (call && args_size)
+	{
+		call->args = malloc(args_size);
+	}
+	if (!call || (args_size && !call->args))
+	{
+		free(call);
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+
+	pthread_mutex_init(&call->mutex, NULL);
+	pthread_cond_init(&call->cond, NULL);
+	call->channel = channel;
+	call->ap = channel->ap;
+	call->function = function;
+	memcpy(call->args, args, args_size);
+	call->args_size = args_size;
+	call->timeout = deadline;
+	call->refs = 2;
+
+	clock_gettime(CLOCK_REALTIME, &abs_deadline);
+	abs_deadline.tv_sec += deadline / 1000;
+	abs_deadline.tv_nsec += (long)(deadline % 1000) * 1000000L;
+	abs_deadline.tv_sec += abs_deadline.tv_nsec / 1000000000L;
+	abs_deadline.tv_nsec %= 1000000000L;
+
+	pthread_mutex_lock(&channel->mutex);
+	channel->current = call;
+	++channel->workers;
+	pthread_mutex_unlock(&channel->mutex);
+
+	if (pthread_create(&thread, NULL, &call_worker, call) != 0)
+	{
+		pthread_mutex_lock(&channel->mutex);
+		channel->current = NULL;
+		--channel->workers;
+		pthread_mutex_unlock(&channel->mutex);
+
+		pthread_cond_destroy(&call->cond);
+		pthread_mutex_destroy(&call->mutex);
+		free(call->args);
+		free(call);
+		return KDRIVE_UNKNOWN_ERROR;
+	}
+	pthread_detach(thread);
+
+	pthread_mutex_lock(&call->mutex);
+	while (!call->done && !call->cancelled)
+	{
+		if (pthread_cond_timedwait(&call->cond, &call->mutex, &abs_deadline) != 0)
+		{
+			break;
+		}
+	}
+
+	if (call->done)
+	{
+		e = call->result;
+		if (e == KDRIVE_ERROR_NONE)
+		{
+			memcpy(args, call->args, args_size);
+		}
+	}
+	else
+	{
+		e = call->cancelled ? KDRIVE_SP_OPERATION_CANCELLED_ERROR : KDRIVE_TIMEOUT_ERROR;
+	}
+	pthread_mutex_unlock(&call->mutex);
+
+	pthread_mutex_lock(&channel->mutex);
+	channel->current = NULL;
+	pthread_mutex_lock(&call->mutex);
+	call_unref(call);
+	pthread_mutex_unlock(&channel->mutex);
+
+	return e;
+}
+
+/*!
+	The channel mutex keeps the call alive while it is cancelled,
+	the caller drops its reference only with the channel mutex locked.
+*/
+void service_cancel(service_channel_t* channel)
+{
+	service_call_t* call = NULL;
+
+	pthread_mutex_lock(&channel->mutex);
+	call = channel->current;
+	if (call)
+	{
+		pthread_mutex_lock(&call->mutex);
+		call->cancelled = 1;
+		pthread_cond_signal(&call->cond);
+		pthread_mutex_unlock(&call->mutex);
+	}
+	pthread_mutex_unlock(&channel->mutex);
+}
+
+error_t deadline_prop_value_read(service_channel_t* channel, uint16_t ind_addr,
+                                 uint8_t object_index, uint8_t prop_id, uint8_t nr_of_elems,
+                                 uint16_t start_index, uint8_t data[], uint32_t* data_length,
+                                 uint32_t deadline)
+{
+	prop_value_read_args_t args;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	memset(&args, 0, sizeof(prop_value_read_args_t));
+	args.ind_addr = ind_addr;
+	args.object_index = object_index;
+	args.prop_id = prop_id;
+	args.nr_of_elems = nr_of_elems;
+	args.start_index = start_index;
+	args.data_length = (*data_length < MAX_PROP_DATA_LEN) ? *data_length : MAX_PROP_DATA_LEN;
+
+	e = service_call(channel, &prop_value_read_function, &args, sizeof(args), deadline);
+	if (e == KDRIVE_ERROR_NONE)
+	{
+		memcpy(data, args.data, args.data_length);
+		*data_length = args.data_length;
+	}
+
+	return e;
+}
+
+error_t prop_value_read_function(int32_t sp, void* args)
+{
+	prop_value_read_args_t* a = (prop_value_read_args_t*) args;
+
+	return kdrive_sp_prop_value_read(sp, a->ind_addr, a->object_index, a->prop_id,
+	                                 a->nr_of_elems, a->start_index, a->data, &a->data_length);
+}
+
+/*!
+	The worker skips the service when the call was cancelled
+	before it started. It leaves the channel after it dropped
+	its reference, the call may be freed by then
+*/
+void* call_worker(void* arg)
+{
+	service_call_t* call = (service_call_t*) arg;
+	service_channel_t* channel = call->channel;
+	int32_t sp = KDRIVE_INVALID_DESCRIPTOR;
+	error_t e = KDRIVE_SP_OPERATION_CANCELLED_ERROR;
+	bool_t cancelled = 0;
+
+	pthread_mutex_lock(&call->mutex);
+	cancelled = call->cancelled;
+	pthread_mutex_unlock(&call->mutex);
+
+	if (!cancelled)
+	{
+		sp = kdrive_sp_create(call->ap);
+		if (sp == KDRIVE_INVALID_DESCRIPTOR)
+		{
+			e = KDRIVE_UNKNOWN_ERROR;
+		}
+		else
+		{
+			kdrive_sp_set_response_timeout(sp, call->timeout);
+			e = call->function(sp, call->args);
+			kdrive_sp_release(sp);
+		}
+	}
+
+	pthread_mutex_lock(&call->mutex);
+	call->result = e;
+	call->done = 1;
+	pthread_cond_signal(&call->cond);
+	call_unref(call);
+
+	pthread_mutex_lock(&channel->mutex);
+	if (--channel->workers == 0)
+	{
+		pthread_cond_broadcast(&channel->idle);
+	}
+	pthread_mutex_unlock(&channel->mutex);
+
+	return NULL;
+}
+
+void call_unref(service_call_t* call)
+{
+	bool_t last = (--call->refs == 0);
+
+	pthread_mutex_unlock(&call->mutex);
+
+	if (last)
+	{
+		pthread_cond_destroy(&call->cond);
+		pthread_mutex_destroy(&call->mutex);
+		free(call->args);
+		free(call);
+	}
+}
+
+void* cancel_thread(void* arg)
+{
+	usleep(100 * 1000);
+	service_cancel((service_channel_t*) arg);
+	return NULL;
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
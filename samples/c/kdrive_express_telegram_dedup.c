@@ -0,0 +1,630 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Received Telegram Deduplication
+
+	A telegram which is not acknowledged on the bus is repeated (up to
+	three times) with the repeat flag cleared. With several interfaces on
+	overlapping lines the same telegram is also received more than once.
+
+	This sample registers a telegram callback which drops these copies
+	before they are passed on to the application callback (i.e. before
+	they are queued, see kdrive_express_callback_pool.c):
+	- an L_Data.ind is identified by its source address, destination
+	  address (and address type), APCI and a hash of the payload
+	- the recently received telegrams are kept in a small hash table,
+	  an entry expires after the repeat window
+	- a repeated frame (repeat flag cleared) with a known key is dropped
+	  within the repeat window
+	- a frame which is not repeated with a known key is dropped within the
+	  (shorter) duplicate window only: a device may send the same value
+	  again on purpose, and two interfaces deliver a copy within a few ms
+	- other message codes (i.e. L_Data.con) are always passed on
+
+	The filter can be enabled and disabled at runtime, the dropped
+	telegrams are counted.
+
+	Start the sample with the argument "bench" to run the filter on a
+	generated telegram stream with repeats and duplicates without an
+	interface device.
+
+	This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_telegram_dedup kdrive_express_telegram_dedup.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN			(128)	/*!< kdriveExpress Error Messages */
+#define DEDUP_TABLE_SIZE			(256)	/*!< number of entries of the hash table, a power of two */
+#define DEDUP_MAX_PROBE				(8)		/*!< number of entries searched for a key */
+#define DEDUP_REPEAT_WINDOW			(1000)	/*!< repeated frames are dropped within this time, in ms */
+#define DEDUP_DUPLICATE_WINDOW		(100)	/*!< frames which are not repeated are dropped within this time, in ms */
+#define DEDUP_MAX_PORTS				(8)		/*!< max number of access ports a filter is registered with */
+#define CEMI_REPEAT_FLAG			(0x20)	/*!< control field 1: 0 = repeated frame */
+#define CEMI_GROUP_ADDRESS			(0x80)	/*!< control field 2: destination address type */
+
+#define BENCH_TELEGRAMS				(1000000)	/*!< number of original telegrams in the benchmark */
+#define BENCH_ADDRESSES				(64)	/*!< number of different group addresses used by the benchmark */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	The identity of an L_Data.ind
+*/
+typedef struct dedup_key_t
+{
+	uint16_t src; /*!< source address */
+	uint16_t dest; /*!< destination address */
+	uint16_t apci; /*!< the APCI including the short data (6 bits) */
+	uint16_t flags; /*!< destination address type and payload length */
+	uint32_t payload; /*!< hash of the payload after the APCI */
+
+} dedup_key_t;
+
+/*!
+	An entry of the hash table
+*/
+typedef struct dedup_entry_t
+{
+	dedup_key_t key;
+	uint32_t seen; /*!< time the telegram was passed on (ms) */
+	bool_t used; /*!< 0 if the entry was never used */
+
+} dedup_entry_t;
+
+/*!
+	The counters of the filter
+*/
+typedef struct dedup_stats_t
+{
+	uint32_t passed; /*!< number of telegrams passed on */
+	uint32_t repeats; /*!< number of dropped repeated frames */
+	uint32_t duplicates; /*!< number of dropped frames which were not repeated */
+	uint32_t evicted; /*!< number of entries replaced before they expired */
+
+} dedup_stats_t;
+
+/*!
+	A registration of the filter with an access port
+*/
+typedef struct dedup_port_t
+{
+	int32_t ap; /*!< the access port descriptor */
+	uint32_t key; /*!< the telegram callback key */
+
+} dedup_port_t;
+
+/*!
+	The deduplication filter
+*/
+typedef struct dedup_filter_t
+{
+	dedup_port_t ports[DEDUP_MAX_PORTS]; /*!< the access ports the filter is registered with */
+	uint32_t port_count;
+	kdrive_ap_telegram_callback callback; /*!< the application telegram callback */
+	void* user_data; /*!< the user data passed to the callback */
+
+	pthread_mutex_t mutex; /*!< the filter may be shared by several access ports */
+	bool_t enabled;
+	uint32_t repeat_window; /*!< in ms */
+	uint32_t duplicate_window; /*!< in ms */
+	dedup_entry_t table[DEDUP_TABLE_SIZE];
+	dedup_stats_t stats;
+
+} dedup_filter_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Initializes the filter, the filter is enabled
+	\param repeat_window repeated frames are dropped within this time (ms)
+	\param duplicate_window frames which are not repeated are dropped within this time (ms)
+*/
+static void dedup_init(dedup_filter_t* filter, kdrive_ap_telegram_callback c, void* user_data,
+                       uint32_t repeat_window, uint32_t duplicate_window);
+
+/*!
+	Registers the filter as telegram callback of the access port.
+	This is the filtered variant of kdrive_ap_register_telegram_callback.
+	A filter can be registered with up to DEDUP_MAX_PORTS access ports
+*/
+static error_t dedup_register_telegram_callback(dedup_filter_t* filter, int32_t ap);
+
+/*!
+	Removes the telegram callback from all access ports
+*/
+static void dedup_remove_telegram_callback(dedup_filter_t* filter);
+
+/*!
+	Enables or disables the filter. A disabled filter passes on all telegrams
+*/
+static void dedup_enable(dedup_filter_t* filter, bool_t enabled);
+
+/*!
+	Copies the counters
+*/
+static void dedup_get_stats(dedup_filter_t* filter, dedup_stats_t* stats);
+
+/*!
+	Returns 1 if the telegram is passed on
+	\param now the current time in ms
+*/
+static bool_t dedup_check(dedup_filter_t* filter, const uint8_t* telegram, uint32_t telegram_len, uint32_t now);
+
+/*!
+	Decodes the key of an L_Data.ind.
+	Returns 0 for other telegrams
+*/
+static bool_t dedup_key(const uint8_t* telegram, uint32_t telegram_len, dedup_key_t* key, bool_t* repeated);
+
+/*!
+	The telegram callback registered with the access port
+*/
+static void on_dedup_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Runs the filter on a generated telegram stream
+*/
+static void run_benchmark(void);
+
+/*!
+	Passes a telegram of the benchmark to the filter at the simulated time now
+*/
+static void bench_feed(const uint8_t* telegram, uint32_t telegram_len, uint32_t now, uint32_t* delivered);
+
+/*!
+	Telegram Callback Handler of the application
+*/
+static void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static dedup_filter_t filter;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	dedup_stats_t stats;
+	int32_t ap = 0;
+
+	/*
+		Configure the logging level and console logger
+	*/
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	if ((argc > 1) && (strcmp(argv[1], "bench") == 0))
+	{
+		run_benchmark();
+		return 0;
+	}
+
+	/*
+		We create a Access Port descriptor. This descriptor is then used for
+		all calls to that specific access port.
+	*/
+	ap = kdrive_ap_create();
+
+	/*
+		We check that we were able to allocate a new descriptor
+		This should always happen, unless a bad_alloc exception is internally thrown
+		which means the memory couldn't be allocated.
+	*/
+	if (ap == KDRIVE_INVALID_DESCRIPTOR)
+	{
+		kdrive_logger(KDRIVE_LOGGER_FATAL, "Unable to create access port. This is a terminal failure");
+		while (1)
+		{
+			;
+		}
+	}
+
+	/*
+		We register the filter instead of the application callback,
+		the filter passes on the first copy of each telegram
+	*/
+	dedup_init(&filter, &on_telegram, NULL, DEDUP_REPEAT_WINDOW, DEDUP_DUPLICATE_WINDOW);
+	dedup_register_telegram_callback(&filter, ap);
+
+	/* Open the first USB interface */
+	if ((kdrive_ap_enum_usb(ap) > 0) && (kdrive_ap_open_usb(ap, 0) == KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Press [Enter] to exit the application ...");
+		getchar();
+
+		dedup_get_stats(&filter, &stats);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "passed %u, repeats %u, duplicates %u, evicted %u",
+		                 stats.passed, stats.repeats, stats.duplicates, stats.evicted);
+
+		kdrive_ap_close(ap);
+	}
+
+	dedup_remove_telegram_callback(&filter);
+
+	/* releases the access port */
+	kdrive_ap_release(ap);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+void dedup_init(dedup_filter_t* filter, kdrive_ap_telegram_callback c, void* user_data,
+                uint32_t repeat_window, uint32_t duplicate_window)
+{
+	memset(filter, 0, sizeof(dedup_filter_t));
+	filter->callback = c;
+	filter->user_data = user_data;
+	filter->enabled = 1;
+	filter->repeat_window = repeat_window;
+	filter->duplicate_window = duplicate_window;
+	pthread_mutex_init(&filter->mutex, NULL);
+}
+
+error_t dedup_register_telegram_callback(dedup_filter_t* filter, int32_t ap)
+{
+	dedup_port_t* port = 0;
+	error_t e = KDRIVE_ERROR_NONE;
+
+	if (filter->port_count >= DEDUP_MAX_PORTS)
+	{
+		return KDRIVE_BUFFER_TOO_SMALL_ERROR;
+	}
+
+	port = &filter->ports[filter->port_count];
+	e = kdrive_ap_register_telegram_callback(ap, &on_dedup_telegram, filter, &port->key);
+	if (e == KDRIVE_ERROR_NONE)
+	{
+		port->ap = ap;
+		++filter->port_count;
+	}
+
+	return e;
+}
+
+void dedup_remove_telegram_callback(dedup_filter_t* filter)
+{
+	uint32_t index = 0;
+
+	for (index = 0; index < filter->port_count; ++index)
+	{
+		kdrive_ap_remove_telegram_callback(filter->ports[index].ap, filter->ports[index].key);
+	}
+	filter->port_count = 0;
+}
+
+/*!
+	The table is cleared, so a telegram received while the filter
+	was disabled is not compared with an old entry
+*/
+void dedup_enable(dedup_filter_t* filter, bool_t enabled)
+{
+	pthread_mutex_lock(&filter->mutex);
+	if (enabled && !filter->enabled)
+	{
+		memset(filter->table, 0, sizeof(filter->table));
+	}
+	filter->enabled = enabled;
+	pthread_mutex_unlock(&filter->mutex);
+}
+
+void dedup_get_stats(dedup_filter_t* filter, dedup_stats_t* stats)
+{
+	pthread_mutex_lock(&filter->mutex);
+	*stats = filter->stats;
+	pthread_mutex_unlock(&filter->mutex);
+}
+
+/*!
+	The key is searched in DEDUP_MAX_PROBE entries from its hash position,
+	so the cost is bounded. An expired entry counts as free. A new key takes
+	the first free entry, or the oldest one (eviction) when all are in use.
+	The time of an entry is only updated when a telegram is passed on,
+	so the windows start with the original frame.
+*/
+bool_t dedup_check(dedup_filter_t* filter, const uint8_t* telegram, uint32_t telegram_len, uint32_t now)
+{
+	dedup_key_t key;
+	dedup_entry_t* entry = 0;
+	dedup_entry_t* found = 0;
+	dedup_entry_t* free_entry = 0;
+	dedup_entry_t* oldest = 0;
+	uint32_t oldest_age = 0;
+	uint32_t hash = 0;
+	uint32_t probe = 0;
+	uint32_t age = 0;
+	bool_t repeated = 0;
+	bool_t passed = 1;
+
+	if (!dedup_key(telegram, telegram_len, &key, &repeated))
+	{
+		return 1;
+	}
+
+	hash = ((((uint32_t) key.src << 16) | key.dest) * 2654435761u) ^ (key.payload + key.apci + key.flags);
+	hash ^= hash >> 15;
+
+	pthread_mutex_lock(&filter->mutex);
+
+	if (!filter->enabled)
+	{
+		++filter->stats.passed;
+		pthread_mutex_unlock(&filter->mutex);
+		return 1;
+	}
+
+	for (probe = 0; (probe < DEDUP_MAX_PROBE) && !found; ++probe)
+	{
+		entry = &filter->table[(hash + probe) & (DEDUP_TABLE_SIZE - 1)];
+
+		/* telegrams of several access ports may arrive slightly out of order */
+		age = ((int32_t)(now - entry->seen) > 0) ? now - entry->seen : 0;
+
+		if (!entry->used || (age > filter->repeat_window))
+		{
+			if (!free_entry)
+			{
+				free_entry = entry;
+			}
+		}
+		else if (memcmp(&entry->key, &key, sizeof(dedup_key_t)) == 0)
+		{
+			found = entry;
+			if (repeated)
+			{
+				++filter->stats.repeats;
+				passed = 0;
+			}
+			else if (age <= filter->duplicate_window)
+			{
+				++filter->stats.duplicates;
+				passed = 0;
+			}
+		}
+		else if (!oldest || (age > oldest_age))
+		{
+			oldest = entry;
+			oldest_age = age;
+		}
+	}
+
+	if (passed)
+	{
+		if (!found && !free_entry)
+		{
+			++filter->stats.evicted;
+		}
+		entry = found ? found : (free_entry ? free_entry : oldest);
+		entry->key = key;
+		entry->seen = now;
+		entry->used = 1;
+		++filter->stats.passed;
+	}
+
+	pthread_mutex_unlock(&filter->mutex);
+
+	return passed;
+}
+
+/*!
+	cEMI L_Data.ind: message code, additional info length, additional info,
+	control field 1, control field 2, source, destination, length, TPCI/APCI, data.
+	The key is built from the raw frame, this is called for every received telegram.
+*/
+bool_t dedup_key(const uint8_t* telegram, uint32_t telegram_len, dedup_key_t* key, bool_t* repeated)
+{
+	const uint8_t* frame = 0;
+	uint32_t frame_len = 0;
+	uint32_t hash = 2166136261u;
+	uint32_t index = 0;
+
+	if ((telegram_len < 2) || (telegram[0] != KDRIVE_CEMI_L_DATA_IND) || (telegram_len < 2u + telegram[1] + 9u))
+	{
+		return 0;
+	}
+
+	frame = &telegram[2 + telegram[1]];
+	frame_len = telegram_len - 2u - telegram[1];
+
+	/* FNV-1a over the data after the APCI */
+	for (index = 9; index < frame_len; ++index)
+	{
+		hash = (hash ^ frame[index]) * 16777619u;
+	}
+
+	memset(key, 0, sizeof(dedup_key_t));
+	key->src = (uint16_t)((frame[2] << 8) | frame[3]);
+	key->dest = (uint16_t)((frame[4] << 8) | frame[5]);
+	key->apci = (uint16_t)(((frame[7] & 0x03) << 8) | frame[8]);
+	key->flags = (uint16_t)(((frame[1] & CEMI_GROUP_ADDRESS) << 8) | frame[6]);
+	key->payload = hash;
+	*repeated = (frame[0] & CEMI_REPEAT_FLAG) ? 0 : 1;
+
+	return 1;
+}
+
+void on_dedup_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	dedup_filter_t* filter = (dedup_filter_t*) user_data;
+
+	if (dedup_check(filter, telegram, telegram_len, now_ms()) && filter->callback)
+	{
+		filter->callback(telegram, telegram_len, filter->user_data);
+	}
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
+}
+
+/*!
+	Generates BENCH_TELEGRAMS GroupValue_Write telegrams for BENCH_ADDRESSES
+	group addresses with a 2 byte value, one every 20 ms (a busy TP line):
+	- every 8th telegram is received a second time 5 ms later (i.e. on another interface)
+	- every 4th telegram is repeated twice (repeat flag cleared)
+	- every 16th telegram is sent again with the same value 500 ms later,
+	  this one has to be passed on
+	The time is simulated, so the run measures the cost of the filter only.
+*/
+void run_benchmark(void)
+{
+	uint8_t telegram[] = { 0x29, 0x00, 0xBC, 0xE0, 0x11, 0x01, 0x09, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00 };
+	uint32_t delivered = 0;
+	uint32_t expected = 0;
+	uint32_t sent = 0;
+	uint32_t index = 0;
+	uint32_t now = 0;
+	uint16_t address = 0;
+	bool_t enabled = 1;
+	struct timespec start;
+	struct timespec end;
+	double seconds = 0;
+	dedup_stats_t stats;
+
+	/* the second run with the filter disabled shows the load without deduplication */
+	for (enabled = 1; enabled >= 0; --enabled)
+	{
+		dedup_init(&filter, 0, 0, DEDUP_REPEAT_WINDOW, DEDUP_DUPLICATE_WINDOW);
+		dedup_enable(&filter, enabled);
+		delivered = 0;
+		expected = 0;
+		sent = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (index = 0; index < BENCH_TELEGRAMS; ++index)
+		{
+			now = index * 20;
+			address = (uint16_t)(0x0900 + (index % BENCH_ADDRESSES));
+			telegram[2] = 0xBC;
+			telegram[6] = (uint8_t)(address >> 8);
+			telegram[7] = (uint8_t)(address & 0xFF);
+			telegram[11] = (uint8_t)(index >> 8);
+			telegram[12] = (uint8_t)(index & 0xFF);
+
+			bench_feed(telegram, sizeof(telegram), now, &delivered);
+			++expected;
+			++sent;
+
+			if ((index % 8) == 0)
+			{
+				bench_feed(telegram, sizeof(telegram), now + 5, &delivered);
+				++sent;
+			}
+
+			if ((index % 4) == 0)
+			{
+				telegram[2] = 0x9C; /* repeat flag cleared */
+				bench_feed(telegram, sizeof(telegram), now + 10, &delivered);
+				bench_feed(telegram, sizeof(telegram), now + 20, &delivered);
+				telegram[2] = 0xBC;
+				sent += 2;
+			}
+
+			if ((index % 16) == 0)
+			{
+				bench_feed(telegram, sizeof(telegram), now + 500, &delivered);
+				++expected;
+				++sent;
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		seconds = (double)(end.tv_sec - start.tv_sec) + ((double)(end.tv_nsec - start.tv_nsec) / 1e9);
+
+		dedup_get_stats(&filter, &stats);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "filter %s: %u telegrams in %.3f s, %.0f ns per telegram",
+		                 enabled ? "enabled" : "disabled", sent, seconds, seconds * 1e9 / sent);
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "delivered %u (expected %u), repeats %u, duplicates %u, evicted %u",
+		                 delivered, expected, stats.repeats, stats.duplicates, stats.evicted);
+	}
+}
+
+void bench_feed(const uint8_t* telegram, uint32_t telegram_len, uint32_t now, uint32_t* delivered)
+{
+	if (dedup_check(&filter, telegram, telegram_len, now))
+	{
+		++*delivered;
+	}
+}
+
+/*!
+	When a telegram is received we check to see if it is a group value write
+	telegram and if so, we print out the datapoint value
+*/
+void on_telegram(const uint8_t* telegram, uint32_t telegram_len, void* user_data)
+{
+	static uint8_t data[KDRIVE_MAX_GROUP_VALUE_LEN];
+	uint32_t data_len = KDRIVE_MAX_GROUP_VALUE_LEN;
+	uint16_t address = 0;
+
+	if (kdrive_ap_is_group_write(telegram, telegram_len) &&
+	    (kdrive_ap_get_dest(telegram, telegram_len, &address) == KDRIVE_ERROR_NONE) &&
+	    (kdrive_ap_get_group_data(telegram, telegram_len, data, &data_len) == KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "A_GroupValue_Write: 0x%04x ", address);
+		kdrive_logger_dump(KDRIVE_LOGGER_INFORMATION, "A_GroupValue_Write Data :", data, data_len);
+	}
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
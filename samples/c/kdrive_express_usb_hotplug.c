@@ -0,0 +1,573 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Watches for KNX USB interfaces being plugged and unplugged.
+
+	kdrive_ap_enum_usb_ex scans all HID devices on each call. Instead of
+	calling it periodically, the watcher listens to the udev events on a
+	netlink socket and only scans when a hidraw device was added or
+	removed. Events which arrive within USB_WATCH_DEBOUNCE ms are handled
+	with a single scan. The result is kept in a cache which is read
+	without scanning (usb_watch_get), and the differences to the previous
+	scan are reported with the arrival and removal callbacks.
+
+	The event source is a datagram socket and the scan function can be
+	replaced, so the watcher can be tested without udev and without
+	devices: "kdrive_express_usb_hotplug fake" sends fake events over a
+	socket pair and simulates the devices.
+
+	Linux only. This sample uses POSIX threads, i.e.
+	gcc -I../../include -o kdrive_express_usb_hotplug kdrive_express_usb_hotplug.c -lkdriveExpress -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <kdrive_express.h>
+
+#define ERROR_MESSAGE_LEN		(128)	/*!< kdriveExpress Error Messages */
+#define USB_WATCH_MAX_DEVICES	(16)	/*!< max number of cached usb interfaces */
+#define USB_WATCH_DEBOUNCE		(200)	/*!< ms to collect events before scanning */
+#define USB_WATCH_EVENT_LEN		(8192)	/*!< max size of an uevent message */
+#define UDEV_MONITOR_GROUP		(2)		/*!< netlink group of the events processed by udev */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	Scans for the usb interfaces, see kdrive_ap_enum_usb_ex
+*/
+typedef error_t (*usb_enum_function)(usb_dev_t items[], uint32_t* items_length);
+
+/*!
+	Called on the watcher thread when an interface arrived or was removed
+*/
+typedef void (*usb_watch_callback)(const usb_dev_t* dev, void* user_data);
+
+/*!
+	The watcher with the device cache
+*/
+typedef struct usb_watch_t
+{
+	int fd; /*!< the event source */
+	usb_enum_function enumerate;
+	usb_watch_callback on_arrival;
+	usb_watch_callback on_removal;
+	void* user_data;
+
+	pthread_mutex_t mutex; /*!< protects the cache */
+	usb_dev_t devices[USB_WATCH_MAX_DEVICES];
+	uint32_t device_count;
+	uint32_t scans; /*!< number of scans, for statistics */
+
+	pthread_t thread;
+	volatile int stop;
+
+} usb_watch_t;
+
+/*!
+	The simulated devices of the fake mode
+*/
+typedef struct fake_bus_t
+{
+	pthread_mutex_t mutex;
+	usb_dev_t devices[USB_WATCH_MAX_DEVICES];
+	uint32_t device_count;
+
+} fake_bus_t;
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Opens the netlink socket for the udev events.
+	Returns the socket or -1
+*/
+static int usb_watch_open_netlink(void);
+
+/*!
+	Scans once, reports the found interfaces as arrivals and starts
+	the watcher thread on the event source fd. The watcher owns fd.
+	Returns 0 on success
+*/
+static int usb_watch_start(usb_watch_t* watch, int fd, usb_enum_function enumerate,
+                           usb_watch_callback on_arrival, usb_watch_callback on_removal, void* user_data);
+
+/*!
+	Stops the watcher thread and closes the event source
+*/
+static void usb_watch_stop(usb_watch_t* watch);
+
+/*!
+	Copies the cached interfaces, without scanning.
+	items_length is the capacity (in) and the number of interfaces (out)
+*/
+static void usb_watch_get(usb_watch_t* watch, usb_dev_t items[], uint32_t* items_length);
+
+/*!
+	The watcher thread
+*/
+static void* usb_watch_thread(void* arg);
+
+/*!
+	Scans and reports the differences to the cache
+*/
+static void usb_watch_rescan(usb_watch_t* watch);
+
+/*!
+	Returns 1 if the uevent message is about a hidraw device
+	being added or removed
+*/
+static int usb_watch_is_relevant(const char* message, uint32_t length);
+
+/*!
+	Returns 1 if both entries describe the same interface
+	(the internal usb index can change when another one is removed)
+*/
+static int usb_dev_equal(const usb_dev_t* a, const usb_dev_t* b);
+
+/*!
+	Sends a fake uevent to the watcher
+*/
+static void fake_event(int fd, const char* action);
+
+/*!
+	The scan function of the fake mode
+*/
+static error_t fake_enum(usb_dev_t items[], uint32_t* items_length);
+
+/*!
+	Logs an arrival
+*/
+static void on_arrival(const usb_dev_t* dev, void* user_data);
+
+/*!
+	Logs a removal
+*/
+static void on_removal(const usb_dev_t* dev, void* user_data);
+
+/*!
+	Returns the monotonic time in milliseconds.
+	The value wraps around, only use it for differences
+*/
+static uint32_t now_ms(void);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Private Variables
+********************************/
+
+static usb_watch_t watch;
+static fake_bus_t fake_bus;
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	usb_dev_t items[USB_WATCH_MAX_DEVICES];
+	uint32_t items_length = USB_WATCH_MAX_DEVICES;
+	int fds[2] = { -1, -1 };
+	int fd = -1;
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	if ((argc > 1) && (strcmp(argv[1], "fake") == 0))
+	{
+		/* one device present at the start */
+		pthread_mutex_init(&fake_bus.mutex, NULL);
+		fake_bus.devices[0].ind_addr = 0xFFFF;
+		fake_bus.devices[0].usb_vendor_id = 0x0E77;
+		fake_bus.devices[0].usb_product_id = 0x0104;
+		fake_bus.device_count = 1;
+
+		if ((socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) != 0) ||
+		        (usb_watch_start(&watch, fds[0], &fake_enum, &on_arrival, &on_removal, NULL) != 0))
+		{
+			kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to start the watcher");
+			return -1;
+		}
+
+		/* plug a second device, the usb and hidraw events come in a burst */
+		pthread_mutex_lock(&fake_bus.mutex);
+		fake_bus.devices[1] = fake_bus.devices[0];
+		fake_bus.devices[1].ind_addr = 0x1101;
+		fake_bus.devices[1].internal_usb_index = 1;
+		fake_bus.device_count = 2;
+		pthread_mutex_unlock(&fake_bus.mutex);
+		fake_event(fds[1], "add");
+		fake_event(fds[1], "add");
+		usleep(2 * USB_WATCH_DEBOUNCE * 1000);
+
+		/* unplug the first device, the index of the second changes */
+		pthread_mutex_lock(&fake_bus.mutex);
+		fake_bus.devices[0] = fake_bus.devices[1];
+		fake_bus.devices[0].internal_usb_index = 0;
+		fake_bus.device_count = 1;
+		pthread_mutex_unlock(&fake_bus.mutex);
+		fake_event(fds[1], "remove");
+		usleep(2 * USB_WATCH_DEBOUNCE * 1000);
+
+		close(fds[1]);
+	}
+	else
+	{
+		fd = usb_watch_open_netlink();
+		if ((fd < 0) || (usb_watch_start(&watch, fd, &kdrive_ap_enum_usb_ex, &on_arrival, &on_removal, NULL) != 0))
+		{
+			kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to start the watcher");
+			return -1;
+		}
+
+		kdrive_logger(KDRIVE_LOGGER_INFORMATION, "Plug or unplug a KNX USB interface, press [Enter] to exit");
+		getchar();
+	}
+
+	usb_watch_get(&watch, items, &items_length);
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%u interface(s) cached, %u scan(s)", items_length, watch.scans);
+
+	usb_watch_stop(&watch);
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+int usb_watch_open_netlink(void)
+{
+	struct sockaddr_nl addr;
+	int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = UDEV_MONITOR_GROUP;
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int usb_watch_start(usb_watch_t* watch, int fd, usb_enum_function enumerate,
+                    usb_watch_callback on_arrival, usb_watch_callback on_removal, void* user_data)
+{
+	memset(watch, 0, sizeof(usb_watch_t));
+	watch->fd = fd;
+	watch->enumerate = enumerate;
+	watch->on_arrival = on_arrival;
+	watch->on_removal = on_removal;
+	watch->user_data = user_data;
+	pthread_mutex_init(&watch->mutex, NULL);
+
+	usb_watch_rescan(watch);
+
+	if (pthread_create(&watch->thread, NULL, &usb_watch_thread, watch) != 0)
+	{
+		pthread_mutex_destroy(&watch->mutex);
+		close(fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+void usb_watch_stop(usb_watch_t* watch)
+{
+	watch->stop = 1;
+	pthread_join(watch->thread, NULL);
+	close(watch->fd);
+	pthread_mutex_destroy(&watch->mutex);
+}
+
+void usb_watch_get(usb_watch_t* watch, usb_dev_t items[], uint32_t* items_length)
+{
+	pthread_mutex_lock(&watch->mutex);
+	if (*items_length > watch->device_count)
+	{
+		*items_length = watch->device_count;
+	}
+	memcpy(items, watch->devices, *items_length * sizeof(usb_dev_t));
+	pthread_mutex_unlock(&watch->mutex);
+}
+
+/*!
+	The poll timeout is the stop latency when there are no events.
+	After a relevant event the thread keeps reading events until
+	USB_WATCH_DEBOUNCE ms have passed, then it scans once. The deadline
+	is checked after each wakeup, so a steady stream of other events
+	doesn't delay the scan. Lost events (ENOBUFS) also lead to a scan.
+*/
+void* usb_watch_thread(void* arg)
+{
+	usb_watch_t* watch = (usb_watch_t*) arg;
+	char message[USB_WATCH_EVENT_LEN];
+	struct pollfd pfd;
+	int pending = 0;
+	int relevant = 0;
+	int timeout = 0;
+	uint32_t pending_since = 0;
+	uint32_t elapsed = 0;
+	ssize_t n = 0;
+
+	pfd.fd = watch->fd;
+	pfd.events = POLLIN;
+
+	while (!watch->stop)
+	{
+		timeout = 100;
+		if (pending)
+		{
+			elapsed = now_ms() - pending_since;
+			timeout = (elapsed >= USB_WATCH_DEBOUNCE) ? 0 : (int)(USB_WATCH_DEBOUNCE - elapsed);
+		}
+
+		relevant = 0;
+		if (poll(&pfd, 1, timeout) > 0)
+		{
+			n = recv(watch->fd, message, sizeof(message) - 1, 0);
+			if (n > 0)
+			{
+				message[n] = 0;
+				relevant = usb_watch_is_relevant(message, (uint32_t) n);
+			}
+			else if (n == 0)
+			{
+				/* the fake source was closed */
+				pfd.fd = -1;
+			}
+			else if (errno == ENOBUFS)
+			{
+				/* the socket buffer overflowed, events were lost */
+				relevant = 1;
+			}
+		}
+
+		if (relevant && !pending)
+		{
+			pending = 1;
+			pending_since = now_ms();
+		}
+
+		if (pending && (now_ms() - pending_since >= USB_WATCH_DEBOUNCE))
+		{
+			pending = 0;
+			usb_watch_rescan(watch);
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+	The cache is updated before the callbacks are called,
+	so a callback sees the new state in usb_watch_get.
+	The callbacks are called without the mutex locked.
+*/
+void usb_watch_rescan(usb_watch_t* watch)
+{
+	usb_dev_t found[USB_WATCH_MAX_DEVICES];
+	usb_dev_t arrived[USB_WATCH_MAX_DEVICES];
+	usb_dev_t removed[USB_WATCH_MAX_DEVICES];
+	uint8_t matched[USB_WATCH_MAX_DEVICES];
+	uint32_t found_count = USB_WATCH_MAX_DEVICES;
+	uint32_t arrived_count = 0;
+	uint32_t removed_count = 0;
+	uint32_t index = 0;
+	uint32_t old = 0;
+
+	if (watch->enumerate(found, &found_count) != KDRIVE_ERROR_NONE)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&watch->mutex);
+
+	/* match each found interface with one cached interface */
+	memset(matched, 0, sizeof(matched));
+	for (index = 0; index < found_count; ++index)
+	{
+		for (old = 0; old < watch->device_count; ++old)
+		{
+			if (!matched[old] && usb_dev_equal(&found[index], &watch->devices[old]))
+			{
+				matched[old] = 1;
+				break;
+			}
+		}
+		if (old == watch->device_count)
+		{
+			arrived[arrived_count++] = found[index];
+		}
+	}
+	for (old = 0; old < watch->device_count; ++old)
+	{
+		if (!matched[old])
+		{
+			removed[removed_count++] = watch->devices[old];
+		}
+	}
+
+	memcpy(watch->devices, found, found_count * sizeof(usb_dev_t));
+	watch->device_count = found_count;
+	++watch->scans;
+
+	pthread_mutex_unlock(&watch->mutex);
+
+	for (index = 0; (index < removed_count) && watch->on_removal; ++index)
+	{
+		watch->on_removal(&removed[index], watch->user_data);
+	}
+	for (index = 0; (index < arrived_count) && watch->on_arrival; ++index)
+	{
+		watch->on_arrival(&arrived[index], watch->user_data);
+	}
+}
+
+/*!
+	A kernel uevent is "ACTION@DEVPATH" followed by KEY=VALUE strings.
+	An udev event starts with the "libudev" header, the KEY=VALUE
+	strings follow at an offset which is given in the header.
+	Both are separated by zero octets.
+*/
+int usb_watch_is_relevant(const char* message, uint32_t length)
+{
+	const char* p = message;
+	const char* end = message + length;
+	uint32_t offset = 0;
+	int subsystem = 0;
+	int action = 0;
+
+	if ((length >= 40) && (memcmp(message, "libudev", 8) == 0))
+	{
+		/* properties_off follows prefix[8], magic and header_size */
+		memcpy(&offset, message + 16, sizeof(offset));
+		if (offset >= length)
+		{
+			return 0;
+		}
+		p = message + offset;
+	}
+
+	for (; p < end; p += strlen(p) + 1)
+	{
+		if (strcmp(p, "SUBSYSTEM=hidraw") == 0)
+		{
+			subsystem = 1;
+		}
+		else if ((strcmp(p, "ACTION=add") == 0) || (strcmp(p, "ACTION=remove") == 0))
+		{
+			action = 1;
+		}
+	}
+
+	return subsystem && action;
+}
+
+int usb_dev_equal(const usb_dev_t* a, const usb_dev_t* b)
+{
+	return (a->ind_addr == b->ind_addr) && (a->media_tytes == b->media_tytes) &&
+	       (a->usb_vendor_id == b->usb_vendor_id) && (a->usb_product_id == b->usb_product_id);
+}
+
+void fake_event(int fd, const char* action)
+{
+	char message[256];
+	int length = 0;
+
+	length = snprintf(message, sizeof(message), "%s@/devices/usb1/1-1/hidraw/hidraw0", action) + 1;
+	length += snprintf(message + length, sizeof(message) - length, "ACTION=%s", action) + 1;
+	length += snprintf(message + length, sizeof(message) - length, "SUBSYSTEM=hidraw") + 1;
+
+	send(fd, message, (size_t) length, 0);
+}
+
+error_t fake_enum(usb_dev_t items[], uint32_t* items_length)
+{
+	pthread_mutex_lock(&fake_bus.mutex);
+	if (*items_length > fake_bus.device_count)
+	{
+		*items_length = fake_bus.device_count;
+	}
+	memcpy(items, fake_bus.devices, *items_length * sizeof(usb_dev_t));
+	pthread_mutex_unlock(&fake_bus.mutex);
+
+	return KDRIVE_ERROR_NONE;
+}
+
+void on_arrival(const usb_dev_t* dev, void* user_data)
+{
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Arrived: index %u, %04X:%04X, %u.%u.%u",
+	                 dev->internal_usb_index, dev->usb_vendor_id, dev->usb_product_id,
+	                 (dev->ind_addr >> 12) & 0x0F, (dev->ind_addr >> 8) & 0x0F, dev->ind_addr & 0xFF);
+}
+
+void on_removal(const usb_dev_t* dev, void* user_data)
+{
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "Removed: index %u, %04X:%04X, %u.%u.%u",
+	                 dev->internal_usb_index, dev->usb_vendor_id, dev->usb_product_id,
+	                 (dev->ind_addr >> 12) & 0x0F, (dev->ind_addr >> 8) & 0x0F, dev->ind_addr & 0xFF);
+}
+
+uint32_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint32_t) ts.tv_sec * 1000u) + ((uint32_t) ts.tv_nsec / 1000000u);
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}
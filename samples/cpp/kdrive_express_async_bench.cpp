@@ -0,0 +1,233 @@
+//
+// Copyright (c) 2002-2016 WEINZIERL ENGINEERING GmbH
+// All rights reserved.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY DAMAGES OR OTHER LIABILITY,
+// WHETHER IN CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE
+//
+
+/*
+	Compares the coroutine layer (kdrive_express_async.hpp) with
+	thread-per-request for group value reads.
+
+	Both variants read the same group addresses, all reads in flight
+	at the same time. Each read has its own group address: concurrent
+	reads of one address share a single GroupValue_Read in the coroutine
+	layer, so both variants send one telegram per read. The coroutine
+	variant uses the 2 executor threads and the timer thread of the
+	access port, thread-per-request uses one thread per read, each
+	blocking in kdrive_ap_read_group_object.
+
+	usage: kdrive_express_async_bench [reads] [first group address]
+	the reads use the group addresses first ... first + reads - 1
+	i.e. kdrive_express_async_bench 1000 0x0900
+
+	g++ -std=c++20 -I../../include -o kdrive_express_async_bench kdrive_express_async_bench.cpp -lkdriveExpress -lpthread
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <latch>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <kdrive_express_async.hpp>
+
+#define ERROR_MESSAGE_LEN	(128)	/*!< kdriveExpress Error Messages */
+#define MAX_TELEGRAM_LEN	(64)	/*!< max telegram buffer size */
+#define READ_TIMEOUT		(1000)	/*!< timeout of a read in ms */
+
+/*******************************
+** Private Types
+********************************/
+
+/*!
+	The result of a run
+*/
+struct bench_result
+{
+	std::atomic<uint32_t> ok{0};
+	std::atomic<uint32_t> failed{0};
+	uint32_t threads = 0;
+	long long elapsed_ms = 0;
+};
+
+/*******************************
+** Private Functions
+********************************/
+
+/*!
+	Reads all addresses with coroutines
+*/
+static void bench_async(const kdrive::access_port_handle& ap, uint32_t reads, uint16_t first, bench_result& result);
+
+/*!
+	Reads all addresses with one thread per read
+*/
+static void bench_threads(int32_t ap, uint32_t reads, uint16_t first, bench_result& result);
+
+/*!
+	A single read of bench_async
+*/
+static kdrive::async::task<void> read_one(kdrive::async::access_port& port, uint16_t address,
+        bench_result& result, std::latch& done);
+
+/*!
+	Logs the result of a run
+*/
+static void print_result(const char* name, uint32_t reads, const bench_result& result);
+
+/*!
+	Called when an error occurs
+*/
+static void error_callback(error_t e, void* user_data);
+
+/*******************************
+** Main
+********************************/
+
+int main(int argc, char* argv[])
+{
+	const uint32_t reads = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 0) : 1000;
+	const uint16_t first = (argc > 2) ? (uint16_t) strtoul(argv[2], NULL, 0) : 0x0900;
+	kdrive::access_port_handle ap = kdrive::access_port_handle::create();
+
+	/* Configure the logging level and console logger */
+	kdrive_logger_set_level(KDRIVE_LOGGER_INFORMATION);
+	kdrive_logger_console();
+
+	/*
+		We register an error callback as a convenience logger function to
+		print out the error message when an error occurs.
+	*/
+	kdrive_register_error_callback(&error_callback, NULL);
+
+	if (!ap || (kdrive_ap_enum_usb(ap.get()) == 0) ||
+	        (kdrive_ap_open_usb(ap.get(), 0) != KDRIVE_ERROR_NONE))
+	{
+		kdrive_logger(KDRIVE_LOGGER_ERROR, "Unable to open the access port");
+		return -1;
+	}
+
+	{
+		bench_result result;
+		bench_async(ap, reads, first, result);
+		print_result("coroutines", reads, result);
+	}
+
+	{
+		bench_result result;
+		bench_threads(ap.get(), reads, first, result);
+		print_result("thread-per-request", reads, result);
+	}
+
+	return 0;
+}
+
+/*******************************
+** Private Functions
+********************************/
+
+void bench_async(const kdrive::access_port_handle& ap, uint32_t reads, uint16_t first, bench_result& result)
+{
+	kdrive::async::executor ex(2);
+	kdrive::async::access_port port(ap, ex);
+	std::latch done(reads);
+	const auto start = std::chrono::steady_clock::now();
+
+	for (uint32_t index = 0; index < reads; ++index)
+	{
+		kdrive::async::spawn(read_one(port, (uint16_t)(first + index), result, done));
+	}
+	done.wait();
+
+	result.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                        std::chrono::steady_clock::now() - start).count();
+	result.threads = 3;
+}
+
+/*!
+	A thread which can't be created counts as a failed read
+*/
+void bench_threads(int32_t ap, uint32_t reads, uint16_t first, bench_result& result)
+{
+	std::vector<std::thread> threads;
+	const auto start = std::chrono::steady_clock::now();
+
+	threads.reserve(reads);
+	for (uint32_t index = 0; index < reads; ++index)
+	{
+		const uint16_t address = (uint16_t)(first + index);
+		try
+		{
+			threads.emplace_back([ap, address, &result]
+			{
+				uint8_t telegram[MAX_TELEGRAM_LEN];
+				if (kdrive_ap_read_group_object(ap, address, telegram, sizeof(telegram), READ_TIMEOUT) > 0)
+				{
+					++result.ok;
+				}
+				else
+				{
+					++result.failed;
+				}
+			});
+		}
+		catch (const std::system_error&)
+		{
+			++result.failed;
+		}
+	}
+	result.threads = (uint32_t) threads.size();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	result.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                        std::chrono::steady_clock::now() - start).count();
+}
+
+kdrive::async::task<void> read_one(kdrive::async::access_port& port, uint16_t address,
+                                   bench_result& result, std::latch& done)
+{
+	const kdrive::async::group_value value = co_await port.read_group(address, READ_TIMEOUT);
+	if (value.error == KDRIVE_ERROR_NONE)
+	{
+		++result.ok;
+	}
+	else
+	{
+		++result.failed;
+	}
+	done.count_down();
+}
+
+void print_result(const char* name, uint32_t reads, const bench_result& result)
+{
+	kdrive_logger_ex(KDRIVE_LOGGER_INFORMATION, "%-20s %u reads: %u ok, %u failed, %lld ms, %u threads",
+	                 name, reads, result.ok.load(), result.failed.load(), result.elapsed_ms, result.threads);
+}
+
+/*!
+	Called when a kdrive error exception is raised.
+	The handling in the error callback is typically
+	application specific. And here we simply show
+	the error message.
+*/
+void error_callback(error_t e, void* user_data)
+{
+	if (e != KDRIVE_TIMEOUT_ERROR)
+	{
+		static char error_message[ERROR_MESSAGE_LEN];
+		kdrive_get_error_message(e, error_message, ERROR_MESSAGE_LEN);
+		kdrive_logger_ex(KDRIVE_LOGGER_ERROR, "kdrive error: %s", error_message);
+	}
+}